@@ -0,0 +1,188 @@
+// Quality-per-cost benchmark for the advection schemes.
+//
+// Runs the same resolution-independent flow (a periodic array of vortices
+// carrying fine dye stripes, set up in domain coordinates) at a range of
+// grid sizes and measures how much of the initial kinetic energy and dye
+// variance survives. The semi-Lagrangian scheme at the reference size sets
+// the bar; for every scheme the smallest grid that retains at least as
+// much of both is reported with its step time, i.e. how far resolution can
+// be cut for the same quality. Results are written as JSON.
+#include "fluid.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    int size = 256;      // reference grid, square
+    int minSize = 32;
+    int sizeStep = 16;
+    int steps = 120;
+    int threads = 1;
+    std::string jsonPath;
+};
+
+struct Retention {
+    double energy;  // kinetic energy after the run over before
+    double detail;  // dye variance after the run over before
+    double msPerStep;
+};
+
+struct Match {
+    AdvectionScheme scheme;
+    int size;  // smallest size retaining as much as the reference, 0 if none
+    Retention retention;
+};
+
+const double PI = 3.14159265358979323846;
+
+// Kinetic energy and dye variance per unit area
+void measure(const FluidSimulation& fluid, double& energy, double& variance) {
+    const int w = fluid.getWidth();
+    const int h = fluid.getHeight();
+    const float* u = fluid.getVelocityX();
+    const float* v = fluid.getVelocityY();
+    ChannelView dye = fluid.getChannel(0);
+    double e = 0;
+    double sum = 0;
+    double sumSquares = 0;
+    for (int y = 1; y < h - 1; y++) {
+        for (int x = 1; x < w - 1; x++) {
+            const int idx = x + y * w;
+            e += static_cast<double>(u[idx]) * u[idx] + static_cast<double>(v[idx]) * v[idx];
+            sum += dye[idx];
+            sumSquares += static_cast<double>(dye[idx]) * dye[idx];
+        }
+    }
+    const double cells = static_cast<double>(w - 2) * (h - 2);
+    energy = e / cells;
+    variance = sumSquares / cells - (sum / cells) * (sum / cells);
+}
+
+Retention run(AdvectionScheme scheme, int size, const BenchOptions& options) {
+    FluidSimulation fluid(size, size, 0.0f, 0.0f, 0.016f);
+    fluid.setThreadCount(options.threads);
+    fluid.setAdvectionScheme(scheme);
+    // Cellular vortices (divergence free, walls at the domain edges) and
+    // eight dye stripes across them
+    for (int y = 1; y < size - 1; y++) {
+        for (int x = 1; x < size - 1; x++) {
+            const double px = (x - 0.5) / (size - 2);
+            const double py = (y - 0.5) / (size - 2);
+            const float u = static_cast<float>(0.5 * std::sin(2 * PI * px) * std::cos(2 * PI * py));
+            const float v = static_cast<float>(-0.5 * std::cos(2 * PI * px) * std::sin(2 * PI * py));
+            fluid.addVelocity(x, y, u, v);
+            fluid.addToChannel(0, x, y, static_cast<float>(0.5 + 0.5 * std::sin(16 * PI * px)));
+        }
+    }
+    double energy0;
+    double variance0;
+    measure(fluid, energy0, variance0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < options.steps; k++) fluid.step();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double energy;
+    double variance;
+    measure(fluid, energy, variance);
+    return Retention{energy / energy0, variance / variance0, seconds * 1e3 / options.steps};
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --size N          reference grid size, square (default 256)\n"
+              << "  --min-size N      smallest grid tried (default 32)\n"
+              << "  --size-step N     spacing of the grids tried (default 16)\n"
+              << "  --steps N         steps per run (default 120)\n"
+              << "  --threads N       solver threads (default 1)\n"
+              << "  --json PATH       write results to PATH instead of stdout\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            options.size = std::max(8, std::atoi(argv[++i]));
+        } else if (arg == "--min-size" && hasValue) {
+            options.minSize = std::max(8, std::atoi(argv[++i]));
+        } else if (arg == "--size-step" && hasValue) {
+            options.sizeStep = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--steps" && hasValue) {
+            options.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    const Retention reference = run(AdvectionScheme::SemiLagrangian, options.size, options);
+    std::fprintf(stderr, "reference: %s %dx%d  energy %.3f  detail %.3f  %.3f ms/step\n",
+                 advectionSchemeName(AdvectionScheme::SemiLagrangian), options.size, options.size,
+                 reference.energy, reference.detail, reference.msPerStep);
+
+    // Retention grows with the grid size, so the first size that matches is the smallest
+    std::vector<Match> matches;
+    for (AdvectionScheme scheme : {AdvectionScheme::SemiLagrangian, AdvectionScheme::MacCormack, AdvectionScheme::BFECC}) {
+        Match match{scheme, 0, reference};
+        for (int size = options.minSize; size <= options.size; size += options.sizeStep) {
+            Retention retention = run(scheme, size, options);
+            if (retention.energy >= reference.energy && retention.detail >= reference.detail) {
+                match.size = size;
+                match.retention = retention;
+                break;
+            }
+        }
+        if (match.size == 0) {
+            std::fprintf(stderr, "%-16s no size up to %d matches\n", advectionSchemeName(scheme), options.size);
+        } else {
+            std::fprintf(stderr, "%-16s matches at %4dx%-4d energy %.3f  detail %.3f  %8.3f ms/step  speedup %5.2f\n",
+                         advectionSchemeName(scheme), match.size, match.size, match.retention.energy,
+                         match.retention.detail, match.retention.msPerStep,
+                         reference.msPerStep / match.retention.msPerStep);
+        }
+        matches.push_back(match);
+    }
+
+    std::ofstream file;
+    if (!options.jsonPath.empty()) {
+        file.open(options.jsonPath);
+        if (!file) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.jsonPath.empty() ? std::cout : file;
+    out << "{\n  \"benchmark\": \"advection_bench\",\n  \"unit\": \"ms/step\",\n"
+        << "  \"referenceSize\": " << options.size << ", \"steps\": " << options.steps
+        << ", \"threads\": " << options.threads << ",\n"
+        << "  \"reference\": {\"energy\": " << reference.energy << ", \"detail\": " << reference.detail
+        << ", \"step\": " << reference.msPerStep << "},\n  \"results\": [\n";
+    for (size_t m = 0; m < matches.size(); m++) {
+        const Match& match = matches[m];
+        out << "    {\"scheme\": \"" << advectionSchemeName(match.scheme) << "\", \"size\": " << match.size;
+        if (match.size > 0) {
+            out << ", \"energy\": " << match.retention.energy << ", \"detail\": " << match.retention.detail
+                << ", \"step\": " << match.retention.msPerStep
+                << ", \"speedup\": " << reference.msPerStep / match.retention.msPerStep;
+        }
+        out << "}" << (m + 1 < matches.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Throughput benchmark for FluidEnsemble.
+//
+// Steps a parameter sweep over diffusion, viscosity and dt once as separate
+// FluidSimulation objects and once as one ensemble, reports both in
+// cell-steps per second and checks that every member stayed within
+// rounding of its standalone simulation. Results are written as JSON.
+#include "ensemble.hpp"
+#include "fluid.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    int width = 300;
+    int height = 200;
+    int members = 32;
+    int steps = 50;
+    int threads = 1;
+    // Largest difference from the standalone simulation accepted, relative
+    // to the field's largest magnitude
+    double tolerance = 1e-3;
+    std::string jsonPath;
+};
+
+// Spreads the members over a grid of diffusion, viscosity and dt values
+std::vector<EnsembleMember> makeSweep(int count) {
+    const float diffusions[] = {0.0000001f, 0.000001f, 0.00001f, 0.0001f};
+    const float viscosities[] = {0.0000001f, 0.000001f, 0.00001f, 0.0001f};
+    std::vector<EnsembleMember> members;
+    for (int m = 0; m < count; m++) {
+        EnsembleMember member;
+        member.diffusion = diffusions[m % 4];
+        member.viscosity = viscosities[(m / 4) % 4];
+        member.dt = 0.008f + 0.002f * (m / 16 % 5);
+        members.push_back(member);
+    }
+    return members;
+}
+
+// Inflow speed that carries the dye half a cell per step. fluid_bench's
+// inflow (200) moves it hundreds of cells per step; the flow then turns
+// chaotic within a few dozen steps and rounding differences between the
+// ensemble and the standalone solver grow to the size of the field.
+float inflowSpeed(int width, int height, float dt) {
+    return 0.5f / (dt * (std::max(width, height) - 2));
+}
+
+// Same region as fluid_bench's inflow, scaled per member so no two inputs
+// coincide
+template <typename Add>
+void drive(int width, int height, int member, Add&& add) {
+    int radius = std::max(2, height / 50);
+    int cx = width / 8;
+    int cy = height / 2;
+    float strength = 1.0f + 0.05f * member;
+    for (int y = cy - radius; y <= cy + radius; y++) {
+        for (int x = cx - radius; x <= cx + radius; x++) add(x, y, strength);
+    }
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Largest |a - b| relative to the largest |b|
+double relativeDifference(const float* a, const float* b, size_t count) {
+    double difference = 0;
+    double magnitude = 0;
+    for (size_t k = 0; k < count; k++) {
+        difference = std::max(difference, static_cast<double>(std::fabs(a[k] - b[k])));
+        magnitude = std::max(magnitude, static_cast<double>(std::fabs(b[k])));
+    }
+    return magnitude > 0 ? difference / magnitude : difference;
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --size WxH        grid size of every member (default 300x200)\n"
+              << "  --members N       ensemble size (default 32)\n"
+              << "  --steps N         steps per run (default 50)\n"
+              << "  --threads N       solver threads (default 1)\n"
+              << "  --tolerance T     accepted relative difference per field (default 1e-3)\n"
+              << "  --json PATH       write results to PATH instead of stdout\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 ||
+                options.width < 3 || options.height < 3) {
+                std::cerr << "Invalid --size value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--members" && hasValue) {
+            options.members = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--steps" && hasValue) {
+            options.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = std::atof(argv[++i]);
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    const int width = options.width;
+    const int height = options.height;
+    const std::vector<EnsembleMember> sweep = makeSweep(options.members);
+    const double cellSteps = static_cast<double>(width) * height * options.members * options.steps;
+
+    // Standalone simulations, stepped one after the other
+    std::vector<std::unique_ptr<FluidSimulation>> singles;
+    for (const EnsembleMember& member : sweep) {
+        singles.push_back(std::make_unique<FluidSimulation>(width, height, member.diffusion, member.viscosity, member.dt));
+        singles.back()->setThreadCount(options.threads);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < options.steps; k++) {
+        for (int m = 0; m < options.members; m++) {
+            FluidSimulation& fluid = *singles[m];
+            const float speed = inflowSpeed(width, height, sweep[m].dt);
+            drive(width, height, m, [&](int x, int y, float s) {
+                fluid.addDensity(x, y, 100 * s, 0, 128, 255);
+                fluid.addVelocity(x, y, speed * s, 0.0f);
+            });
+            fluid.step();
+        }
+    }
+    const double singleSeconds = seconds(start);
+
+    FluidEnsemble ensemble(width, height, sweep);
+    ensemble.setThreadCount(options.threads);
+    for (int k = 0; k < options.steps; k++) {
+        for (int m = 0; m < options.members; m++) {
+            const float speed = inflowSpeed(width, height, sweep[m].dt);
+            drive(width, height, m, [&](int x, int y, float s) {
+                ensemble.addDensity(m, x, y, 100 * s, 0, 128, 255);
+                ensemble.addVelocity(m, x, y, speed * s, 0.0f);
+            });
+        }
+        ensemble.step();
+    }
+
+    // Worst member over velocity and every dye channel
+    const size_t cells = static_cast<size_t>(width) * height;
+    std::vector<float> first(cells);
+    std::vector<float> second(cells);
+    std::vector<float> expected(cells);
+    double worst = 0;
+    for (int m = 0; m < options.members; m++) {
+        const FluidSimulation& fluid = *singles[m];
+        ensemble.copyVelocity(m, first.data(), second.data());
+        worst = std::max(worst, relativeDifference(first.data(), fluid.getVelocityX(), cells));
+        worst = std::max(worst, relativeDifference(second.data(), fluid.getVelocityY(), cells));
+        for (int c = 0; c < FluidEnsemble::CHANNELS; c++) {
+            ensemble.copyChannel(m, c, first.data());
+            ChannelView channel = fluid.getChannel(c);
+            for (size_t idx = 0; idx < cells; idx++) expected[idx] = channel[static_cast<int>(idx)];
+            worst = std::max(worst, relativeDifference(first.data(), expected.data(), cells));
+        }
+    }
+
+    const double singleRate = cellSteps / singleSeconds;
+    const double ensembleRate = ensemble.getThroughput();
+    std::fprintf(stderr, "%d members of %dx%d, %d steps\n", options.members, width, height, options.steps);
+    std::fprintf(stderr, "  separate  %10.3e cell-steps/s\n", singleRate);
+    std::fprintf(stderr, "  ensemble  %10.3e cell-steps/s  speedup %5.2f  max relative difference %g\n",
+                 ensembleRate, ensembleRate / singleRate, worst);
+
+    std::ofstream file;
+    if (!options.jsonPath.empty()) {
+        file.open(options.jsonPath);
+        if (!file) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.jsonPath.empty() ? std::cout : file;
+    out << "{\n  \"benchmark\": \"ensemble_bench\",\n  \"unit\": \"cell-steps/s\",\n"
+        << "  \"width\": " << width << ", \"height\": " << height << ", \"members\": " << options.members
+        << ", \"lanes\": " << FluidEnsemble::LANES << ", \"steps\": " << options.steps
+        << ", \"threads\": " << options.threads << ",\n"
+        << "  \"separate\": " << singleRate << ", \"ensemble\": " << ensembleRate
+        << ", \"speedup\": " << ensembleRate / singleRate << ", \"maxRelativeDifference\": " << worst << "\n}\n";
+
+    if (!(worst <= options.tolerance)) {
+        std::cerr << "Ensemble members differ from their standalone simulations" << std::endl;
+        return 1;
+    }
+    return 0;
+}
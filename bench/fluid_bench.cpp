@@ -0,0 +1,487 @@
+// Headless benchmark for FluidSimulation::step().
+//
+// Runs scripted scenarios at several grid sizes and reports the time spent
+// per cell per step in each solver phase. Results are written as JSON so
+// runs from different releases can be compared mechanically.
+#include "fluid.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every heap allocation in the process goes through these, so the benchmark
+// can check that step() does not allocate
+static std::atomic<std::uint64_t> heapAllocations{0};
+
+void* operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = static_cast<std::size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (size + align - 1) / align * align)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace {
+
+struct GridSize {
+    int width;
+    int height;
+};
+
+struct Scenario {
+    const char* name;
+    std::function<void(FluidSimulation&, int)> drive;  // called before each step
+};
+
+struct BenchOptions {
+    std::vector<GridSize> sizes = {{300, 200}, {512, 512}, {1024, 1024}, {2048, 2048}, {4096, 4096}};
+    std::vector<std::string> scenarioFilter;
+    std::vector<int> threadCounts = {ThreadPool::defaultThreadCount()};
+    Relaxation relaxation = Relaxation::RedBlack;
+    int temporalDepth = 1;  // 0 = autotuned
+    SimdLevel simd = detectSimdLevel();
+    SolverType pressureSolver = SolverType::Relaxation;
+    SolverSettings pressureSettings;
+    DyeLayout dyeLayout = DyeLayout::Planar;
+    DyeStorage dyeStorage = DyeStorage::Float32;
+    AdvectionScheme advection = AdvectionScheme::SemiLagrangian;
+    int channels = 3;
+    float activityEpsilon = 0;
+    bool checkAllocations = false;
+    int fixedSteps = 0;
+    double budget = 1e8;
+    int warmup = 2;
+    std::string jsonPath;
+};
+
+struct Result {
+    std::string scenario;
+    GridSize size;
+    int steps;
+    int threads;
+    int temporalDepth;
+    SimdLevel simd;
+    SolverType pressureSolver;
+    DyeLayout dyeLayout;
+    DyeStorage dyeStorage;
+    AdvectionScheme advection;
+    int channels;
+    double activeFraction;      // mean over the timed steps
+    double pressureIterations;  // mean per solve
+    double pressureResidual;    // mean RMS residual per solve
+    double stepNsPerCell;
+    double allocationsPerStep;
+    double phaseNsPerCell[static_cast<int>(Phase::Count)];
+};
+
+// Small deterministic generator so every run injects the same input
+struct Lcg {
+    std::uint32_t state;
+    int next(int bound) {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<int>((state >> 8) % static_cast<std::uint32_t>(bound));
+    }
+};
+
+std::vector<Scenario> makeScenarios() {
+    std::vector<Scenario> scenarios;
+
+    // Constant emitter on the left edge pushing dye to the right
+    scenarios.push_back({"inflow", [](FluidSimulation& fluid, int) {
+        int w = fluid.getWidth();
+        int h = fluid.getHeight();
+        int radius = std::max(2, h / 50);
+        int cx = w / 8;
+        int cy = h / 2;
+        for (int y = cy - radius; y <= cy + radius; y++) {
+            for (int x = cx - radius; x <= cx + radius; x++) {
+                fluid.addDensity(x, y, 100, 0, 128, 255);
+                fluid.addVelocity(x, y, 200.0f, 0.0f);
+            }
+        }
+    }});
+
+    // An explosion at a pseudo-random position every few steps
+    scenarios.push_back({"explosions", [](FluidSimulation& fluid, int step) {
+        if (step % 5 != 0) return;
+        Lcg rng{static_cast<std::uint32_t>(step) * 2654435761u + 1u};
+        int x = 1 + rng.next(fluid.getWidth() - 2);
+        int y = 1 + rng.next(fluid.getHeight() - 2);
+        fluid.createExplosion(x, y, 100.0f, 255, 0, 255);
+    }});
+
+    // A few explosions up front, then the field is left to decay
+    scenarios.push_back({"decay", [](FluidSimulation& fluid, int step) {
+        if (step != 0) return;
+        int w = fluid.getWidth();
+        int h = fluid.getHeight();
+        fluid.createExplosion(w / 4, h / 4, 100.0f, 255, 0, 0);
+        fluid.createExplosion(3 * w / 4, h / 2, 100.0f, 0, 255, 0);
+        fluid.createExplosion(w / 2, 3 * h / 4, 100.0f, 0, 0, 255);
+    }});
+
+    // The inflow against a barrier: a disc in its path and the right half
+    // of the grid solid, so about half the cells are stepped
+    scenarios.push_back({"barrier", [inflow = scenarios.front().drive](FluidSimulation& fluid, int step) {
+        if (step == 0) {
+            int w = fluid.getWidth();
+            int h = fluid.getHeight();
+            for (int y = 0; y < h; y++) {
+                for (int x = w / 2; x < w; x++) fluid.setSolid(x, y, true);
+            }
+            fluid.fillObstacleCircle(w / 4, h / 2, h / 10.0f, true);
+        }
+        inflow(fluid, step);
+    }});
+
+    // Many small emitters circling the centre, queued as splats, plus a
+    // brush stroke sweeping across the grid
+    scenarios.push_back({"emitters", [](FluidSimulation& fluid, int step) {
+        const float w = static_cast<float>(fluid.getWidth());
+        const float h = static_cast<float>(fluid.getHeight());
+        const float radius = std::max(1.5f, h / 100);
+        for (int e = 0; e < 64; e++) {
+            float angle = 0.0981748f * e + 0.05f * step;
+            float x = w / 2 + 0.35f * w * std::cos(angle);
+            float y = h / 2 + 0.35f * h * std::sin(angle);
+            fluid.queueSplat(Splat::gaussian(x, y, radius, 50, 255, 128 + 2 * e, 0,
+                                             -60.0f * std::sin(angle), 60.0f * std::cos(angle)));
+        }
+        float t = (step % 50) / 50.0f;
+        fluid.queueSplat(Splat::segment(w * t, h / 4, w * (t + 0.02f), h / 4, 0, 100, 0, 255, 128, 100.0f, 0));
+    }});
+
+    return scenarios;
+}
+
+std::vector<std::string> splitList(const std::string& arg) {
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) items.push_back(item);
+    return items;
+}
+
+bool parseSizes(const std::string& arg, std::vector<GridSize>& sizes) {
+    sizes.clear();
+    for (const std::string& item : splitList(arg)) {
+        GridSize size;
+        if (std::sscanf(item.c_str(), "%dx%d", &size.width, &size.height) != 2 ||
+            size.width < 3 || size.height < 3) {
+            return false;
+        }
+        sizes.push_back(size);
+    }
+    return !sizes.empty();
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --sizes WxH,...     grid sizes (default 300x200,512x512,1024x1024,2048x2048,4096x4096)\n"
+              << "  --scenarios a,b     subset of inflow,explosions,decay,barrier,emitters (default all)\n"
+              << "  --steps N           timed steps per run (default: scaled by --budget)\n"
+              << "  --budget N          cell-steps per run when --steps is not given (default 1e8)\n"
+              << "  --threads N,...     solver thread counts to sweep (default: hardware thread count)\n"
+              << "  --lexicographic     use the single-threaded lexicographic Gauss-Seidel sweep\n"
+              << "  --temporal-depth D  red-black sweeps per wavefront pass, or auto (default 1)\n"
+              << "  --simd LEVEL        cap row kernels at scalar, sse4.1, avx2 or avx512\n"
+              << "  --pressure-solver S relaxation, multigrid or cg (default relaxation)\n"
+              << "  --tolerance T       relative residual tolerance of the pressure solve (default 0: off)\n"
+              << "  --max-iterations N  pressure sweeps, V-cycles or CG iterations (default 20)\n"
+              << "  --warm-start        start each pressure solve from the previous pressure\n"
+              << "  --dye-layout L      planar, interleaved or padded dye storage (default planar)\n"
+              << "  --dye-storage S     f32 or f16 dye between steps (f16 implies planar)\n"
+              << "  --advection A       semi-lagrangian, maccormack or bfecc (default semi-lagrangian)\n"
+              << "  --channels N        dye channels, at least 3 (default 3)\n"
+              << "  --activity-eps E    skip tiles quieter than E (default 0: step every cell)\n"
+              << "  --check-allocations fail if step() allocates after the warmup steps\n"
+              << "  --warmup N          untimed steps before measuring (default 2)\n"
+              << "  --json PATH         write results to PATH instead of stdout\n";
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"benchmark\": \"fluid_bench\",\n  \"unit\": \"ns/cell/step\",\n  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result& res = results[r];
+        out << "    {\"scenario\": \"" << res.scenario << "\""
+            << ", \"width\": " << res.size.width
+            << ", \"height\": " << res.size.height
+            << ", \"steps\": " << res.steps
+            << ", \"threads\": " << res.threads
+            << ", \"temporalDepth\": " << res.temporalDepth
+            << ", \"simd\": \"" << simdLevelName(res.simd) << "\""
+            << ", \"pressureSolver\": \"" << solverTypeName(res.pressureSolver) << "\""
+            << ", \"dyeLayout\": \"" << dyeLayoutName(res.dyeLayout) << "\""
+            << ", \"dyeStorage\": \"" << dyeStorageName(res.dyeStorage) << "\""
+            << ", \"advection\": \"" << advectionSchemeName(res.advection) << "\""
+            << ", \"channels\": " << res.channels
+            << ", \"activeFraction\": " << res.activeFraction
+            << ", \"pressureIterations\": " << res.pressureIterations
+            << ", \"pressureResidual\": " << res.pressureResidual
+            << ", \"step\": " << res.stepNsPerCell
+            << ", \"allocationsPerStep\": " << res.allocationsPerStep
+            << ", \"phases\": {";
+        for (int p = 0; p < static_cast<int>(Phase::Count); p++) {
+            out << (p ? ", " : "") << "\"" << phaseName(static_cast<Phase>(p)) << "\": " << res.phaseNsPerCell[p];
+        }
+        out << "}}" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+Result runScenario(const Scenario& scenario, const GridSize& size, int threads, const BenchOptions& options) {
+    double cells = static_cast<double>(size.width) * size.height;
+    int steps = options.fixedSteps > 0 ? options.fixedSteps
+                                       : static_cast<int>(std::min(200.0, std::max(3.0, options.budget / cells)));
+
+    FluidSimulation fluid(size.width, size.height, 0.0000001f, 0.0000001f, 0.016f);
+    fluid.setThreadCount(threads);
+    fluid.setRelaxation(options.relaxation);
+    fluid.setSimdLevel(options.simd);
+    SolverSettings pressureSettings = options.pressureSettings;
+    pressureSettings.measureResidual = true;
+    fluid.setPressureSolver(options.pressureSolver, pressureSettings);
+    while (fluid.getChannelCount() < options.channels) fluid.addChannel(0.0000001f);
+    fluid.setDyeLayout(options.dyeLayout);
+    fluid.setDyeStorage(options.dyeStorage);
+    fluid.setAdvectionScheme(options.advection);
+    fluid.setActivityEpsilon(options.activityEpsilon);
+    if (options.temporalDepth > 0) {
+        fluid.setTemporalDepth(options.temporalDepth);
+    } else {
+        fluid.autotuneTemporalDepth();
+    }
+
+    int stepIndex = 0;
+    for (int k = 0; k < options.warmup; k++) {
+        scenario.drive(fluid, stepIndex++);
+        fluid.step();
+    }
+
+    Profiler& profiler = fluid.getProfiler();
+    profiler.reset();
+    profiler.setEnabled(true);
+
+    std::uint64_t stepNanos = 0;
+    std::uint64_t allocations = 0;
+    int pressureSolves = 0;
+    double pressureIterations = 0;
+    double pressureResidual = 0;
+    double activeFraction = 0;
+    for (int k = 0; k < steps; k++) {
+        scenario.drive(fluid, stepIndex++);
+        std::uint64_t allocationsBefore = heapAllocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        fluid.step();
+        stepNanos += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        allocations += heapAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+        activeFraction += fluid.getActiveFraction();
+        for (const SolveRecord& record : fluid.getLastSolveStats()) {
+            if (record.kind != SolveKind::Project) continue;
+            pressureSolves++;
+            pressureIterations += record.stats.iterations;
+            pressureResidual += record.stats.residual;
+        }
+    }
+    profiler.setEnabled(false);
+
+    Result res;
+    res.scenario = scenario.name;
+    res.size = size;
+    res.steps = steps;
+    res.threads = threads;
+    res.temporalDepth = fluid.getTemporalDepth();
+    res.simd = fluid.getSimdLevel();
+    res.pressureSolver = options.pressureSolver;
+    res.dyeLayout = fluid.getDyeLayout();
+    res.dyeStorage = fluid.getDyeStorage();
+    res.advection = fluid.getAdvectionScheme();
+    res.channels = fluid.getChannelCount();
+    res.activeFraction = activeFraction / steps;
+    res.pressureIterations = pressureSolves ? pressureIterations / pressureSolves : 0;
+    res.pressureResidual = pressureSolves ? pressureResidual / pressureSolves : 0;
+    res.stepNsPerCell = stepNanos / (cells * steps);
+    res.allocationsPerStep = static_cast<double>(allocations) / steps;
+    for (int p = 0; p < static_cast<int>(Phase::Count); p++) {
+        res.phaseNsPerCell[p] = profiler.totalNanos(static_cast<Phase>(p)) / (cells * steps);
+    }
+    return res;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            if (!parseSizes(argv[++i], options.sizes)) {
+                std::cerr << "Invalid --sizes value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--scenarios" && hasValue) {
+            options.scenarioFilter = splitList(argv[++i]);
+        } else if (arg == "--steps" && hasValue) {
+            options.fixedSteps = std::atoi(argv[++i]);
+        } else if (arg == "--budget" && hasValue) {
+            options.budget = std::atof(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threadCounts.clear();
+            for (const std::string& count : splitList(argv[++i])) {
+                options.threadCounts.push_back(std::max(1, std::atoi(count.c_str())));
+            }
+        } else if (arg == "--lexicographic") {
+            options.relaxation = Relaxation::Lexicographic;
+        } else if (arg == "--temporal-depth" && hasValue) {
+            std::string depth = argv[++i];
+            options.temporalDepth = depth == "auto" ? 0 : std::max(1, std::atoi(depth.c_str()));
+        } else if (arg == "--simd" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}) {
+                if (name == simdLevelName(level)) {
+                    options.simd = level;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --simd level " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--pressure-solver" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (SolverType type : {SolverType::Relaxation, SolverType::Multigrid, SolverType::ConjugateGradient}) {
+                if (name == solverTypeName(type)) {
+                    options.pressureSolver = type;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --pressure-solver " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--tolerance" && hasValue) {
+            options.pressureSettings.tolerance = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--max-iterations" && hasValue) {
+            options.pressureSettings.maxIterations = std::atoi(argv[++i]);
+        } else if (arg == "--warm-start") {
+            options.pressureSettings.warmStart = true;
+        } else if (arg == "--dye-layout" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (DyeLayout layout : {DyeLayout::Planar, DyeLayout::Interleaved, DyeLayout::InterleavedPadded}) {
+                if (name == dyeLayoutName(layout)) {
+                    options.dyeLayout = layout;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --dye-layout " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--dye-storage" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (DyeStorage storage : {DyeStorage::Float32, DyeStorage::Float16}) {
+                if (name == dyeStorageName(storage)) {
+                    options.dyeStorage = storage;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --dye-storage " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--advection" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (AdvectionScheme scheme : {AdvectionScheme::SemiLagrangian, AdvectionScheme::MacCormack, AdvectionScheme::BFECC}) {
+                if (name == advectionSchemeName(scheme)) {
+                    options.advection = scheme;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --advection " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--channels" && hasValue) {
+            options.channels = std::max(3, std::atoi(argv[++i]));
+        } else if (arg == "--activity-eps" && hasValue) {
+            options.activityEpsilon = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--check-allocations") {
+            options.checkAllocations = true;
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::atoi(argv[++i]);
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::vector<Result> results;
+    bool allocated = false;
+    for (const Scenario& scenario : makeScenarios()) {
+        if (!options.scenarioFilter.empty() &&
+            std::find(options.scenarioFilter.begin(), options.scenarioFilter.end(), scenario.name) ==
+                options.scenarioFilter.end()) {
+            continue;
+        }
+
+        for (const GridSize& size : options.sizes) {
+            for (int threads : options.threadCounts) {
+                Result res = runScenario(scenario, size, threads, options);
+                results.push_back(res);
+                allocated = allocated || res.allocationsPerStep > 0;
+                std::fprintf(stderr, "%-10s %5dx%-5d %2d threads depth %2d %4d steps  %8.3f ns/cell/step"
+                             "  pressure %.1f it, residual %.3g, active %.2f\n",
+                             scenario.name, size.width, size.height, threads, res.temporalDepth, res.steps, res.stepNsPerCell,
+                             res.pressureIterations, res.pressureResidual, res.activeFraction);
+            }
+        }
+    }
+
+    if (options.jsonPath.empty()) {
+        writeJson(std::cout, results);
+    } else {
+        std::ofstream out(options.jsonPath);
+        if (!out) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+        writeJson(out, results);
+    }
+    if (options.checkAllocations && allocated) {
+        std::cerr << "step() allocated heap memory after warmup" << std::endl;
+        return 1;
+    }
+    return 0;
+}
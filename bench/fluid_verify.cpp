@@ -0,0 +1,897 @@
+// Differential check of FluidSimulation's optimized paths against
+// ReferenceSimulation (reference.hpp).
+//
+// Every backend below is a FluidSimulation configuration. Each is stepped
+// side by side with the reference on the same scripted and randomized
+// inputs, and after every step the velocity and dye fields are compared:
+// the worst max and RMS errors over the run are reported per field, relative
+// to the field's largest reference value, together with the RMS divergence
+// of both velocity fields after the final projection. A backend fails when
+// an error exceeds its tolerance, any value is NaN or infinite, or its
+// divergence exceeds the reference's by more than the allowed slack; the
+// exit status is 1 if any does. Activity tracking runs on a large grid
+// with inputs confined to one corner instead, and also fails if it keeps
+// more than half the tiles active.
+//
+// The multigrid pressure solver converges much further than the reference's
+// fixed sweeps, so it is checked on its own: a pressure problem with a
+// random right hand side is solved one V-cycle at a time at the app's grid
+// size and at sizes whose coarsening chain has odd dimensions, and the
+// residual has to fall every cycle until it reaches float precision.
+// Tracer particles are checked the same way: emitters on the walls and
+// corners of a stirred grid must only ever produce particles inside the
+// interior, and the count must match what was emitted and removed.
+// Checkpoints must restore a state that steps on bit for bit like the
+// original, and damaged files must be rejected, and recordings must decode
+// to exactly the fields captured. Results are written as JSON.
+#include "checkpoint.hpp"
+#include "fluid.hpp"
+#include "linear_solver.hpp"
+#include "particles.hpp"
+#include "recorder.hpp"
+#include "reference.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Inputs {
+    std::string name;
+    std::function<void(int step, const std::function<void(int, int, float, float)>& velocity,
+                       const std::function<void(int, int, int, float)>& dye)> drive;
+};
+
+struct Backend {
+    std::string name;
+    float tolerance;         // multiple of --tolerance allowed for this backend
+    Relaxation relaxation;   // order the reference has to follow
+    std::function<bool(FluidSimulation&)> configure;  // false if unavailable on this machine
+    // A grid and inputs of its own instead of --size and the shared inputs,
+    // for paths that only do anything on a particular flow
+    int width = 0;
+    int height = 0;
+    std::vector<Inputs> inputs;
+    // Fails when the active fraction, averaged over the run, is above this
+    float maxActiveFraction = 1;
+};
+
+struct VerifyOptions {
+    int width = 130;
+    int height = 98;
+    int steps = 60;
+    std::uint32_t seed = 1;
+    float tolerance = 1e-3f;
+    float divergenceSlack = 0.05f;  // allowed relative excess over the reference's divergence
+    std::vector<std::string> backendFilter;
+    std::string jsonPath;
+};
+
+struct MultigridResult {
+    int width;
+    int height;
+    bool passed = true;
+    std::vector<double> residuals;  // RMS after each V-cycle, the initial one first
+};
+
+struct ParticleResult {
+    bool passed = true;
+    int steps = 0;
+    int count = 0;
+    std::uint64_t emitted = 0;
+    int outside = 0;  // particle positions seen outside the interior over the run
+};
+
+struct CheckpointResult {
+    std::string name;  // dye format round-tripped, or the damage a load must reject
+    bool passed = true;
+    std::uint64_t mismatches = 0;  // values differing from the uninterrupted run, or changed by a rejected load
+    double loadMs = 0;
+};
+
+struct RecorderResult {
+    std::string backpressure;
+    bool passed = true;
+    std::uint64_t captured = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t decoded = 0;     // chunks read back
+    std::uint64_t mismatches = 0;  // decoded values differing from the captured ones, or unexpected chunks
+};
+
+struct FieldError {
+    std::string field;
+    double maxError = 0;  // worst over the run, relative to the field's largest reference value
+    double rmsError = 0;
+    std::uint64_t nonFinite = 0;  // NaN or infinite values seen over the run
+};
+
+struct Result {
+    std::string backend;
+    std::string inputs;
+    int width = 0;
+    int height = 0;
+    bool skipped = false;
+    bool passed = true;
+    std::vector<FieldError> fields;
+    double divergence = 0;           // RMS after the last step
+    double referenceDivergence = 0;
+    double activeFraction = 1;       // averaged over the run
+};
+
+// Same generator as fluid_bench, so runs are reproducible from the seed
+struct Lcg {
+    std::uint32_t state;
+    int next(int bound) {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<int>((state >> 8) % static_cast<std::uint32_t>(bound));
+    }
+    float uniform(float lo, float hi) { return lo + (hi - lo) * next(1 << 16) / 65536.0f; }
+};
+
+// A slow jet and a burst every 20 steps in the top left corner of a large
+// grid; the rest of the grid never sees any flow
+Inputs makeLocalizedInputs() {
+    return {"localized", [](int step, const auto& velocity, const auto& dye) {
+        for (int y = 40; y <= 46; y++) {
+            for (int x = 20; x <= 24; x++) {
+                velocity(x, y, 0.3f, 0.05f);
+                dye(0, x, y, 0.5f);
+                dye(2, x, y, 0.25f);
+            }
+        }
+        if (step % 20 != 0) return;
+        for (int y = -6; y <= 6; y++) {
+            for (int x = -6; x <= 6; x++) {
+                const float dist = std::sqrt(static_cast<float>(x * x + y * y));
+                if (dist > 6 || dist < 0.5f) continue;
+                const float falloff = (6 - dist) / 6;
+                velocity(60 + x, 60 + y, 0.5f * falloff * x / dist, 0.5f * falloff * y / dist);
+                dye(1, 60 + x, 60 + y, falloff);
+            }
+        }
+    }};
+}
+
+std::vector<Backend> makeBackends() {
+    std::vector<Backend> backends;
+    auto simd = [](SimdLevel level) {
+        return [level](FluidSimulation& fluid) {
+            if (static_cast<int>(level) > static_cast<int>(detectSimdLevel())) return false;
+            fluid.setSimdLevel(level);
+            return true;
+        };
+    };
+    backends.push_back({"scalar", 1, Relaxation::RedBlack, simd(SimdLevel::Scalar)});
+    backends.push_back({"sse4.1", 1, Relaxation::RedBlack, simd(SimdLevel::SSE41)});
+    backends.push_back({"avx2", 1, Relaxation::RedBlack, simd(SimdLevel::AVX2)});
+    backends.push_back({"avx512", 1, Relaxation::RedBlack, simd(SimdLevel::AVX512)});
+    backends.push_back({"threads", 1, Relaxation::RedBlack, [](FluidSimulation& fluid) {
+        fluid.setThreadCount(std::max(4, ThreadPool::defaultThreadCount()));
+        return true;
+    }});
+    backends.push_back({"temporal", 1, Relaxation::RedBlack, [](FluidSimulation& fluid) {
+        fluid.setThreadCount(std::max(4, ThreadPool::defaultThreadCount()));
+        fluid.setTemporalDepth(4);
+        return true;
+    }});
+    backends.push_back({"lexicographic", 1, Relaxation::Lexicographic, [](FluidSimulation& fluid) {
+        fluid.setRelaxation(Relaxation::Lexicographic);
+        return true;
+    }});
+    backends.push_back({"interleaved", 1, Relaxation::RedBlack, [](FluidSimulation& fluid) {
+        fluid.setDyeLayout(DyeLayout::Interleaved);
+        return true;
+    }});
+    backends.push_back({"padded", 1, Relaxation::RedBlack, [](FluidSimulation& fluid) {
+        fluid.setDyeLayout(DyeLayout::InterleavedPadded);
+        return true;
+    }});
+    // Halves keep 11 bits of mantissa and diffusion is not warm started
+    backends.push_back({"f16", 10, Relaxation::RedBlack, [](FluidSimulation& fluid) {
+        fluid.setDyeStorage(DyeStorage::Float16);
+        return true;
+    }});
+    // Quiet tiles are flushed to zero, an error of at most the epsilon. On
+    // the shared inputs every tile stays active, so this runs on a grid
+    // where the flow covers a corner and has to skip most of the rest.
+    Backend activity{"activity", 1, Relaxation::RedBlack, [](FluidSimulation& fluid) {
+        fluid.setActivityEpsilon(1e-4f);
+        return true;
+    }};
+    activity.width = 384;
+    activity.height = 384;
+    activity.inputs = {makeLocalizedInputs()};
+    activity.maxActiveFraction = 0.5f;
+    backends.push_back(activity);
+    return backends;
+}
+
+std::vector<Inputs> makeInputs(std::uint32_t seed) {
+    std::vector<Inputs> inputs;
+
+    // A jet from the left edge and a radial burst every 20 steps
+    inputs.push_back({"scripted", [](int step, const auto& velocity, const auto& dye) {
+        (void)dye;
+        for (int y = 44; y <= 52; y++) {
+            for (int x = 10; x <= 14; x++) {
+                velocity(x, y, 1.5f, 0.2f);
+                dye(0, x, y, 0.5f);
+                dye(2, x, y, 0.25f);
+            }
+        }
+        if (step % 20 != 0) return;
+        const int cx = 60 + step % 40;
+        const int cy = 40;
+        for (int y = -8; y <= 8; y++) {
+            for (int x = -8; x <= 8; x++) {
+                const float dist = std::sqrt(static_cast<float>(x * x + y * y));
+                if (dist > 8 || dist < 0.5f) continue;
+                const float falloff = (8 - dist) / 8;
+                velocity(cx + x, cy + y, 3 * falloff * x / dist, 3 * falloff * y / dist);
+                dye(1, cx + x, cy + y, falloff);
+            }
+        }
+    }});
+
+    // A handful of impulses of random strength and colour per step; the
+    // generator is reseeded per step so both simulations see the same ones
+    inputs.push_back({"random", [seed](int step, const auto& velocity, const auto& dye) {
+        Lcg rng{seed * 2654435761u + static_cast<std::uint32_t>(step) * 40503u};
+        for (int k = 0; k < 6; k++) {
+            const int cx = 4 + rng.next(120);
+            const int cy = 4 + rng.next(88);
+            const float u = rng.uniform(-2, 2);
+            const float v = rng.uniform(-2, 2);
+            const int channel = rng.next(3);
+            const float amount = rng.uniform(0, 1);
+            for (int y = cy - 2; y <= cy + 2; y++) {
+                for (int x = cx - 2; x <= cx + 2; x++) {
+                    velocity(x, y, u, v);
+                    dye(channel, x, y, amount);
+                }
+            }
+        }
+    }});
+    return inputs;
+}
+
+// The repo builds with -ffast-math, under which std::isfinite folds to
+// true and comparisons with NaN may go either way, so blow-ups are caught
+// by their exponent bits instead
+bool isFinite(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x7f800000u) != 0x7f800000u;
+}
+
+bool isFinite(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x7ff0000000000000ull) != 0x7ff0000000000000ull;
+}
+
+// RMS of the divergence project() removes, over the interior
+double divergence(const float* u, const float* v, int width, int height) {
+    double sum = 0;
+    for (int j = 1; j < height - 1; j++) {
+        for (int i = 1; i < width - 1; i++) {
+            const int idx = i + j * width;
+            const double div = -0.5 * (u[idx + 1] - u[idx - 1] + v[idx + width] - v[idx - width]) / width;
+            sum += div * div;
+        }
+    }
+    return std::sqrt(sum / (static_cast<double>(width - 2) * (height - 2)));
+}
+
+template <typename Field>
+void compare(FieldError& error, const Field& field, const float* reference, int cells) {
+    double scale = 0;
+    double worst = 0;
+    double sum = 0;
+    for (int idx = 0; idx < cells; idx++) {
+        const float value = field[idx];
+        if (!isFinite(value)) {
+            error.nonFinite++;
+            continue;
+        }
+        const double diff = std::fabs(static_cast<double>(value) - reference[idx]);
+        scale = std::max(scale, std::fabs(static_cast<double>(reference[idx])));
+        worst = std::max(worst, diff);
+        sum += diff * diff;
+    }
+    // Fields still near zero are compared in absolute terms
+    scale = std::max(scale, 1e-3);
+    error.maxError = std::max(error.maxError, worst / scale);
+    error.rmsError = std::max(error.rmsError, std::sqrt(sum / cells) / scale);
+}
+
+Result verify(const Backend& backend, const Inputs& inputs, const VerifyOptions& options) {
+    const float diffusion = 1e-4f;
+    const float viscosity = 1e-5f;
+    const float dt = 0.016f;
+    Result res;
+    res.backend = backend.name;
+    res.inputs = inputs.name;
+    const int width = backend.width > 0 ? backend.width : options.width;
+    const int height = backend.height > 0 ? backend.height : options.height;
+    res.width = width;
+    res.height = height;
+
+    FluidSimulation fluid(width, height, diffusion, viscosity, dt);
+    ReferenceSimulation reference(width, height, diffusion, viscosity, dt);
+    reference.setRelaxation(backend.relaxation);
+    if (!backend.configure(fluid)) {
+        res.skipped = true;
+        return res;
+    }
+
+    const int cells = width * height;
+    res.fields = {{"vx"}, {"vy"}};
+    for (int c = 0; c < reference.getChannelCount(); c++) res.fields.push_back({"dye" + std::to_string(c)});
+
+    auto velocity = [&](int x, int y, float u, float v) {
+        if (x < 1 || x >= width - 1 || y < 1 || y >= height - 1) return;
+        fluid.addVelocity(x, y, u, v);
+        reference.addVelocity(x, y, u, v);
+    };
+    auto dye = [&](int channel, int x, int y, float amount) {
+        if (x < 1 || x >= width - 1 || y < 1 || y >= height - 1) return;
+        fluid.addToChannel(channel, x, y, amount);
+        reference.addToChannel(channel, x, y, amount);
+    };
+    double activeSum = 0;
+    for (int step = 0; step < options.steps; step++) {
+        inputs.drive(step, velocity, dye);
+        fluid.step();
+        reference.step();
+        activeSum += fluid.getActiveFraction();
+        compare(res.fields[0], fluid.getVelocityX(), reference.getVelocityX(), cells);
+        compare(res.fields[1], fluid.getVelocityY(), reference.getVelocityY(), cells);
+        for (int c = 0; c < reference.getChannelCount(); c++) {
+            compare(res.fields[2 + c], fluid.getChannel(c), reference.getChannel(c), cells);
+        }
+    }
+
+    res.activeFraction = activeSum / options.steps;
+    res.divergence = divergence(fluid.getVelocityX(), fluid.getVelocityY(), width, height);
+    res.referenceDivergence = divergence(reference.getVelocityX(), reference.getVelocityY(), width, height);
+    const double tolerance = static_cast<double>(options.tolerance) * backend.tolerance;
+    for (const FieldError& error : res.fields) {
+        if (error.maxError > tolerance || error.nonFinite > 0) res.passed = false;
+    }
+    if (!isFinite(res.divergence) || res.divergence > res.referenceDivergence * (1 + options.divergenceSlack)) {
+        res.passed = false;
+    }
+    if (res.activeFraction > backend.maxActiveFraction) res.passed = false;
+    return res;
+}
+
+// Residuals of the mean-free system below this fraction of the initial one
+// are at float precision and may stall
+constexpr double MULTIGRID_FLOOR = 1e-5;
+constexpr double MULTIGRID_REDUCTION = 1e-3;  // required over the whole run
+constexpr int MULTIGRID_CYCLES = 10;
+
+MultigridResult verifyMultigrid(int width, int height, std::uint32_t seed) {
+    MultigridResult res{width, height};
+    ThreadPool pool(1);
+    Workspace workspace;
+    GridContext grid{width, height, &pool, &selectKernels(detectSimdLevel()), nullptr, Relaxation::RedBlack,
+                     &workspace, 1, nullptr};
+
+    std::vector<float> x(static_cast<size_t>(width) * height, 0.0f);
+    std::vector<float> rhs(x.size(), 0.0f);
+    Lcg rng{seed};
+    for (int j = 1; j < height - 1; j++) {
+        for (int i = 1; i < width - 1; i++) rhs[grid.IX(i, j)] = rng.uniform(-1, 1);
+    }
+
+    // project()'s pressure system: singular, with the mean removed by the solver
+    std::unique_ptr<LinearSolver> solver = makeSolver(SolverType::Multigrid);
+    SolverSettings settings;
+    settings.maxIterations = 0;
+    settings.measureResidual = true;
+    res.residuals.push_back(solver->solve(grid, 0, x.data(), rhs.data(), 1, 4, settings).residual);
+    settings.maxIterations = 1;
+    settings.warmStart = true;
+    for (int k = 0; k < MULTIGRID_CYCLES; k++) {
+        const float residual = solver->solve(grid, 0, x.data(), rhs.data(), 1, 4, settings).residual;
+        const double previous = res.residuals.back();
+        if (!isFinite(residual) || (residual >= previous && residual > MULTIGRID_FLOOR * res.residuals[0])) {
+            res.passed = false;
+        }
+        res.residuals.push_back(residual);
+    }
+    if (!isFinite(res.residuals[0]) || res.residuals.back() > MULTIGRID_REDUCTION * res.residuals[0]) {
+        res.passed = false;
+    }
+    return res;
+}
+
+ParticleResult verifyParticles(int steps) {
+    const int size = 64;
+    ParticleResult res;
+    FluidSimulation fluid(size, size, 1e-4f, 1e-5f, 0.016f);
+    fluid.createExplosion(size / 2, size / 2, 100.0f, 255, 255, 255);
+    ParticleSystem particles(20000);
+    particles.setThreadCount(1);
+    // Discs reaching past the walls and corners, and one collector
+    particles.addEmitter({20, 0, 6, 40});
+    particles.addEmitter({0, 0, 4, 20});
+    particles.addEmitter({size - 1.0f, size - 1.0f, 4, 20});
+    particles.addEmitter({size - 1.0f, 30, 6, 40});
+    particles.addCollector({20, 8, 4});
+
+    const float lo = 0.5f;
+    const float hi = size - 1.5f;
+    for (int step = 0; step < steps; step++) {
+        fluid.step();
+        particles.step(fluid);
+        const float* x = particles.getX();
+        const float* y = particles.getY();
+        for (int k = 0; k < particles.getCount(); k++) {
+            // Negated so NaN counts as outside
+            if (!(x[k] >= lo && x[k] <= hi && y[k] >= lo && y[k] <= hi)) res.outside++;
+        }
+    }
+    res.steps = steps;
+    res.count = particles.getCount();
+    res.emitted = particles.getEmitted();
+    res.passed = res.outside == 0 && res.emitted > 0 &&
+                 res.emitted == res.count + particles.getCollected() + particles.getExpired();
+    return res;
+}
+
+// Values of b whose bits differ from a's; NaNs compare by their bits too
+std::uint64_t mismatches(const FluidSimulation& a, const FluidSimulation& b) {
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight() ||
+        a.getChannelCount() != b.getChannelCount()) {
+        return static_cast<std::uint64_t>(b.getWidth()) * b.getHeight();
+    }
+    const int cells = a.getWidth() * a.getHeight();
+    std::uint64_t count = 0;
+    auto same = [](float x, float y) { return std::memcmp(&x, &y, sizeof(float)) == 0; };
+    for (int idx = 0; idx < cells; idx++) {
+        count += !same(a.getVelocityX()[idx], b.getVelocityX()[idx]);
+        count += !same(a.getVelocityY()[idx], b.getVelocityY()[idx]);
+    }
+    for (int c = 0; c < a.getChannelCount(); c++) {
+        const ChannelView x = a.getChannel(c);
+        const ChannelView y = b.getChannel(c);
+        for (int idx = 0; idx < cells; idx++) count += !same(x[idx], y[idx]);
+    }
+    return count;
+}
+
+// A simulation stepped through a checkpoint must end bit for bit where an
+// uninterrupted one does: one simulation runs warmup + steps steps, another
+// is loaded from a checkpoint the first saved after warmup and steps on with
+// the same inputs. Each dye format is covered, with a barrier in the flow.
+// Damaged files must be rejected without touching the loading simulation.
+std::vector<CheckpointResult> verifyCheckpoints(const VerifyOptions& options) {
+    const int warmup = 20;
+    const std::string path = (std::filesystem::temp_directory_path() / "fluid_verify.checkpoint").string();
+    const Inputs inputs = makeInputs(options.seed).front();
+    auto drive = [&](FluidSimulation& fluid, int step) {
+        auto velocity = [&](int x, int y, float u, float v) {
+            if (x >= 1 && x < options.width - 1 && y >= 1 && y < options.height - 1) fluid.addVelocity(x, y, u, v);
+        };
+        auto dye = [&](int channel, int x, int y, float amount) {
+            if (x >= 1 && x < options.width - 1 && y >= 1 && y < options.height - 1) {
+                fluid.addToChannel(channel, x, y, amount);
+            }
+        };
+        inputs.drive(step, velocity, dye);
+        fluid.step();
+    };
+
+    const std::pair<const char*, std::function<void(FluidSimulation&)>> formats[] = {
+        {"f32", [](FluidSimulation&) {}},
+        {"f16", [](FluidSimulation& fluid) { fluid.setDyeStorage(DyeStorage::Float16); }},
+        {"padded", [](FluidSimulation& fluid) { fluid.setDyeLayout(DyeLayout::InterleavedPadded); }},
+    };
+    std::vector<CheckpointResult> results;
+    for (const auto& format : formats) {
+        CheckpointResult res;
+        res.name = format.first;
+        FluidSimulation original(options.width, options.height, 1e-4f, 1e-5f, 0.016f);
+        format.second(original);
+        original.fillObstacleCircle(options.width / 2, options.height / 2, 6, true);
+        for (int step = 0; step < warmup; step++) drive(original, step);
+        // A different size and format, all of which the load replaces
+        FluidSimulation restored(64, 48, 1e-3f, 1e-3f, 0.01f);
+        if (!original.saveCheckpoint(path)) {
+            res.passed = false;
+            results.push_back(res);
+            continue;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        res.passed = restored.loadCheckpoint(path);
+        res.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (int step = warmup; step < warmup + options.steps; step++) {
+            drive(original, step);
+            if (res.passed) drive(restored, step);
+        }
+        res.mismatches = mismatches(original, restored);
+        res.passed = res.passed && res.mismatches == 0;
+        results.push_back(res);
+    }
+
+    // Damaged copies of the last checkpoint, each loaded into a simulation
+    // that has to come out unchanged and say why it refused
+    std::vector<char> bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    struct Damage {
+        const char* name;
+        const char* reason;  // expected in the rejection message
+        std::function<void(std::vector<char>&)> apply;
+    };
+    const Damage damages[] = {
+        {"truncated", "truncated", [](std::vector<char>& file) { file.resize(file.size() / 2); }},
+        {"version", "unsupported version", [](std::vector<char>& file) {
+            const std::uint32_t version = CHECKPOINT_VERSION + 1;
+            std::memcpy(file.data() + offsetof(CheckpointHeader, version), &version, sizeof(version));
+        }},
+    };
+    for (const Damage& damage : damages) {
+        CheckpointResult res;
+        res.name = damage.name;
+        std::vector<char> file = bytes;
+        damage.apply(file);
+        std::ofstream damaged(path, std::ios::binary | std::ios::trunc);
+        damaged.write(file.data(), static_cast<std::streamsize>(file.size()));
+        damaged.close();
+
+        FluidSimulation fluid(options.width, options.height, 1e-4f, 1e-5f, 0.016f);
+        FluidSimulation untouched(options.width, options.height, 1e-4f, 1e-5f, 0.016f);
+        for (int step = 0; step < 5; step++) {
+            drive(fluid, step);
+            drive(untouched, step);
+        }
+        std::ostringstream reason;
+        std::streambuf* console = std::cerr.rdbuf(reason.rdbuf());
+        const bool loaded = fluid.loadCheckpoint(path);
+        std::cerr.rdbuf(console);
+        res.mismatches = mismatches(untouched, fluid);
+        res.passed = !loaded && res.mismatches == 0 && reason.str().find(damage.reason) != std::string::npos;
+        results.push_back(res);
+    }
+    std::remove(path.c_str());
+    return results;
+}
+
+// A recording must decode to exactly the fields that were captured. Every
+// second step of a run is recorded with keyframes every fourth chunk, so
+// most chunks are deltas; the recorder's copy of the fields is kept for
+// each recorded step and compared bit for bit with what RecordingReader
+// decodes. With Drop the ring is a single slot, so frames may be skipped
+// and the deltas have to span them; the reader must then see exactly the
+// frames that were written, in order.
+std::vector<RecorderResult> verifyRecorder(const VerifyOptions& options) {
+    const std::string path = (std::filesystem::temp_directory_path() / "fluid_verify.recording").string();
+    const Inputs inputs = makeInputs(options.seed).front();
+    const size_t cells = static_cast<size_t>(options.width) * options.height;
+    std::vector<RecorderResult> results;
+    for (Backpressure backpressure : {Backpressure::Block, Backpressure::Drop}) {
+        RecorderResult res;
+        res.backpressure = backpressure == Backpressure::Block ? "block" : "drop";
+        RecorderSettings settings;
+        settings.decimation = 2;
+        settings.keyframeInterval = 4;
+        settings.capacity = backpressure == Backpressure::Block ? 2 : 1;
+        settings.backpressure = backpressure;
+
+        FluidSimulation fluid(options.width, options.height, 1e-4f, 1e-5f, 0.016f);
+        Recorder recorder;
+        if (!recorder.start(path, fluid, settings)) {
+            res.passed = false;
+            results.push_back(res);
+            continue;
+        }
+        auto velocity = [&](int x, int y, float u, float v) {
+            if (x >= 1 && x < options.width - 1 && y >= 1 && y < options.height - 1) fluid.addVelocity(x, y, u, v);
+        };
+        auto dye = [&](int channel, int x, int y, float amount) {
+            if (x >= 1 && x < options.width - 1 && y >= 1 && y < options.height - 1) {
+                fluid.addToChannel(channel, x, y, amount);
+            }
+        };
+        // Fields in RecordedField order, per recorded step
+        std::vector<std::pair<std::uint64_t, std::vector<float>>> expected;
+        for (int step = 0; step < options.steps; step++) {
+            inputs.drive(step, velocity, dye);
+            fluid.step();
+            recorder.capture(fluid, static_cast<std::uint64_t>(step));
+            if (step % settings.decimation != 0) continue;
+            std::vector<float> values(cells * static_cast<size_t>(RecordedField::Count));
+            for (int c = 0; c < 3; c++) {
+                const ChannelView channel = fluid.getChannel(c);
+                for (size_t idx = 0; idx < cells; idx++) values[c * cells + idx] = channel[static_cast<int>(idx)];
+            }
+            std::copy(fluid.getVelocityX(), fluid.getVelocityX() + cells, values.begin() + 3 * cells);
+            std::copy(fluid.getVelocityY(), fluid.getVelocityY() + cells, values.begin() + 4 * cells);
+            expected.emplace_back(step, std::move(values));
+        }
+        recorder.stop();
+        res.captured = recorder.getFramesCaptured();
+        res.dropped = recorder.getFramesDropped();
+
+        RecordingReader reader;
+        if (!reader.open(path)) {
+            res.passed = false;
+            results.push_back(res);
+            continue;
+        }
+        std::uint64_t step;
+        std::vector<float> values;
+        size_t at = 0;
+        while (reader.next(step, values)) {
+            res.decoded++;
+            // Dropped frames are skipped over; anything else is out of order
+            while (at < expected.size() && expected[at].first < step) at++;
+            if (at == expected.size() || expected[at].first != step || values.size() != expected[at].second.size()) {
+                res.mismatches++;
+                continue;
+            }
+            const std::vector<float>& captured = expected[at++].second;
+            for (size_t k = 0; k < values.size(); k++) {
+                res.mismatches += std::memcmp(&values[k], &captured[k], sizeof(float)) != 0;
+            }
+        }
+        res.passed = res.mismatches == 0 && res.decoded == recorder.getFramesWritten() &&
+                     res.decoded == res.captured && res.captured + res.dropped == expected.size() &&
+                     (backpressure == Backpressure::Drop || res.dropped == 0);
+        results.push_back(res);
+    }
+    std::remove(path.c_str());
+    return results;
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results, const std::vector<MultigridResult>& multigrid,
+               const ParticleResult* particles, const std::vector<CheckpointResult>& checkpoints,
+               const std::vector<RecorderResult>& recordings, const VerifyOptions& options) {
+    out << "{\n  \"benchmark\": \"fluid_verify\",\n  \"width\": " << options.width
+        << ", \"height\": " << options.height << ", \"steps\": " << options.steps
+        << ", \"seed\": " << options.seed << ", \"tolerance\": " << options.tolerance
+        << ",\n  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result& res = results[r];
+        out << "    {\"backend\": \"" << res.backend << "\", \"inputs\": \"" << res.inputs << "\"";
+        if (res.skipped) {
+            out << ", \"skipped\": true";
+        } else {
+            if (res.width != options.width || res.height != options.height) {
+                out << ", \"width\": " << res.width << ", \"height\": " << res.height;
+            }
+            out << ", \"passed\": " << (res.passed ? "true" : "false")
+                << ", \"activeFraction\": " << res.activeFraction
+                << ", \"divergence\": " << res.divergence
+                << ", \"referenceDivergence\": " << res.referenceDivergence << ", \"fields\": {";
+            for (size_t f = 0; f < res.fields.size(); f++) {
+                out << (f ? ", " : "") << "\"" << res.fields[f].field << "\": {\"max\": " << res.fields[f].maxError
+                    << ", \"rms\": " << res.fields[f].rmsError << ", \"nonFinite\": " << res.fields[f].nonFinite
+                    << "}";
+            }
+            out << "}";
+        }
+        out << "}" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n  \"multigrid\": [\n";
+    for (size_t m = 0; m < multigrid.size(); m++) {
+        const MultigridResult& res = multigrid[m];
+        out << "    {\"width\": " << res.width << ", \"height\": " << res.height
+            << ", \"passed\": " << (res.passed ? "true" : "false") << ", \"residuals\": [";
+        for (size_t k = 0; k < res.residuals.size(); k++) out << (k ? ", " : "") << res.residuals[k];
+        out << "]}" << (m + 1 < multigrid.size() ? "," : "") << "\n";
+    }
+    out << "  ]";
+    if (particles) {
+        out << ",\n  \"particles\": {\"passed\": " << (particles->passed ? "true" : "false")
+            << ", \"steps\": " << particles->steps << ", \"count\": " << particles->count
+            << ", \"emitted\": " << particles->emitted << ", \"outside\": " << particles->outside << "}";
+    }
+    if (!checkpoints.empty()) {
+        out << ",\n  \"checkpoint\": [\n";
+        for (size_t k = 0; k < checkpoints.size(); k++) {
+            const CheckpointResult& res = checkpoints[k];
+            out << "    {\"case\": \"" << res.name << "\", \"passed\": " << (res.passed ? "true" : "false")
+                << ", \"mismatches\": " << res.mismatches << ", \"loadMs\": " << res.loadMs << "}"
+                << (k + 1 < checkpoints.size() ? "," : "") << "\n";
+        }
+        out << "  ]";
+    }
+    if (!recordings.empty()) {
+        out << ",\n  \"recorder\": [\n";
+        for (size_t k = 0; k < recordings.size(); k++) {
+            const RecorderResult& res = recordings[k];
+            out << "    {\"backpressure\": \"" << res.backpressure << "\", \"passed\": "
+                << (res.passed ? "true" : "false") << ", \"captured\": " << res.captured
+                << ", \"dropped\": " << res.dropped << ", \"decoded\": " << res.decoded
+                << ", \"mismatches\": " << res.mismatches << "}" << (k + 1 < recordings.size() ? "," : "") << "\n";
+        }
+        out << "  ]";
+    }
+    out << "\n}\n";
+}
+
+std::vector<std::string> splitList(const std::string& arg) {
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) items.push_back(item);
+    return items;
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --size WxH          grid size (default 130x98, at least 128x96)\n"
+              << "  --steps N           steps per run (default 60)\n"
+              << "  --seed N            seed of the randomized inputs (default 1)\n"
+              << "  --tolerance T       largest max error relative to the field's scale (default 1e-3)\n"
+              << "  --divergence-slack S  allowed relative excess over the reference divergence (default 0.05)\n"
+              << "  --backends a,b      backends to check, multigrid, particles, checkpoint and recorder included (default all)\n"
+              << "  --json PATH         write results to PATH instead of stdout\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    VerifyOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            // The scripted and random inputs are placed for at least 128x96
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 ||
+                options.width < 128 || options.height < 96) {
+                std::cerr << "Invalid --size " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--steps" && hasValue) {
+            options.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--divergence-slack" && hasValue) {
+            options.divergenceSlack = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--backends" && hasValue) {
+            options.backendFilter = splitList(argv[++i]);
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::vector<Backend> backends = makeBackends();
+    for (const std::string& name : options.backendFilter) {
+        bool known = name == "multigrid" || name == "particles" || name == "checkpoint" ||
+                     name == "recorder" ||
+                     std::any_of(backends.begin(), backends.end(),
+                                 [&](const Backend& backend) { return backend.name == name; });
+        if (!known) {
+            std::cerr << "Unknown backend " << name << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+    for (const Backend& backend : backends) {
+        if (!options.backendFilter.empty() &&
+            std::find(options.backendFilter.begin(), options.backendFilter.end(), backend.name) ==
+                options.backendFilter.end()) {
+            continue;
+        }
+        for (const Inputs& inputs : backend.inputs.empty() ? makeInputs(options.seed) : backend.inputs) {
+            Result res = verify(backend, inputs, options);
+            if (res.skipped) {
+                std::fprintf(stderr, "%-14s %-9s skipped (not supported here)\n", res.backend.c_str(), res.inputs.c_str());
+            } else {
+                double worst = 0;
+                const char* field = "";
+                std::uint64_t nonFinite = 0;
+                for (const FieldError& error : res.fields) {
+                    if (error.maxError >= worst) {
+                        worst = error.maxError;
+                        field = error.field.c_str();
+                    }
+                    nonFinite += error.nonFinite;
+                }
+                std::fprintf(stderr, "%-14s %-9s %s  worst max error %.2e (%s)  divergence %.3e vs %.3e",
+                             res.backend.c_str(), res.inputs.c_str(), res.passed ? "ok  " : "FAIL", worst, field,
+                             res.divergence, res.referenceDivergence);
+                if (res.activeFraction < 1) std::fprintf(stderr, "  %.0f%% of tiles active", 100 * res.activeFraction);
+                if (nonFinite > 0) {
+                    std::fprintf(stderr, "  %llu NaN or infinite values", static_cast<unsigned long long>(nonFinite));
+                }
+                std::fprintf(stderr, "\n");
+                failed = failed || !res.passed;
+            }
+            results.push_back(res);
+        }
+    }
+
+    // The app's grid, odd interior sizes and an odd size halfway down the chain
+    std::vector<MultigridResult> multigrid;
+    if (options.backendFilter.empty() ||
+        std::find(options.backendFilter.begin(), options.backendFilter.end(), "multigrid") != options.backendFilter.end()) {
+        for (const auto& size : {std::make_pair(300, 200), std::make_pair(67, 67), std::make_pair(100, 60)}) {
+            MultigridResult res = verifyMultigrid(size.first, size.second, options.seed);
+            std::fprintf(stderr, "%-14s %4dx%-4d %s  residual %.3e -> %.3e after %d V-cycles\n", "multigrid",
+                         res.width, res.height, res.passed ? "ok  " : "FAIL", res.residuals.front(),
+                         res.residuals.back(), MULTIGRID_CYCLES);
+            failed = failed || !res.passed;
+            multigrid.push_back(res);
+        }
+    }
+
+    ParticleResult particles;
+    const bool checkParticles = options.backendFilter.empty() ||
+        std::find(options.backendFilter.begin(), options.backendFilter.end(), "particles") != options.backendFilter.end();
+    if (checkParticles) {
+        particles = verifyParticles(options.steps);
+        std::fprintf(stderr, "%-14s %-9s %s  %d alive of %llu emitted, %d positions outside the interior\n",
+                     "particles", "border", particles.passed ? "ok  " : "FAIL", particles.count,
+                     static_cast<unsigned long long>(particles.emitted), particles.outside);
+        failed = failed || !particles.passed;
+    }
+
+    std::vector<CheckpointResult> checkpoints;
+    if (options.backendFilter.empty() ||
+        std::find(options.backendFilter.begin(), options.backendFilter.end(), "checkpoint") != options.backendFilter.end()) {
+        checkpoints = verifyCheckpoints(options);
+        for (const CheckpointResult& res : checkpoints) {
+            std::fprintf(stderr, "%-14s %-9s %s  %llu values differ", "checkpoint", res.name.c_str(),
+                         res.passed ? "ok  " : "FAIL", static_cast<unsigned long long>(res.mismatches));
+            if (res.loadMs > 0) std::fprintf(stderr, "  loaded in %.3f ms", res.loadMs);
+            std::fprintf(stderr, "\n");
+            failed = failed || !res.passed;
+        }
+    }
+
+    std::vector<RecorderResult> recordings;
+    if (options.backendFilter.empty() ||
+        std::find(options.backendFilter.begin(), options.backendFilter.end(), "recorder") != options.backendFilter.end()) {
+        recordings = verifyRecorder(options);
+        for (const RecorderResult& res : recordings) {
+            std::fprintf(stderr, "%-14s %-9s %s  %llu of %llu frames decoded (%llu dropped), %llu values differ\n",
+                         "recorder", res.backpressure.c_str(), res.passed ? "ok  " : "FAIL",
+                         static_cast<unsigned long long>(res.decoded),
+                         static_cast<unsigned long long>(res.captured + res.dropped),
+                         static_cast<unsigned long long>(res.dropped), static_cast<unsigned long long>(res.mismatches));
+            failed = failed || !res.passed;
+        }
+    }
+
+    if (options.jsonPath.empty()) {
+        writeJson(std::cout, results, multigrid, checkParticles ? &particles : nullptr, checkpoints, recordings,
+                  options);
+    } else {
+        std::ofstream file(options.jsonPath);
+        if (!file) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+        writeJson(file, results, multigrid, checkParticles ? &particles : nullptr, checkpoints, recordings, options);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+// Scaling benchmark for the domain-decomposed solver.
+//
+// Runs one grid split into horizontal slabs across 1 to N local processes
+// that exchange ghost rows through a ShmTransport, reports the time per
+// step and the speedup over one process, and checks every decomposed run
+// against an undecomposed FluidSimulation. Results are written as JSON.
+#include "fluid.hpp"
+#include "halo.hpp"
+#include "shm_transport.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#define FLUID_HAVE_FORK 1
+#endif
+
+namespace {
+
+struct BenchOptions {
+    int width = 512;
+    int height = 512;
+    std::vector<int> rankCounts = {1, 2, 4, 8};
+    int steps = 50;
+    int threads = 1;  // solver threads per process
+    bool verify = true;
+    std::string jsonPath;
+};
+
+// Sent by rank 0 to the parent through a pipe
+struct RankReport {
+    double stepSeconds;   // slowest rank, per step
+    double haloSeconds;   // slowest rank, per step
+    double maxDifference;  // largest |decomposed - reference| over every field, -1 if not verified
+};
+
+struct Result {
+    int ranks;
+    RankReport report;
+};
+
+// Relative to the first (usually one-process) run
+double speedup(const std::vector<Result>& results, const Result& res) {
+    return results.front().report.stepSeconds / res.report.stepSeconds;
+}
+
+// Same input for every decomposition, in global coordinates: a jet pushing
+// right and one pushing up, so flow crosses the slab boundaries
+void drive(FluidSimulation& fluid, int width, int height) {
+    int radius = std::max(2, height / 50);
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            fluid.addDensity(width / 8 + x, height / 2 + y, 100, 0, 128, 255);
+            fluid.addVelocity(width / 8 + x, height / 2 + y, 200.0f, 0.0f);
+            fluid.addDensity(width / 2 + x, 3 * height / 4 + y, 100, 255, 64, 0);
+            fluid.addVelocity(width / 2 + x, 3 * height / 4 + y, 0.0f, -200.0f);
+        }
+    }
+}
+
+// Velocity and the three dye channels, one after the other
+const int FIELD_COUNT = 5;
+
+const float* field(const FluidSimulation& fluid, int f) {
+    if (f == 0) return fluid.getVelocityX();
+    if (f == 1) return fluid.getVelocityY();
+    return fluid.getChannel(f - 2).data;
+}
+
+#ifdef FLUID_HAVE_FORK
+
+// Body of one rank process; returns its exit status
+int runRank(const std::string& name, int rank, const BenchOptions& options,
+            const FluidSimulation* reference, int reportFd) {
+    std::unique_ptr<ShmTransport> transport = ShmTransport::attach(name, rank);
+    if (!transport) return 1;
+    auto halo = std::make_shared<Halo>(options.width, options.height, *transport);
+    FluidSimulation fluid(options.width, halo->slab().localHeight(), 0.0000001f, 0.0000001f, 0.016f);
+    fluid.setThreadCount(options.threads);
+    if (!fluid.setHalo(halo)) return 1;
+
+    // One untimed step warms the workspace and the pool
+    drive(fluid, options.width, options.height);
+    fluid.step();
+    Profiler& profiler = fluid.getProfiler();
+    profiler.setEnabled(true);
+    transport->sum(0);  // start together
+
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 1; k < options.steps; k++) {
+        drive(fluid, options.width, options.height);
+        fluid.step();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    profiler.setEnabled(false);
+    const int timedSteps = std::max(1, options.steps - 1);
+
+    RankReport report;
+    report.stepSeconds = transport->max(seconds) / timedSteps;
+    report.haloSeconds = transport->max(profiler.totalNanos(Phase::Halo) * 1e-9) / timedSteps;
+    report.maxDifference = -1;
+
+    if (reference) {
+        // Rank 0 collects each whole field; the others only publish theirs
+        const int width = options.width;
+        std::vector<float> global(rank == 0 ? static_cast<size_t>(width) * options.height : 0);
+        double difference = 0;
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            if (rank == 0) {
+                halo->gatherRows(field(fluid, f), 0, options.height - 1, global.data());
+                const float* expected = field(*reference, f);
+                for (size_t idx = 0; idx < global.size(); idx++) {
+                    difference = std::max(difference, static_cast<double>(std::fabs(global[idx] - expected[idx])));
+                }
+            } else {
+                halo->gatherRows(field(fluid, f), 1, 0, nullptr);
+            }
+        }
+        report.maxDifference = difference;
+    }
+
+    if (rank == 0 && write(reportFd, &report, sizeof(report)) != sizeof(report)) return 1;
+    return 0;
+}
+
+// Forks one process per rank and returns rank 0's report
+bool runDecomposed(int ranks, const BenchOptions& options, const FluidSimulation* reference, RankReport& report) {
+    const std::string name = "/fluid_halo_bench_" + std::to_string(getpid()) + "_" + std::to_string(ranks);
+    ShmTransport::unlink(name);
+    if (!ShmTransport::create(name, ranks, Halo::windowFloats(options.width, options.height, ranks))) return false;
+
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        ShmTransport::unlink(name);
+        return false;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> children;
+    for (int rank = 0; rank < ranks; rank++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(pipeFds[0]);
+            _exit(runRank(name, rank, options, reference, pipeFds[1]));
+        }
+        if (pid > 0) children.push_back(pid);
+    }
+    close(pipeFds[1]);
+
+    bool ok = static_cast<int>(children.size()) == ranks;
+    ok = read(pipeFds[0], &report, sizeof(report)) == sizeof(report) && ok;
+    close(pipeFds[0]);
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    ShmTransport::unlink(name);
+    return ok;
+}
+
+#else
+
+bool runDecomposed(int, const BenchOptions&, const FluidSimulation*, RankReport&) {
+    std::cerr << "halo_bench needs fork() and POSIX shared memory" << std::endl;
+    return false;
+}
+
+#endif
+
+std::vector<std::string> splitList(const std::string& arg) {
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) items.push_back(item);
+    return items;
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --size WxH        grid size (default 512x512)\n"
+              << "  --ranks N,...     process counts to run (default 1,2,4,8)\n"
+              << "  --steps N         steps per run, the first one untimed (default 50)\n"
+              << "  --threads N       solver threads per process (default 1)\n"
+              << "  --no-verify       skip the comparison with the undecomposed solver\n"
+              << "  --json PATH       write results to PATH instead of stdout\n";
+}
+
+void writeJson(std::ostream& out, const BenchOptions& options, const std::vector<Result>& results) {
+    out << "{\n  \"benchmark\": \"halo_bench\",\n  \"unit\": \"ms/step\",\n"
+        << "  \"width\": " << options.width << ", \"height\": " << options.height
+        << ", \"steps\": " << options.steps << ", \"threadsPerRank\": " << options.threads << ",\n  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result& res = results[r];
+        out << "    {\"ranks\": " << res.ranks
+            << ", \"step\": " << res.report.stepSeconds * 1e3
+            << ", \"halo\": " << res.report.haloSeconds * 1e3
+            << ", \"speedup\": " << speedup(results, res)
+            << ", \"maxDifference\": " << res.report.maxDifference << "}"
+            << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 ||
+                options.width < 3 || options.height < 3) {
+                std::cerr << "Invalid --size value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--ranks" && hasValue) {
+            options.rankCounts.clear();
+            for (const std::string& count : splitList(argv[++i])) {
+                options.rankCounts.push_back(std::max(1, std::atoi(count.c_str())));
+            }
+        } else if (arg == "--steps" && hasValue) {
+            options.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--no-verify") {
+            options.verify = false;
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // Computed before forking, so every rank process inherits it
+    std::unique_ptr<FluidSimulation> reference;
+    if (options.verify) {
+        reference = std::make_unique<FluidSimulation>(options.width, options.height, 0.0000001f, 0.0000001f, 0.016f);
+        reference->setThreadCount(options.threads);
+        for (int k = 0; k < options.steps; k++) {
+            drive(*reference, options.width, options.height);
+            reference->step();
+        }
+    }
+
+    std::vector<Result> results;
+    bool mismatch = false;
+    for (int ranks : options.rankCounts) {
+        if (ranks > options.height - 2 || ranks > ShmTransport::MAX_RANKS) {
+            std::cerr << "Skipping " << ranks << " ranks: too many for the grid" << std::endl;
+            continue;
+        }
+        Result res;
+        res.ranks = ranks;
+        if (!runDecomposed(ranks, options, reference.get(), res.report)) {
+            std::cerr << "Run with " << ranks << " ranks failed" << std::endl;
+            return 1;
+        }
+        results.push_back(res);
+        mismatch = mismatch || res.report.maxDifference > 0;
+        std::fprintf(stderr, "%2d ranks  %9.3f ms/step  halo %8.3f ms/step  speedup %5.2f  max difference %g\n",
+                     ranks, res.report.stepSeconds * 1e3, res.report.haloSeconds * 1e3,
+                     speedup(results, res),
+                     res.report.maxDifference);
+    }
+
+    if (options.jsonPath.empty()) {
+        writeJson(std::cout, options, results);
+    } else {
+        std::ofstream out(options.jsonPath);
+        if (!out) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+        writeJson(out, options, results);
+    }
+    if (mismatch) {
+        std::cerr << "Decomposed results differ from the undecomposed solver" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Throughput benchmark for the tracer particles.
+//
+// Stirs a grid with a few explosions, then, for each particle count, seeds
+// that many particles uniformly over it (with an emitter and a collector so
+// compaction has work to do) and times ParticleSystem::step() and
+// rasterize() into a full-HD image against the fixed velocity field. A
+// count fits a frame when both together stay within the frame budget.
+// Results are written as JSON.
+#include "particles.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    int width = 512;
+    int height = 512;
+    std::vector<int> counts = {250000, 1000000, 4000000};
+    int steps = 60;
+    int threads = 0;  // 0 uses the hardware thread count
+    SimdLevel simd = detectSimdLevel();
+    int imageWidth = 1920;
+    int imageHeight = 1080;
+    double frameMs = 1000.0 / 60;
+    std::string jsonPath;
+};
+
+struct BenchResult {
+    int count;
+    int remaining;  // particles alive after the run
+    std::uint64_t collected;
+    double stepMs;
+    double rasterMs;
+    double nsPerParticle;  // step and rasterization together
+    bool fitsFrame;
+};
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+BenchResult run(const FluidSimulation& fluid, int count, const BenchOptions& options,
+                std::vector<std::uint16_t>& image) {
+    const int w = fluid.getWidth();
+    const int h = fluid.getHeight();
+    ParticleSystem particles(count);
+    if (options.threads > 0) particles.setThreadCount(options.threads);
+    particles.setSimdLevel(options.simd);
+    particles.seed(1, 1, w - 2, h - 2, count);
+    particles.addEmitter({w * 0.25f, h * 0.5f, 6.0f, count / 1000.0f});
+    particles.addCollector({w * 0.75f, h * 0.5f, 8.0f});
+
+    using Clock = std::chrono::steady_clock;
+    double stepSeconds = 0;
+    double rasterSeconds = 0;
+    for (int k = 0; k < options.steps; k++) {
+        auto start = Clock::now();
+        particles.step(fluid);
+        auto stepped = Clock::now();
+        std::fill(image.begin(), image.end(), 0);
+        particles.rasterize(image.data(), options.imageWidth, options.imageHeight);
+        auto drawn = Clock::now();
+        stepSeconds += std::chrono::duration<double>(stepped - start).count();
+        rasterSeconds += std::chrono::duration<double>(drawn - stepped).count();
+    }
+
+    BenchResult result;
+    result.count = count;
+    result.remaining = particles.getCount();
+    result.collected = particles.getCollected();
+    result.stepMs = stepSeconds * 1e3 / options.steps;
+    result.rasterMs = rasterSeconds * 1e3 / options.steps;
+    result.nsPerParticle = (result.stepMs + result.rasterMs) * 1e6 / count;
+    result.fitsFrame = result.stepMs + result.rasterMs <= options.frameMs;
+    return result;
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --size WxH        grid size (default 512x512)\n"
+              << "  --particles LIST  comma-separated particle counts (default 250000,1000000,4000000)\n"
+              << "  --steps N         timed steps per count (default 60)\n"
+              << "  --threads N       particle threads (default: hardware threads)\n"
+              << "  --simd LEVEL      cap the kernels at scalar, sse4.1, avx2 or avx512\n"
+              << "  --image WxH       rasterized image size (default 1920x1080)\n"
+              << "  --frame-ms MS     frame budget (default 16.7)\n"
+              << "  --json PATH       write results to PATH instead of stdout\n";
+}
+
+bool parseSize(const std::string& text, int& width, int& height) {
+    return std::sscanf(text.c_str(), "%dx%d", &width, &height) == 2 && width >= 8 && height >= 8;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            if (!parseSize(argv[++i], options.width, options.height)) {
+                std::cerr << "Bad --size " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--particles" && hasValue) {
+            options.counts.clear();
+            for (const std::string& count : splitList(argv[++i])) {
+                options.counts.push_back(std::max(1, std::atoi(count.c_str())));
+            }
+        } else if (arg == "--steps" && hasValue) {
+            options.steps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--simd" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}) {
+                if (name == simdLevelName(level)) {
+                    options.simd = level;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --simd level " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--image" && hasValue) {
+            if (!parseSize(argv[++i], options.imageWidth, options.imageHeight)) {
+                std::cerr << "Bad --image " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--frame-ms" && hasValue) {
+            options.frameMs = std::atof(argv[++i]);
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // A developed flow, frozen so every count sees the same velocities
+    FluidSimulation fluid(options.width, options.height, 0.0000001f, 0.0000001f, 0.016f);
+    const int w = options.width;
+    const int h = options.height;
+    fluid.createExplosion(w / 3, h / 3, 100.0f, 255, 255, 255);
+    fluid.createExplosion(2 * w / 3, h / 2, 100.0f, 255, 255, 255);
+    fluid.createExplosion(w / 2, 3 * h / 4, 100.0f, 255, 255, 255);
+    for (int k = 0; k < 20; k++) fluid.step();
+
+    std::vector<std::uint16_t> image(static_cast<size_t>(options.imageWidth) * options.imageHeight);
+    std::vector<BenchResult> results;
+    for (int count : options.counts) {
+        BenchResult result = run(fluid, count, options, image);
+        std::fprintf(stderr, "%9d particles  step %8.3f ms  rasterize %8.3f ms  %6.2f ns/particle  %s\n",
+                     result.count, result.stepMs, result.rasterMs, result.nsPerParticle,
+                     result.fitsFrame ? "fits frame" : "over budget");
+        results.push_back(result);
+    }
+
+    std::ofstream file;
+    if (!options.jsonPath.empty()) {
+        file.open(options.jsonPath);
+        if (!file) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.jsonPath.empty() ? std::cout : file;
+    ParticleSystem probe(1);
+    if (options.threads > 0) probe.setThreadCount(options.threads);
+    probe.setSimdLevel(options.simd);
+    out << "{\n  \"benchmark\": \"particle_bench\",\n  \"unit\": \"ms/frame\",\n"
+        << "  \"width\": " << w << ", \"height\": " << h << ", \"steps\": " << options.steps
+        << ", \"threads\": " << probe.getThreadCount() << ", \"simd\": \"" << simdLevelName(probe.getSimdLevel())
+        << "\",\n  \"image\": [" << options.imageWidth << ", " << options.imageHeight
+        << "], \"frameMs\": " << options.frameMs << ",\n  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const BenchResult& result = results[r];
+        out << "    {\"particles\": " << result.count << ", \"remaining\": " << result.remaining
+            << ", \"collected\": " << result.collected << ", \"step\": " << result.stepMs
+            << ", \"rasterize\": " << result.rasterMs << ", \"nsPerParticle\": " << result.nsPerParticle
+            << ", \"fitsFrame\": " << (result.fitsFrame ? "true" : "false") << "}"
+            << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Headless benchmark for temporally tiled relaxation.
+//
+// Runs the pressure system's red-black sweeps at several temporal depths and
+// reports the time per cell per sweep next to the memory traffic each depth
+// implies. A pass over the grid reads x and rhs and writes x back, so a depth
+// of D moves those three fields once per D sweeps instead of once per sweep.
+// That model holds once the rows a pass keeps in flight fit in cache, which
+// the measured times show.
+#include "grid.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct GridSize {
+    int width;
+    int height;
+};
+
+struct BenchOptions {
+    std::vector<GridSize> sizes = {{2048, 2048}, {4096, 4096}};
+    std::vector<int> depths = {1, 2, 4, 5, 10, 20, 0};  // 0 = autotuned
+    int threads = ThreadPool::defaultThreadCount();
+    SimdLevel simd = detectSimdLevel();
+    int sweeps = 20;
+    int repeats = 3;
+    std::string jsonPath;
+};
+
+struct Result {
+    GridSize size;
+    int depth;
+    bool autotuned;
+    int threads;
+    int sweeps;
+    double sweepNsPerCell;    // best of the repeats
+    double modeledBytes;      // grid traffic of one solve
+    double bytesPerSweep;     // modeledBytes / sweeps
+    double traffic;           // modeledBytes relative to depth 1
+};
+
+std::vector<std::string> splitList(const std::string& arg) {
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) items.push_back(item);
+    return items;
+}
+
+bool parseSizes(const std::string& arg, std::vector<GridSize>& sizes) {
+    sizes.clear();
+    for (const std::string& item : splitList(arg)) {
+        GridSize size;
+        if (std::sscanf(item.c_str(), "%dx%d", &size.width, &size.height) != 2 ||
+            size.width < 3 || size.height < 3) {
+            return false;
+        }
+        sizes.push_back(size);
+    }
+    return !sizes.empty();
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --sizes WxH,...     grid sizes (default 2048x2048,4096x4096)\n"
+              << "  --depths D,...      temporal depths, auto for the autotuned one (default 1,2,4,5,10,20,auto)\n"
+              << "  --sweeps N          red-black sweeps per solve (default 20)\n"
+              << "  --repeats N         timed solves per depth, best is kept (default 3)\n"
+              << "  --threads N         solver threads (default: hardware thread count)\n"
+              << "  --simd LEVEL        cap row kernels at scalar, sse4.1, avx2 or avx512\n"
+              << "  --json PATH         write results to PATH instead of stdout\n";
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"benchmark\": \"relax_bench\",\n  \"unit\": \"ns/cell/sweep\",\n  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result& res = results[r];
+        out << "    {\"width\": " << res.size.width
+            << ", \"height\": " << res.size.height
+            << ", \"depth\": " << res.depth
+            << ", \"autotuned\": " << (res.autotuned ? "true" : "false")
+            << ", \"threads\": " << res.threads
+            << ", \"sweeps\": " << res.sweeps
+            << ", \"sweep\": " << res.sweepNsPerCell
+            << ", \"modeledBytes\": " << res.modeledBytes
+            << ", \"bytesPerSweep\": " << res.bytesPerSweep
+            << ", \"traffic\": " << res.traffic
+            << "}" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+Result runDepth(const GridContext& grid, float* x, const float* rhs, int depth, bool autotuned,
+                const BenchOptions& options) {
+    const size_t cells = static_cast<size_t>(grid.width) * grid.height;
+    GridContext g = grid;
+    g.temporalDepth = depth;
+
+    double best = 0;
+    for (int run = 0; run <= options.repeats; run++) {
+        std::fill(x, x + cells, 0.0f);
+        auto start = std::chrono::steady_clock::now();
+        g.relaxSweeps(0, x, rhs, 1.0f, 4.0f, options.sweeps);
+        double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        // Run 0 warms up
+        if (run == 1 || (run > 1 && nanos < best)) best = nanos;
+    }
+
+    int passes = (options.sweeps + depth - 1) / depth;
+    Result res;
+    res.size = {grid.width, grid.height};
+    res.depth = depth;
+    res.autotuned = autotuned;
+    res.threads = grid.pool->getThreadCount();
+    res.sweeps = options.sweeps;
+    res.sweepNsPerCell = best / (static_cast<double>(grid.interiorCells()) * options.sweeps);
+    res.modeledBytes = 3.0 * sizeof(float) * cells * passes;
+    res.bytesPerSweep = res.modeledBytes / options.sweeps;
+    res.traffic = static_cast<double>(passes) / options.sweeps;
+    return res;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            if (!parseSizes(argv[++i], options.sizes)) {
+                std::cerr << "Invalid --sizes value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--depths" && hasValue) {
+            options.depths.clear();
+            for (const std::string& depth : splitList(argv[++i])) {
+                options.depths.push_back(depth == "auto" ? 0 : std::max(1, std::atoi(depth.c_str())));
+            }
+        } else if (arg == "--sweeps" && hasValue) {
+            options.sweeps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--repeats" && hasValue) {
+            options.repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--simd" && hasValue) {
+            std::string name = argv[++i];
+            bool known = false;
+            for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}) {
+                if (name == simdLevelName(level)) {
+                    options.simd = level;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown --simd level " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    Profiler profiler;
+    Workspace workspace;
+    std::vector<Result> results;
+    for (const GridSize& size : options.sizes) {
+        const size_t cells = static_cast<size_t>(size.width) * size.height;
+        GridContext grid{size.width, size.height, &pool, &selectKernels(options.simd),
+                         &profiler, Relaxation::RedBlack, &workspace, 1, nullptr};
+        Workspace::Scope scratch(workspace);
+        float* x = workspace.allocateFloats(cells);
+        float* rhs = workspace.allocateFloats(cells);
+        for (size_t k = 0; k < cells; k++) rhs[k] = static_cast<float>(k * 7919 % 1024) / 1024.0f - 0.5f;
+
+        double baseline = 0;
+        for (int depth : options.depths) {
+            bool autotuned = depth == 0;
+            if (autotuned) depth = autotuneTemporalDepth(grid, options.sweeps);
+            Result res = runDepth(grid, x, rhs, depth, autotuned, options);
+            if (baseline == 0) baseline = res.sweepNsPerCell;
+            results.push_back(res);
+            std::fprintf(stderr, "%5dx%-5d depth %2d%s  %7.3f ns/cell/sweep  %6.2fx  traffic %6.1f MB/sweep (%.2f)\n",
+                         size.width, size.height, res.depth, autotuned ? " (auto)" : "       ",
+                         res.sweepNsPerCell, baseline / res.sweepNsPerCell, res.bytesPerSweep / 1e6, res.traffic);
+        }
+    }
+
+    if (options.jsonPath.empty()) {
+        writeJson(std::cout, results);
+    } else {
+        std::ofstream out(options.jsonPath);
+        if (!out) {
+            std::cerr << "Failed to open " << options.jsonPath << std::endl;
+            return 1;
+        }
+        writeJson(out, results);
+    }
+    return 0;
+}
@@ -1,9 +1,13 @@
 #include "UI.hpp"
+#include <functional>
 #include <iostream>
 
 UI::UI(SDL_Renderer* renderer) : renderer(renderer), font(nullptr) {}
 
 UI::~UI() {
+    for (CachedText& entry : textCache) {
+        SDL_DestroyTexture(entry.texture);
+    }
     if (font) {
         TTF_CloseFont(font);
     }
@@ -26,60 +30,104 @@ bool UI::init() {
     return true;
 }
 
-void UI::drawText(const std::string& text, int x, int y, SDL_Color color, bool outline) {
+std::size_t UI::cacheKey(std::string_view text, SDL_Color color, bool outline) {
+    std::size_t packed = (static_cast<std::size_t>(color.r) << 24 | color.g << 16 | color.b << 8 | color.a) << 1 | outline;
+    return std::hash<std::string_view>{}(text) ^ (packed * 0x9E3779B97F4A7C15ull);
+}
+
+void UI::drawText(std::string_view text, int x, int y, SDL_Color color, bool outline) {
+    Profiler::Scope scope(profiler, Phase::DrawText);
     if (!font) {
         std::cerr << "Font not initialized" << std::endl;
         return;
     }
 
+    const std::size_t key = cacheKey(text, color, outline);
+    auto found = textIndex.find(key);
+    if (found != textIndex.end()) {
+        CachedText& entry = *found->second;
+        bool same = entry.text == text && entry.outline == outline &&
+                    entry.color.r == color.r && entry.color.g == color.g &&
+                    entry.color.b == color.b && entry.color.a == color.a;
+        if (!same) {
+            SDL_DestroyTexture(entry.texture);
+            textCache.erase(found->second);
+            textIndex.erase(found);
+            found = textIndex.end();
+        }
+    }
+
+    if (found == textIndex.end()) {
+        std::string owned(text);
+        SDL_Texture* texture = renderText(owned, color, outline);
+        if (!texture) return;
+
+        if (textCache.size() >= MAX_CACHED_TEXTS) {
+            CachedText& oldest = textCache.back();
+            SDL_DestroyTexture(oldest.texture);
+            textIndex.erase(oldest.key);
+            textCache.pop_back();
+        }
+        CachedText entry{key, std::move(owned), color, outline, texture, 0, 0};
+        SDL_QueryTexture(texture, nullptr, nullptr, &entry.width, &entry.height);
+        textCache.push_front(std::move(entry));
+        found = textIndex.emplace(key, textCache.begin()).first;
+    } else if (found->second != textCache.begin()) {
+        textCache.splice(textCache.begin(), textCache, found->second);
+    }
+
+    const CachedText& entry = textCache.front();
+    // The outline extends one pixel past the text on every side
+    const int offset = entry.outline ? 1 : 0;
+    SDL_Rect destRect = {x - offset, y - offset, entry.width, entry.height};
+    SDL_RenderCopy(renderer, entry.texture, nullptr, &destRect);
+}
+
+// Rasterizes the string once, composing the outline on the CPU so the
+// result is a single texture
+SDL_Texture* UI::renderText(const std::string& text, SDL_Color color, bool outline) {
+    SDL_Surface* surface = TTF_RenderText_Blended(font, text.c_str(), color);
+    if (!surface) {
+        std::cerr << "Failed to render text: " << TTF_GetError() << std::endl;
+        return nullptr;
+    }
+
     if (outline) {
         // Draw black outline
         SDL_Color outlineColor = {0, 0, 0, 255};
         const int outlineOffset = 1;
-        
-        // Draw outline in 8 directions
-        for(int dy = -outlineOffset; dy <= outlineOffset; dy++) {
-            for(int dx = -outlineOffset; dx <= outlineOffset; dx++) {
-                if (dx == 0 && dy == 0) continue; // Skip center
-                
-                SDL_Surface* outlineSurface = TTF_RenderText_Blended(font, text.c_str(), outlineColor);
-                if (!outlineSurface) continue;
-
-                SDL_Texture* outlineTexture = SDL_CreateTextureFromSurface(renderer, outlineSurface);
-                if (outlineTexture) {
-                    SDL_Rect outlineRect;
-                    outlineRect.x = x + dx;
-                    outlineRect.y = y + dy;
-                    SDL_QueryTexture(outlineTexture, nullptr, nullptr, &outlineRect.w, &outlineRect.h);
-                    SDL_RenderCopy(renderer, outlineTexture, nullptr, &outlineRect);
-                    SDL_DestroyTexture(outlineTexture);
+
+        SDL_Surface* outlineSurface = TTF_RenderText_Blended(font, text.c_str(), outlineColor);
+        SDL_Surface* composed = SDL_CreateRGBSurfaceWithFormat(0, surface->w + 2 * outlineOffset,
+                                                               surface->h + 2 * outlineOffset,
+                                                               32, SDL_PIXELFORMAT_ARGB8888);
+        if (outlineSurface && composed) {
+            SDL_SetSurfaceBlendMode(outlineSurface, SDL_BLENDMODE_BLEND);
+            SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+
+            // Outline in 8 directions, then the text on top
+            for(int dy = -outlineOffset; dy <= outlineOffset; dy++) {
+                for(int dx = -outlineOffset; dx <= outlineOffset; dx++) {
+                    if (dx == 0 && dy == 0) continue; // Skip center
+                    SDL_Rect outlineRect = {outlineOffset + dx, outlineOffset + dy, 0, 0};
+                    SDL_BlitSurface(outlineSurface, nullptr, composed, &outlineRect);
                 }
-                SDL_FreeSurface(outlineSurface);
             }
-        }
-    }
+            SDL_Rect textRect = {outlineOffset, outlineOffset, 0, 0};
+            SDL_BlitSurface(surface, nullptr, composed, &textRect);
 
-    // Draw main text
-    SDL_Surface* surface = TTF_RenderText_Blended(font, text.c_str(), color);
-    if (!surface) {
-        std::cerr << "Failed to render text: " << TTF_GetError() << std::endl;
-        return;
+            SDL_FreeSurface(surface);
+            surface = composed;
+            composed = nullptr;
+        }
+        if (composed) SDL_FreeSurface(composed);
+        if (outlineSurface) SDL_FreeSurface(outlineSurface);
     }
 
     SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
     if (!texture) {
         std::cerr << "Failed to create texture: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(surface);
-        return;
     }
-
-    SDL_Rect destRect;
-    destRect.x = x;
-    destRect.y = y;
-    SDL_QueryTexture(texture, nullptr, nullptr, &destRect.w, &destRect.h);
-
-    SDL_RenderCopy(renderer, texture, nullptr, &destRect);
-
     SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+    return texture;
 }
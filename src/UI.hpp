@@ -1,7 +1,12 @@
 #pragma once
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <cstddef>
+#include <list>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include "profiler.hpp"
 
 class UI {
 public:
@@ -12,10 +17,34 @@ public:
     bool init();
     
     // Draw text at specified position
-    void drawText(const std::string& text, int x, int y, SDL_Color color = {255, 255, 255, 255}, bool outline = true);
+    void drawText(std::string_view text, int x, int y, SDL_Color color = {255, 255, 255, 255}, bool outline = true);
+
+    // Times drawText() as Phase::DrawText when set
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
     
 private:
+    // A finished string texture, outline included
+    struct CachedText {
+        std::size_t key;
+        std::string text;
+        SDL_Color color;
+        bool outline;
+        SDL_Texture* texture;
+        int width;
+        int height;
+    };
+
+    static std::size_t cacheKey(std::string_view text, SDL_Color color, bool outline);
+    SDL_Texture* renderText(const std::string& text, SDL_Color color, bool outline);
+
     SDL_Renderer* renderer;
     TTF_Font* font;
+    Profiler* profiler = nullptr;
     static constexpr int FONT_SIZE = 24;
+
+    // Most recently used first. Lookups go through the hash so a hit never
+    // copies the string; a hash collision is treated as a miss.
+    std::list<CachedText> textCache;
+    std::unordered_map<std::size_t, std::list<CachedText>::iterator> textIndex;
+    static constexpr std::size_t MAX_CACHED_TEXTS = 64;
 };
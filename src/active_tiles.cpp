@@ -0,0 +1,66 @@
+#include "active_tiles.hpp"
+#include <algorithm>
+
+void ActiveTiles::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    maxSpansPerRow = (tilesX + 1) / 2;
+    flags.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+    dilated.assign(flags.size(), 0);
+    spans.assign(static_cast<size_t>(maxSpansPerRow) * tilesY, Span{0, 0});
+    spanCounts.assign(tilesY, 0);
+    setAll(true);
+}
+
+float ActiveTiles::getActiveFraction() const {
+    return flags.empty() ? 0.0f : static_cast<float>(activeCount) / flags.size();
+}
+
+void ActiveTiles::setActive(int tx, int ty, bool active) {
+    std::uint8_t& flag = flags[tx + ty * tilesX];
+    if ((flag != 0) == active) return;
+    flag = active;
+    activeCount += active ? 1 : -1;
+    rebuildRow(ty);
+}
+
+void ActiveTiles::setAll(bool active) {
+    std::fill(flags.begin(), flags.end(), active);
+    activeCount = active ? static_cast<int>(flags.size()) : 0;
+    for (int ty = 0; ty < tilesY; ty++) rebuildRow(ty);
+}
+
+void ActiveTiles::dilate(const int* radii) {
+    dilated = flags;
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int radius = radii[tx + ty * tilesX];
+            if (radius <= 0) continue;
+            for (int y = std::max(0, ty - radius); y <= std::min(tilesY - 1, ty + radius); y++) {
+                std::fill(&dilated[std::max(0, tx - radius) + y * tilesX],
+                          &dilated[std::min(tilesX - 1, tx + radius) + y * tilesX] + 1, 1);
+            }
+        }
+    }
+    flags.swap(dilated);
+    activeCount = static_cast<int>(std::count(flags.begin(), flags.end(), 1));
+    for (int ty = 0; ty < tilesY; ty++) rebuildRow(ty);
+}
+
+void ActiveTiles::rebuildRow(int ty) {
+    Span* row = &spans[static_cast<size_t>(ty) * maxSpansPerRow];
+    int count = 0;
+    for (int tx = 0; tx < tilesX; tx++) {
+        if (!isActive(tx, ty)) continue;
+        int begin = tx * TILE_SIZE;
+        int end = std::min(width, begin + TILE_SIZE);
+        if (count > 0 && row[count - 1].end == begin) {
+            row[count - 1].end = end;
+        } else {
+            row[count++] = Span{begin, end};
+        }
+    }
+    spanCounts[ty] = count;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Activity flags for square tiles of a width x height field, ghost cells
+// included. Phases given an ActiveTiles skip the cells of inactive tiles,
+// which are expected to hold zeros. The active tiles of every tile row are
+// kept as column spans so row loops can jump straight to them.
+class ActiveTiles {
+public:
+    static constexpr int TILE_SIZE = 32;
+
+    // Grid columns [begin, end)
+    struct Span {
+        int begin;
+        int end;
+    };
+
+    struct SpanRange {
+        const Span* first;
+        const Span* last;
+        const Span* begin() const { return first; }
+        const Span* end() const { return last; }
+    };
+
+    // Every tile starts out active
+    void resize(int width, int height);
+
+    int getTilesX() const { return tilesX; }
+    int getTilesY() const { return tilesY; }
+    int getActiveCount() const { return activeCount; }
+    float getActiveFraction() const;
+
+    bool isActive(int tx, int ty) const { return flags[tx + ty * tilesX] != 0; }
+    void setActive(int tx, int ty, bool active);
+    void setAll(bool active);
+
+    // Activates the tile holding cell (x, y)
+    void activateCell(int x, int y) {
+        int tx = x / TILE_SIZE;
+        int ty = y / TILE_SIZE;
+        if (!isActive(tx, ty)) setActive(tx, ty, true);
+    }
+
+    // Activates every tile within radii[t] tiles of tile t, where tiles are
+    // numbered tx + ty * getTilesX()
+    void dilate(const int* radii);
+
+    // Active spans of the tile row holding grid row y
+    SpanRange rowSpans(int y) const {
+        const Span* first = &spans[static_cast<std::size_t>(y / TILE_SIZE) * maxSpansPerRow];
+        return {first, first + spanCounts[y / TILE_SIZE]};
+    }
+
+private:
+    void rebuildRow(int ty);
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    int activeCount = 0;
+    int maxSpansPerRow = 0;
+    std::vector<std::uint8_t> flags;
+    std::vector<std::uint8_t> dilated;  // scratch for dilate()
+    std::vector<Span> spans;            // maxSpansPerRow slots per tile row
+    std::vector<int> spanCounts;
+};
@@ -0,0 +1,77 @@
+#include "advection.hpp"
+#include <algorithm>
+#include "interp.hpp"
+
+const char* advectionSchemeName(AdvectionScheme scheme) {
+    switch (scheme) {
+        case AdvectionScheme::SemiLagrangian: return "semi-lagrangian";
+        case AdvectionScheme::MacCormack: return "maccormack";
+        case AdvectionScheme::BFECC: return "bfecc";
+    }
+    return "unknown";
+}
+
+namespace {
+
+// Calls fn(idx, lo, hi) for every lane of the updated cells, with the range
+// of d0 at the corners of the cell's backtrace, the same backtrace advectRow
+// follows
+template <typename F>
+void forBacktraceRange(const GridContext& grid, const float* d0, int lanes, const float* velocX,
+                       const float* velocY, float dtx, float dty, F&& fn) {
+    const int width = grid.width;
+    const int height = grid.globalHeight();
+    const int rowOffset = grid.rowOffset();
+    grid.forRows([&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            grid.forSpans(j, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    const int idx = grid.IX(i, j);
+                    BilinearWeights w = bilinearWeights(width, height, i - dtx * velocX[idx],
+                                                        j + rowOffset - dty * velocY[idx]);
+                    const size_t corners[4] = {static_cast<size_t>(w.idx), static_cast<size_t>(w.idx) + 1,
+                                               static_cast<size_t>(w.idx) + width,
+                                               static_cast<size_t>(w.idx) + width + 1};
+                    for (int lane = 0; lane < lanes; lane++) {
+                        float lo = d0[corners[0] * lanes + lane];
+                        float hi = lo;
+                        for (int k = 1; k < 4; k++) {
+                            const float value = d0[corners[k] * lanes + lane];
+                            lo = std::min(lo, value);
+                            hi = std::max(hi, value);
+                        }
+                        fn(static_cast<size_t>(idx) * lanes + lane, lo, hi);
+                    }
+                }
+            });
+        }
+    });
+}
+
+}  // namespace
+
+void advection::correct(const GridContext& grid, float* d, const float* d0, const float* back, int lanes,
+                        const float* velocX, const float* velocY, float dtx, float dty) {
+    forBacktraceRange(grid, d0, lanes, velocX, velocY, dtx, dty, [&](size_t at, float lo, float hi) {
+        d[at] = std::clamp(d[at] + 0.5f * (d0[at] - back[at]), lo, hi);
+    });
+}
+
+void advection::compensate(const GridContext& grid, float* out, const float* d0, const float* back, int lanes) {
+    grid.forRows([&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            grid.forSpans(j, [&](int begin, int end) {
+                const size_t first = static_cast<size_t>(grid.IX(begin, j)) * lanes;
+                const size_t last = static_cast<size_t>(grid.IX(end, j)) * lanes;
+                for (size_t at = first; at < last; at++) out[at] = d0[at] + 0.5f * (d0[at] - back[at]);
+            });
+        }
+    });
+}
+
+void advection::limit(const GridContext& grid, float* d, const float* d0, int lanes,
+                      const float* velocX, const float* velocY, float dtx, float dty) {
+    forBacktraceRange(grid, d0, lanes, velocX, velocY, dtx, dty, [&](size_t at, float lo, float hi) {
+        d[at] = std::clamp(d[at], lo, hi);
+    });
+}
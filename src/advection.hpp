@@ -0,0 +1,34 @@
+#pragma once
+#include "grid.hpp"
+
+// How advect() transports a field along the velocity
+enum class AdvectionScheme {
+    SemiLagrangian,  // one bilinear backtrace; first order and dissipative
+    MacCormack,      // forward and reverse backtraces, half the round-trip error added back
+    BFECC            // as MacCormack, but the corrected source is advected again
+};
+
+const char* advectionSchemeName(AdvectionScheme scheme);
+
+// Correction and limiter passes shared by the scalar, velocity and
+// interleaved dye advection. Fields hold `lanes` floats per cell; every
+// pass covers the updated spans of the interior and leaves the ghost cells
+// to setBnd. dtx and dty are the forward backtrace's, as given to advectRow.
+namespace advection {
+
+// MacCormack: d holds the forward advection of d0 and back the reverse
+// advection of d. Each value becomes d + (d0 - back) / 2, clamped to the
+// range of d0 at the four corners of its forward backtrace, so the
+// correction cannot create new extrema.
+void correct(const GridContext& grid, float* d, const float* d0, const float* back, int lanes,
+             const float* velocX, const float* velocY, float dtx, float dty);
+
+// BFECC's compensated source: out = d0 + (d0 - back) / 2
+void compensate(const GridContext& grid, float* out, const float* d0, const float* back, int lanes);
+
+// Clamps d, advected from a compensated source, to the range of d0 at the
+// four corners of each cell's backtrace
+void limit(const GridContext& grid, float* d, const float* d0, int lanes,
+           const float* velocX, const float* velocY, float dtx, float dty);
+
+}  // namespace advection
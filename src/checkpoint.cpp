@@ -0,0 +1,304 @@
+#include "checkpoint.hpp"
+#include "fluid.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FLUID_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int SECTION_COUNT = static_cast<int>(CheckpointSection::Count);
+
+std::uint64_t alignOffset(std::uint64_t offset) {
+    return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+// The bytes of a checkpoint file. Mapped copy-on-write where the platform
+// allows, so pages are read on first touch and writes stay private to the
+// process; otherwise the file is read into one aligned block.
+class CheckpointImage {
+public:
+    ~CheckpointImage() {
+#ifdef FLUID_HAVE_MMAP
+        if (mapped) {
+            munmap(memory, bytes);
+            return;
+        }
+#endif
+        if (memory) ::operator delete(memory, std::align_val_t(WORKSPACE_ALIGNMENT));
+    }
+
+    static std::shared_ptr<CheckpointImage> open(const std::string& path) {
+        auto image = std::make_shared<CheckpointImage>();
+#ifdef FLUID_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Failed to open checkpoint " << path << std::endl;
+            return nullptr;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            std::cerr << "Failed to read checkpoint " << path << std::endl;
+            ::close(fd);
+            return nullptr;
+        }
+        image->bytes = static_cast<std::size_t>(info.st_size);
+        void* memory = mmap(nullptr, image->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            std::cerr << "Failed to map checkpoint " << path << std::endl;
+            return nullptr;
+        }
+        image->memory = static_cast<std::byte*>(memory);
+        image->mapped = true;
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in || in.tellg() <= 0) {
+            std::cerr << "Failed to open checkpoint " << path << std::endl;
+            return nullptr;
+        }
+        image->bytes = static_cast<std::size_t>(in.tellg());
+        image->memory = static_cast<std::byte*>(
+            ::operator new(image->bytes, std::align_val_t(WORKSPACE_ALIGNMENT)));
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(image->memory), static_cast<std::streamsize>(image->bytes))) {
+            std::cerr << "Failed to read checkpoint " << path << std::endl;
+            return nullptr;
+        }
+#endif
+        return image;
+    }
+
+    std::byte* data() { return memory; }
+    std::size_t size() const { return bytes; }
+
+private:
+    std::byte* memory = nullptr;
+    std::size_t bytes = 0;
+    bool mapped = false;
+};
+
+int dyeStrideFor(DyeLayout layout, int channels) {
+    if (layout == DyeLayout::Interleaved) return channels;
+    if (layout == DyeLayout::InterleavedPadded) return (channels + 3) / 4 * 4;
+    return 1;
+}
+
+// Checks everything loadCheckpoint() relies on before any state changes
+bool validate(const std::string& path, const CheckpointImage& image, const CheckpointHeader& header,
+              const CheckpointSectionEntry* sections) {
+    auto fail = [&](const char* reason) {
+        std::cerr << "Invalid checkpoint " << path << ": " << reason << std::endl;
+        return false;
+    };
+    if (header.version != CHECKPOINT_VERSION) return fail("unsupported version");
+    if (header.byteOrder != CHECKPOINT_BYTE_ORDER) return fail("written with a different byte order");
+    if (header.headerBytes != sizeof(CheckpointHeader) || header.sectionCount != SECTION_COUNT) {
+        return fail("unexpected header");
+    }
+    if (header.fileBytes != image.size()) return fail("truncated");
+    if (header.width < 3 || header.height < 3 || header.channels < 3) return fail("bad dimensions");
+    if (header.dyeLayout < 0 || header.dyeLayout > static_cast<int>(DyeLayout::InterleavedPadded) ||
+        header.dyeStorage < 0 || header.dyeStorage > static_cast<int>(DyeStorage::Float16)) {
+        return fail("bad dye format");
+    }
+    const DyeLayout layout = static_cast<DyeLayout>(header.dyeLayout);
+    const bool half = static_cast<DyeStorage>(header.dyeStorage) == DyeStorage::Float16;
+    if (half && layout != DyeLayout::Planar) return fail("bad dye format");
+    if (header.dyeStride != dyeStrideFor(layout, header.channels)) return fail("bad dye stride");
+
+    const std::uint64_t cells = static_cast<std::uint64_t>(header.width) * header.height;
+    const std::uint64_t dyeCount = cells * (layout == DyeLayout::Planar ? header.channels : header.dyeStride);
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        const CheckpointSectionEntry& entry = sections[s];
+        const auto id = static_cast<CheckpointSection>(s);
+        std::uint64_t count = cells;
+        std::uint32_t elementBytes = sizeof(float);
+        if (id == CheckpointSection::ChannelDiffusion) count = header.channels;
+        if (id == CheckpointSection::Dye || id == CheckpointSection::DyeScratch) count = half ? 0 : dyeCount;
+        if (id == CheckpointSection::DyeHalf) {
+            count = half ? dyeCount : 0;
+            elementBytes = sizeof(Half);
+        }
+        if (id == CheckpointSection::Solid) {
+            count = entry.count == 0 ? 0 : cells;
+            elementBytes = sizeof(std::uint8_t);
+        }
+        if (entry.id != static_cast<std::uint32_t>(s) || entry.count != count ||
+            entry.elementBytes != elementBytes || entry.offset % CHECKPOINT_ALIGNMENT != 0 ||
+            entry.offset > image.size() || entry.count * entry.elementBytes > image.size() - entry.offset) {
+            return fail("bad section table");
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+// Written to a temporary file that then replaces path, so a failed save
+// never leaves a partial checkpoint behind and a simulation restored from
+// path keeps its pages while it is overwritten
+bool FluidSimulation::saveCheckpoint(const std::string& path) const {
+    struct Source {
+        const void* data;
+        std::uint64_t count;
+        std::uint32_t elementBytes;
+    };
+    std::vector<std::uint8_t> solid;
+    if (!obstacles.empty() || obstacles.isDirty()) {
+        solid.assign(static_cast<size_t>(width) * height, 0);
+        for (int y = 1; y < height - 1; y++) {
+            for (int x = 1; x < width - 1; x++) solid[x + y * width] = obstacles.isSolid(x, y) ? 1 : 0;
+        }
+    }
+    const Source sources[SECTION_COUNT] = {
+        {channelDiffusion.data(), channelDiffusion.size(), sizeof(float)},
+        {Vx.data(), Vx.size(), sizeof(float)},
+        {Vy.data(), Vy.size(), sizeof(float)},
+        {Vx0.data(), Vx0.size(), sizeof(float)},
+        {Vy0.data(), Vy0.size(), sizeof(float)},
+        {pressure.data(), pressure.size(), sizeof(float)},
+        {dye.data(), dye.size(), sizeof(float)},
+        {dyeScratch.data(), dyeScratch.size(), sizeof(float)},
+        {dyeHalf.data(), dyeHalf.size(), sizeof(Half)},
+        {solid.data(), solid.size(), sizeof(std::uint8_t)},
+    };
+
+    CheckpointSectionEntry sections[SECTION_COUNT];
+    std::uint64_t offset = alignOffset(sizeof(CheckpointHeader) + sizeof(sections));
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        sections[s] = {static_cast<std::uint32_t>(s), sources[s].elementBytes, offset, sources[s].count};
+        offset = alignOffset(offset + sources[s].count * sources[s].elementBytes);
+    }
+
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.byteOrder = CHECKPOINT_BYTE_ORDER;
+    header.headerBytes = sizeof(CheckpointHeader);
+    header.sectionCount = SECTION_COUNT;
+    header.width = width;
+    header.height = height;
+    header.channels = getChannelCount();
+    header.dyeLayout = static_cast<std::int32_t>(dyeLayout);
+    header.dyeStorage = static_cast<std::int32_t>(dyeStorage);
+    header.dyeStride = dyeStride;
+    header.dt = dt;
+    header.diffusion = diff;
+    header.viscosity = visc;
+    header.fileBytes = offset;
+
+    const std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to create checkpoint " << temporary << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+    std::uint64_t written = sizeof(header) + sizeof(sections);
+    const std::vector<char> padding(CHECKPOINT_ALIGNMENT, 0);
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        out.write(padding.data(), static_cast<std::streamsize>(sections[s].offset - written));
+        const std::uint64_t bytes = sections[s].count * sections[s].elementBytes;
+        if (bytes) out.write(static_cast<const char*>(sources[s].data), static_cast<std::streamsize>(bytes));
+        written = sections[s].offset + bytes;
+    }
+    out.write(padding.data(), static_cast<std::streamsize>(header.fileBytes - written));
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write checkpoint " << temporary << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to replace checkpoint " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FluidSimulation::loadCheckpoint(const std::string& path) {
+    if (halo) {
+        std::cerr << "Checkpoints are not supported on a decomposed grid" << std::endl;
+        return false;
+    }
+    std::shared_ptr<CheckpointImage> image = CheckpointImage::open(path);
+    if (!image) return false;
+    std::byte* base = image->data();
+
+    CheckpointHeader header;
+    CheckpointSectionEntry sections[SECTION_COUNT];
+    if (image->size() < sizeof(header) || std::memcmp(base, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a checkpoint: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&header, base, sizeof(header));
+    if (header.headerBytes != sizeof(header) || header.sectionCount != SECTION_COUNT ||
+        image->size() < sizeof(header) + sizeof(sections)) {
+        std::cerr << "Invalid checkpoint " << path << ": unexpected header" << std::endl;
+        return false;
+    }
+    std::memcpy(sections, base + sizeof(header), sizeof(sections));
+    if (!validate(path, *image, header, sections)) return false;
+
+    // Fields point into the image, which lives as long as any of them
+    auto adopt = [&](auto& field, CheckpointSection id) {
+        using T = std::remove_reference_t<decltype(field[0])>;
+        const CheckpointSectionEntry& entry = sections[static_cast<int>(id)];
+        if (entry.count == 0) {
+            field = std::remove_reference_t<decltype(field)>();
+        } else {
+            field.adopt(reinterpret_cast<T*>(base + entry.offset), entry.count, image);
+        }
+    };
+    adopt(Vx, CheckpointSection::Vx);
+    adopt(Vy, CheckpointSection::Vy);
+    adopt(Vx0, CheckpointSection::Vx0);
+    adopt(Vy0, CheckpointSection::Vy0);
+    adopt(pressure, CheckpointSection::Pressure);
+    adopt(dye, CheckpointSection::Dye);
+    adopt(dyeScratch, CheckpointSection::DyeScratch);
+    adopt(dyeHalf, CheckpointSection::DyeHalf);
+
+    const CheckpointSectionEntry& diffusions = sections[static_cast<int>(CheckpointSection::ChannelDiffusion)];
+    const float* channelDiffusions = reinterpret_cast<const float*>(base + diffusions.offset);
+    channelDiffusion.assign(channelDiffusions, channelDiffusions + diffusions.count);
+    channelA.resize(header.channels);
+    channelInvC.resize(header.channels);
+    dyeLayout = static_cast<DyeLayout>(header.dyeLayout);
+    dyeStorage = static_cast<DyeStorage>(header.dyeStorage);
+    dyeStride = header.dyeStride;
+
+    width = header.width;
+    height = header.height;
+    dt = header.dt;
+    diff = header.diffusion;
+    visc = header.viscosity;
+
+    // Activity is not recorded; tracking starts over from every tile active
+    resizeTiles();
+    obstacles.resize(width, height);
+    const CheckpointSectionEntry& solids = sections[static_cast<int>(CheckpointSection::Solid)];
+    const std::uint8_t* solid = reinterpret_cast<const std::uint8_t*>(base + solids.offset);
+    for (std::uint64_t idx = 0; idx < solids.count; idx++) {
+        if (solid[idx]) obstacles.setSolid(static_cast<int>(idx % width), static_cast<int>(idx / width), true);
+    }
+    updateObstacles();
+    // Splats queued for the replaced state would land on the restored one
+    splats.clear();
+    reserveWorkspace();
+    solveStats.reserve(4 + getChannelCount());
+    return true;
+}
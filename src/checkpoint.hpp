@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+
+// On-disk layout of FluidSimulation::saveCheckpoint().
+//
+// A fixed header is followed by a table of sections. Every section starts
+// at a CHECKPOINT_ALIGNMENT offset, so loadCheckpoint() can map the file
+// and point the simulation's fields straight at its pages. Values are in
+// the byte order of the machine that wrote them; the header records it
+// and a mismatching file is rejected rather than swapped.
+constexpr char CHECKPOINT_MAGIC[8] = {'F', 'L', 'U', 'I', 'D', 'C', 'K', '\0'};
+constexpr std::uint32_t CHECKPOINT_VERSION = 2;
+constexpr std::uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304u;
+constexpr std::uint64_t CHECKPOINT_ALIGNMENT = 4096;  // page size
+
+enum class CheckpointSection : std::uint32_t {
+    ChannelDiffusion,  // float per channel
+    Vx,                // float per cell, likewise up to Pressure
+    Vy,
+    Vx0,
+    Vy0,
+    Pressure,
+    Dye,               // float dye and its scratch, in the recorded layout
+    DyeScratch,
+    DyeHalf,           // Half dye with Float16 storage
+    Solid,             // byte per cell, 1 on barriers; empty without barriers
+    Count
+};
+
+struct CheckpointHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t headerBytes;   // sizeof(CheckpointHeader)
+    std::uint32_t sectionCount;  // entries in the table that follows
+    std::int32_t width;
+    std::int32_t height;
+    std::int32_t channels;
+    std::int32_t dyeLayout;      // DyeLayout
+    std::int32_t dyeStorage;     // DyeStorage
+    std::int32_t dyeStride;
+    float dt;
+    float diffusion;
+    float viscosity;
+    std::uint32_t reserved;
+    std::uint64_t fileBytes;
+};
+
+struct CheckpointSectionEntry {
+    std::uint32_t id;            // CheckpointSection
+    std::uint32_t elementBytes;
+    std::uint64_t offset;        // from the start of the file
+    std::uint64_t count;         // elements
+};
@@ -0,0 +1,186 @@
+#include "dye.hpp"
+#include "interp.hpp"
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define DYE_HAVE_SSE 1
+#endif
+
+namespace {
+
+// Calls fn with compile-time (channels, stride) for the common shapes so the
+// per-channel loops unroll and vectorize; (0, 0) means "use the runtime values"
+template <typename F>
+void dispatchShape(int channels, int stride, F&& fn) {
+    using std::integral_constant;
+    if (channels == 1 && stride == 1) {
+        fn(integral_constant<int, 1>{}, integral_constant<int, 1>{});
+    } else if (channels == 3 && stride == 3) {
+        fn(integral_constant<int, 3>{}, integral_constant<int, 3>{});
+    } else if (channels == 3 && stride == 4) {
+        fn(integral_constant<int, 3>{}, integral_constant<int, 4>{});
+    } else if (channels == 4 && stride == 4) {
+        fn(integral_constant<int, 4>{}, integral_constant<int, 4>{});
+    } else {
+        fn(integral_constant<int, 0>{}, integral_constant<int, 0>{});
+    }
+}
+
+// For fixed shapes the padding lanes are updated too, with coefficients that
+// keep them at zero, so a padded cell is processed as one full vector
+template <int C, int S>
+void relaxColor(const GridContext& grid, float* x, const float* x0, int channels, int stride,
+                const float* a, const float* invC, int color) {
+    constexpr int LANES = S ? S : 1;
+    const int nc = S ? S : channels;
+    const size_t ns = S ? S : stride;
+    const size_t rowStride = ns * grid.width;
+    grid.forRows([&](int rowBegin, int rowEnd) {
+        // Local copies of fixed-size coefficients cannot alias the field,
+        // which lets the channel loop stay in registers
+        float localA[LANES];
+        float localInvC[LANES];
+        const float* ka = a;
+        const float* ki = invC;
+        if constexpr (S > 0) {
+            for (int c = 0; c < S; c++) {
+                localA[c] = c < C ? a[c] : 0.0f;
+                localInvC[c] = c < C ? invC[c] : 1.0f;
+            }
+            ka = localA;
+            ki = localInvC;
+        }
+        for (int j = rowBegin; j < rowEnd; j++) {
+            grid.forSpans(j, [&](int begin, int end) {
+                for (int i = begin + ((begin + j + color) & 1); i < end; i += 2) {
+                    size_t offset = static_cast<size_t>(grid.IX(i, j)) * ns;
+                    float* cell = x + offset;
+                    const float* src = x0 + offset;
+                    const float* left = cell - ns;
+                    const float* right = cell + ns;
+                    const float* up = cell - rowStride;
+                    const float* down = cell + rowStride;
+#ifdef DYE_HAVE_SSE
+                    // A padded cell is exactly one SSE vector; left to itself the
+                    // compiler vectorizes across cells with gathers instead
+                    if constexpr (S == 4) {
+                        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(left), _mm_loadu_ps(right)),
+                                                _mm_add_ps(_mm_loadu_ps(up), _mm_loadu_ps(down)));
+                        __m128 rhs = _mm_add_ps(_mm_loadu_ps(src), _mm_mul_ps(_mm_loadu_ps(ka), sum));
+                        _mm_storeu_ps(cell, _mm_mul_ps(rhs, _mm_loadu_ps(ki)));
+                        continue;
+                    }
+#endif
+                    for (int c = 0; c < nc; c++) {
+                        cell[c] = (src[c] + ka[c] * (left[c] + right[c] + up[c] + down[c])) * ki[c];
+                    }
+                }
+            });
+        }
+    });
+}
+
+template <int C, int S>
+void advectRows(const GridContext& grid, float* d, const float* d0, int channels, int stride,
+                const float* velocX, const float* velocY, float dtx, float dty) {
+    const int nc = S ? S : channels;
+    const size_t ns = S ? S : stride;
+    const int width = grid.width;
+    const size_t rowStride = ns * width;
+    grid.forRows([&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            grid.forSpans(j, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    int idx = grid.IX(i, j);
+                    BilinearWeights w = bilinearWeights(width, grid.height, i - dtx * velocX[idx], j - dty * velocY[idx]);
+                    const float* c00 = d0 + static_cast<size_t>(w.idx) * ns;
+                    const float* c10 = c00 + ns;
+                    const float* c01 = c00 + rowStride;
+                    const float* c11 = c01 + ns;
+                    float* out = d + static_cast<size_t>(idx) * ns;
+#ifdef DYE_HAVE_SSE
+                    if constexpr (S == 4) {
+                        __m128 top = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w.s0), _mm_loadu_ps(c00)),
+                                                _mm_mul_ps(_mm_set1_ps(w.s1), _mm_loadu_ps(c10)));
+                        __m128 bottom = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w.s0), _mm_loadu_ps(c01)),
+                                                   _mm_mul_ps(_mm_set1_ps(w.s1), _mm_loadu_ps(c11)));
+                        _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w.t0), top),
+                                                      _mm_mul_ps(_mm_set1_ps(w.t1), bottom)));
+                        continue;
+                    }
+#endif
+                    for (int c = 0; c < nc; c++) {
+                        out[c] = w.s0 * (w.t0 * c00[c] + w.t1 * c01[c]) + w.s1 * (w.t0 * c10[c] + w.t1 * c11[c]);
+                    }
+                }
+            });
+        }
+    });
+}
+
+}  // namespace
+
+const char* dyeLayoutName(DyeLayout layout) {
+    switch (layout) {
+        case DyeLayout::Planar: return "planar";
+        case DyeLayout::Interleaved: return "interleaved";
+        case DyeLayout::InterleavedPadded: return "padded";
+    }
+    return "unknown";
+}
+
+const char* dyeStorageName(DyeStorage storage) {
+    switch (storage) {
+        case DyeStorage::Float32: return "f32";
+        case DyeStorage::Float16: return "f16";
+    }
+    return "unknown";
+}
+
+void dye::relax(const GridContext& grid, float* x, const float* x0, int channels, int stride,
+                const float* a, const float* invC) {
+    dispatchShape(channels, stride, [&](auto C, auto S) {
+        for (int color = 0; color < 2; color++) {
+            relaxColor<decltype(C)::value, decltype(S)::value>(grid, x, x0, channels, stride, a, invC, color);
+        }
+    });
+    setBnd(grid, x, channels, stride);
+}
+
+void dye::advect(const GridContext& grid, float* d, const float* d0, int channels, int stride,
+                 const float* velocX, const float* velocY, float dtx, float dty) {
+    dispatchShape(channels, stride, [&](auto C, auto S) {
+        advectRows<decltype(C)::value, decltype(S)::value>(grid, d, d0, channels, stride,
+                                                           velocX, velocY, dtx, dty);
+    });
+    setBnd(grid, d, channels, stride);
+}
+
+void dye::setBnd(const GridContext& grid, float* x, int channels, int stride) {
+    Profiler::Scope scope(*grid.profiler, Phase::SetBnd);
+    const int width = grid.width;
+    const int height = grid.height;
+    auto cell = [&](int i, int j) { return x + static_cast<size_t>(grid.IX(i, j)) * stride; };
+    auto copy = [&](float* dst, const float* src) {
+        for (int c = 0; c < channels; c++) dst[c] = src[c];
+    };
+    auto average = [&](float* dst, const float* p, const float* q) {
+        for (int c = 0; c < channels; c++) dst[c] = 0.5f * (p[c] + q[c]);
+    };
+
+    for (int i = 1; i < width - 1; i++) {
+        copy(cell(i, 0), cell(i, 1));
+        copy(cell(i, height - 1), cell(i, height - 2));
+    }
+    for (int j = 1; j < height - 1; j++) {
+        copy(cell(0, j), cell(1, j));
+        copy(cell(width - 1, j), cell(width - 2, j));
+    }
+
+    average(cell(0, 0), cell(1, 0), cell(0, 1));
+    average(cell(0, height - 1), cell(1, height - 1), cell(0, height - 2));
+    average(cell(width - 1, 0), cell(width - 2, 0), cell(width - 1, 1));
+    average(cell(width - 1, height - 1), cell(width - 2, height - 1), cell(width - 1, height - 2));
+    if (grid.obstacles) grid.obstacles->setBoundary(0, x, channels, stride);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "grid.hpp"
+#include "half.hpp"
+
+// Storage order of the dye / passive scalar channels
+enum class DyeLayout {
+    Planar,            // one contiguous plane per channel
+    Interleaved,       // all channels of a cell adjacent (e.g. RGB)
+    InterleavedPadded  // as Interleaved, cells padded to a multiple of 4 floats (e.g. RGBA)
+};
+
+const char* dyeLayoutName(DyeLayout layout);
+
+// Precision the dye is kept in between steps. Steps always compute in float;
+// Float16 halves the dye's footprint and requires the planar layout.
+enum class DyeStorage {
+    Float32,
+    Float16
+};
+
+const char* dyeStorageName(DyeStorage storage);
+
+// Strided read-only view of one channel, indexed like the velocity fields.
+// With 16-bit storage half is set instead of data.
+struct ChannelView {
+    const float* data;
+    int stride;
+    const Half* half = nullptr;
+
+    float operator[](int idx) const {
+        size_t offset = static_cast<size_t>(idx) * stride;
+        return half ? halfToFloat(half[offset]) : data[offset];
+    }
+};
+
+// Fused kernels for interleaved channels: each cell holds `stride` floats of
+// which the first `channels` are used. Every channel of a cell is updated in
+// the same pass, so the backtrace and interpolation weights are computed once.
+namespace dye {
+
+// Red-black relaxation sweep for all channels, followed by the boundary.
+// a and invC hold one coefficient per channel.
+void relax(const GridContext& grid, float* x, const float* x0, int channels, int stride,
+           const float* a, const float* invC);
+
+// Semi-Lagrangian advection of all channels through (velocX, velocY)
+void advect(const GridContext& grid, float* d, const float* d0, int channels, int stride,
+            const float* velocX, const float* velocY, float dtx, float dty);
+
+// Scalar (b = 0) boundary for all channels
+void setBnd(const GridContext& grid, float* x, int channels, int stride);
+
+}  // namespace dye
@@ -0,0 +1,339 @@
+#include "ensemble.hpp"
+#include "interp.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <initializer_list>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define ENSEMBLE_HAVE_AVX2 1
+#endif
+
+namespace {
+
+constexpr int L = FluidEnsemble::LANES;
+
+#ifdef ENSEMBLE_HAVE_AVX2
+static_assert(L == 8, "a cell's lanes must be one AVX vector");
+#endif
+
+// Red-black sweeps fused into one pass over the rows. A lane-interleaved
+// row is LANES times wider than a member's, so sweeping the whole grid for
+// each iteration would stream it from memory every time.
+constexpr int WAVEFRONT_DEPTH = 4;
+
+// Geometry of one group's fields
+struct Lanes {
+    int width;
+    int height;
+
+    float* cell(float* x, int i, int j) const { return x + (static_cast<size_t>(j) * width + i) * L; }
+    const float* cell(const float* x, int i, int j) const { return x + (static_cast<size_t>(j) * width + i) * L; }
+    size_t rowStride() const { return static_cast<size_t>(width) * L; }
+};
+
+void mirror(float* dst, const float* src, bool negate) {
+    const float sign = negate ? -1.0f : 1.0f;
+    for (int l = 0; l < L; l++) dst[l] = sign * src[l];
+}
+
+void average(float* dst, const float* p, const float* q) {
+    for (int l = 0; l < L; l++) dst[l] = 0.5f * (p[l] + q[l]);
+}
+
+// GridContext::setBnd applied to every lane
+void setBnd(const Lanes& g, int b, float* x) {
+    const int width = g.width;
+    const int height = g.height;
+    for (int i = 1; i < width - 1; i++) {
+        mirror(g.cell(x, i, 0), g.cell(x, i, 1), b == 2);
+        mirror(g.cell(x, i, height - 1), g.cell(x, i, height - 2), b == 2);
+    }
+    for (int j = 1; j < height - 1; j++) {
+        mirror(g.cell(x, 0, j), g.cell(x, 1, j), b == 1);
+        mirror(g.cell(x, width - 1, j), g.cell(x, width - 2, j), b == 1);
+    }
+    average(g.cell(x, 0, 0), g.cell(x, 1, 0), g.cell(x, 0, 1));
+    average(g.cell(x, 0, height - 1), g.cell(x, 1, height - 1), g.cell(x, 0, height - 2));
+    average(g.cell(x, width - 1, 0), g.cell(x, width - 2, 0), g.cell(x, width - 1, 1));
+    average(g.cell(x, width - 1, height - 1), g.cell(x, width - 2, height - 1), g.cell(x, width - 1, height - 2));
+}
+
+// The part of setBnd that changes when row j finishes a sweep, as in grid.cpp
+void finishRow(const Lanes& g, int b, float* x, int j) {
+    const int width = g.width;
+    const int height = g.height;
+    mirror(g.cell(x, 0, j), g.cell(x, 1, j), b == 1);
+    mirror(g.cell(x, width - 1, j), g.cell(x, width - 2, j), b == 1);
+    if (j == 1) {
+        for (int i = 1; i < width - 1; i++) mirror(g.cell(x, i, 0), g.cell(x, i, 1), b == 2);
+        average(g.cell(x, 0, 0), g.cell(x, 1, 0), g.cell(x, 0, 1));
+        average(g.cell(x, width - 1, 0), g.cell(x, width - 2, 0), g.cell(x, width - 1, 1));
+    }
+    if (j == height - 2) {
+        for (int i = 1; i < width - 1; i++) mirror(g.cell(x, i, height - 1), g.cell(x, i, height - 2), b == 2);
+        average(g.cell(x, 0, height - 1), g.cell(x, 1, height - 1), g.cell(x, 0, height - 2));
+        average(g.cell(x, width - 1, height - 1), g.cell(x, width - 2, height - 1), g.cell(x, width - 1, height - 2));
+    }
+}
+
+// Cells of row j with (i + j + color) even, with per-lane a and invC. The
+// arithmetic is ordered as in the relaxRow kernels.
+void relaxRow(const Lanes& g, float* x, const float* x0, int j, int color, const float* a, const float* invC) {
+    const size_t rowStride = g.rowStride();
+    // One cell's lanes are too short a loop for the compiler, which guards
+    // each cell with a runtime aliasing check
+#ifdef ENSEMBLE_HAVE_AVX2
+    const __m256 va = _mm256_loadu_ps(a);
+    const __m256 vInvC = _mm256_loadu_ps(invC);
+#endif
+    for (int i = 1 + ((1 + j + color) & 1); i < g.width - 1; i += 2) {
+        float* cell = g.cell(x, i, j);
+        const float* src = g.cell(x0, i, j);
+        const float* up = cell - rowStride;
+        const float* down = cell + rowStride;
+#ifdef ENSEMBLE_HAVE_AVX2
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(cell - L), _mm256_loadu_ps(cell + L)),
+                                   _mm256_add_ps(_mm256_loadu_ps(up), _mm256_loadu_ps(down)));
+        _mm256_storeu_ps(cell, _mm256_mul_ps(_mm256_fmadd_ps(va, sum, _mm256_loadu_ps(src)), vInvC));
+#else
+        for (int l = 0; l < L; l++) {
+            cell[l] = (src[l] + a[l] * ((cell[l - L] + cell[l + L]) + (up[l] + down[l]))) * invC[l];
+        }
+#endif
+    }
+}
+
+// `sweeps` red-black sweeps, each followed by the boundary. Uses the
+// schedule of relaxWavefront() in grid.cpp on one thread: half-sweep h
+// updates row j at step t = j - 1 + 2h, so results match sweeping the whole
+// grid each time.
+void relaxSweeps(const Lanes& g, int b, float* x, const float* x0, const float* a, const float* invC,
+                 int sweeps) {
+    // Local copies of the coefficients cannot alias the field, which lets
+    // the scalar lane loop keep them in registers
+    alignas(64) float ka[L];
+    alignas(64) float ki[L];
+    std::copy(a, a + L, ka);
+    std::copy(invC, invC + L, ki);
+    const int rows = g.height - 2;
+    for (int done = 0; done < sweeps; done += WAVEFRONT_DEPTH) {
+        const int halfSweeps = 2 * std::min(WAVEFRONT_DEPTH, sweeps - done);
+        const int steps = rows + 2 * (halfSweeps - 1);
+        for (int t = 0; t < steps; t++) {
+            int first = std::max(1, 1 + t - 2 * (halfSweeps - 1));
+            first += (1 + t - first) & 1;
+            for (int j = first; j <= rows && j <= 1 + t; j += 2) {
+                int color = ((1 + t - j) / 2) & 1;
+                relaxRow(g, x, x0, j, color, ka, ki);
+                if (color == 1) finishRow(g, b, x, j);
+            }
+        }
+    }
+}
+
+// Every lane solves the same pressure system, so the neighbours of a cell
+// are whole rows of lanes and the divergence and gradient run as one flat
+// loop per grid row
+void project(const Lanes& g, float* u, float* v, float* p, float* div, int iterations) {
+    const size_t rowStride = g.rowStride();
+    const size_t count = static_cast<size_t>(g.width - 2) * L;
+    const float divScale = -0.5f / g.width;
+    for (int j = 1; j < g.height - 1; j++) {
+        const size_t row = g.cell(div, 1, j) - div;
+        for (size_t o = row; o < row + count; o++) {
+            div[o] = divScale * ((u[o + L] - u[o - L]) + (v[o + rowStride] - v[o - rowStride]));
+            p[o] = 0;
+        }
+    }
+    setBnd(g, 0, div);
+    setBnd(g, 0, p);
+
+    float a[L];
+    float invC[L];
+    std::fill(a, a + L, 1.0f);
+    std::fill(invC, invC + L, 0.25f);
+    relaxSweeps(g, 0, p, div, a, invC, iterations);
+
+    const float gradScale = 0.5f * g.width;
+    for (int j = 1; j < g.height - 1; j++) {
+        const size_t row = g.cell(p, 1, j) - p;
+        for (size_t o = row; o < row + count; o++) {
+            u[o] -= gradScale * (p[o + L] - p[o - L]);
+            v[o] -= gradScale * (p[o + rowStride] - p[o - rowStride]);
+        }
+    }
+    setBnd(g, 1, u);
+    setBnd(g, 2, v);
+}
+
+// Each lane backtraces through its own velocity with its own time step, so
+// the corners are gathered per lane; otherwise as the advectRow kernels
+void advect(const Lanes& g, int b, float* d, const float* d0, const float* u, const float* v,
+            const float* dtx, const float* dty) {
+    const size_t rowStride = g.rowStride();
+#ifdef ENSEMBLE_HAVE_AVX2
+    const __m256 vDtx = _mm256_loadu_ps(dtx);
+    const __m256 vDty = _mm256_loadu_ps(dty);
+    const __m256 lo = _mm256_set1_ps(0.5f);
+    const __m256 maxX = _mm256_set1_ps(g.width - 1.5f);
+    const __m256 maxY = _mm256_set1_ps(g.height - 1.5f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i vWidth = _mm256_set1_epi32(g.width);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i right = _mm256_set1_epi32(L);
+    const __m256i down = _mm256_set1_epi32(static_cast<int>(rowStride));
+    for (int j = 1; j < g.height - 1; j++) {
+        const __m256 row = _mm256_set1_ps(static_cast<float>(j));
+        for (int i = 1; i < g.width - 1; i++) {
+            __m256 x = _mm256_fnmadd_ps(vDtx, _mm256_loadu_ps(g.cell(u, i, j)), _mm256_set1_ps(static_cast<float>(i)));
+            __m256 y = _mm256_fnmadd_ps(vDty, _mm256_loadu_ps(g.cell(v, i, j)), row);
+            x = _mm256_min_ps(_mm256_max_ps(x, lo), maxX);
+            y = _mm256_min_ps(_mm256_max_ps(y, lo), maxY);
+
+            __m256 i0 = _mm256_floor_ps(x);
+            __m256 j0 = _mm256_floor_ps(y);
+            __m256 s1 = _mm256_sub_ps(x, i0);
+            __m256 s0 = _mm256_sub_ps(one, s1);
+            __m256 t1 = _mm256_sub_ps(y, j0);
+            __m256 t0 = _mm256_sub_ps(one, t1);
+
+            __m256i cellIdx = _mm256_add_epi32(_mm256_cvttps_epi32(i0),
+                                               _mm256_mullo_epi32(_mm256_cvttps_epi32(j0), vWidth));
+            __m256i idx = _mm256_add_epi32(_mm256_slli_epi32(cellIdx, 3), lanes);
+            __m256i below = _mm256_add_epi32(idx, down);
+            __m256 d00 = _mm256_i32gather_ps(d0, idx, 4);
+            __m256 d10 = _mm256_i32gather_ps(d0, _mm256_add_epi32(idx, right), 4);
+            __m256 d01 = _mm256_i32gather_ps(d0, below, 4);
+            __m256 d11 = _mm256_i32gather_ps(d0, _mm256_add_epi32(below, right), 4);
+
+            __m256 leftCol = _mm256_fmadd_ps(t0, d00, _mm256_mul_ps(t1, d01));
+            __m256 rightCol = _mm256_fmadd_ps(t0, d10, _mm256_mul_ps(t1, d11));
+            _mm256_storeu_ps(g.cell(d, i, j), _mm256_fmadd_ps(s0, leftCol, _mm256_mul_ps(s1, rightCol)));
+        }
+    }
+#else
+    for (int j = 1; j < g.height - 1; j++) {
+        for (int i = 1; i < g.width - 1; i++) {
+            const float* cu = g.cell(u, i, j);
+            const float* cv = g.cell(v, i, j);
+            float* out = g.cell(d, i, j);
+            for (int l = 0; l < L; l++) {
+                BilinearWeights w = bilinearWeights(g.width, g.height, i - dtx[l] * cu[l], j - dty[l] * cv[l]);
+                const float* c = d0 + static_cast<size_t>(w.idx) * L + l;
+                out[l] = w.s0 * (w.t0 * c[0] + w.t1 * c[rowStride]) + w.s1 * (w.t0 * c[L] + w.t1 * c[rowStride + L]);
+            }
+        }
+    }
+#endif
+    setBnd(g, b, d);
+}
+
+}  // namespace
+
+FluidEnsemble::FluidEnsemble(int width, int height, const std::vector<EnsembleMember>& members)
+    : width(width), height(height), members(members),
+      pool(std::make_unique<ThreadPool>(ThreadPool::defaultThreadCount())) {
+    groups.resize((members.size() + LANES - 1) / LANES);
+    for (Group& group : groups) {
+        std::fill(group.viscA, group.viscA + LANES, 0.0f);
+        std::fill(group.viscInvC, group.viscInvC + LANES, 1.0f);
+        std::fill(group.diffA, group.diffA + LANES, 0.0f);
+        std::fill(group.diffInvC, group.diffInvC + LANES, 1.0f);
+        std::fill(group.dtx, group.dtx + LANES, 0.0f);
+        std::fill(group.dty, group.dty + LANES, 0.0f);
+    }
+    for (int m = 0; m < getMemberCount(); m++) updateCoefficients(m);
+    reset();
+}
+
+void FluidEnsemble::reset() {
+    const size_t size = static_cast<size_t>(width) * height * LANES;
+    for (Group& group : groups) {
+        for (Field* field : {&group.Vx, &group.Vy, &group.Vx0, &group.Vy0, &group.pressure, &group.div}) {
+            field->assign(size, 0);
+        }
+        for (int c = 0; c < CHANNELS; c++) {
+            group.dye[c].assign(size, 0);
+            group.dyeScratch[c].assign(size, 0);
+        }
+    }
+}
+
+void FluidEnsemble::step() {
+    auto start = std::chrono::steady_clock::now();
+    pool->parallelFor(0, static_cast<int>(groups.size()), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) stepGroup(groups[k]);
+    });
+    stepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cellSteps += static_cast<std::uint64_t>(members.size()) * width * height;
+}
+
+// FluidSimulation::step() for all lanes of the group
+void FluidEnsemble::stepGroup(Group& group) {
+    const Lanes g{width, height};
+    relaxSweeps(g, 1, group.Vx0.data(), group.Vx.data(), group.viscA, group.viscInvC, diffusionIterations);
+    relaxSweeps(g, 2, group.Vy0.data(), group.Vy.data(), group.viscA, group.viscInvC, diffusionIterations);
+    project(g, group.Vx0.data(), group.Vy0.data(), group.pressure.data(), group.div.data(), pressureIterations);
+    advect(g, 1, group.Vx.data(), group.Vx0.data(), group.Vx0.data(), group.Vy0.data(), group.dtx, group.dty);
+    advect(g, 2, group.Vy.data(), group.Vy0.data(), group.Vx0.data(), group.Vy0.data(), group.dtx, group.dty);
+    project(g, group.Vx.data(), group.Vy.data(), group.pressure.data(), group.div.data(), pressureIterations);
+
+    for (int c = 0; c < CHANNELS; c++) {
+        float* d = group.dye[c].data();
+        float* d0 = group.dyeScratch[c].data();
+        relaxSweeps(g, 0, d0, d, group.diffA, group.diffInvC, diffusionIterations);
+        advect(g, 0, d, d0, group.Vx.data(), group.Vy.data(), group.dtx, group.dty);
+    }
+}
+
+void FluidEnsemble::addDensity(int member, int x, int y, float amount, int r, int g, int b) {
+    Group& group = groups[member / LANES];
+    const size_t idx = at(member, x + y * width);
+    float normalizedAmount = amount / 255.0f;
+    group.dye[0][idx] += normalizedAmount * r;
+    group.dye[1][idx] += normalizedAmount * g;
+    group.dye[2][idx] += normalizedAmount * b;
+}
+
+void FluidEnsemble::addVelocity(int member, int x, int y, float amountX, float amountY) {
+    Group& group = groups[member / LANES];
+    const size_t idx = at(member, x + y * width);
+    group.Vx[idx] += amountX;
+    group.Vy[idx] += amountY;
+}
+
+void FluidEnsemble::setMember(int member, const EnsembleMember& parameters) {
+    members[member] = parameters;
+    updateCoefficients(member);
+}
+
+void FluidEnsemble::updateCoefficients(int member) {
+    Group& group = groups[member / LANES];
+    const int lane = member % LANES;
+    const EnsembleMember& m = members[member];
+    group.viscA[lane] = m.dt * m.viscosity * (width - 2) * (height - 2);
+    group.viscInvC[lane] = 1.0f / (1 + 4 * group.viscA[lane]);
+    group.diffA[lane] = m.dt * m.diffusion * (width - 2) * (height - 2);
+    group.diffInvC[lane] = 1.0f / (1 + 4 * group.diffA[lane]);
+    group.dtx[lane] = m.dt * (width - 2);
+    group.dty[lane] = m.dt * (height - 2);
+}
+
+void FluidEnsemble::copyVelocity(int member, float* outX, float* outY) const {
+    const Group& group = groups[member / LANES];
+    for (int idx = 0; idx < width * height; idx++) {
+        outX[idx] = group.Vx[at(member, idx)];
+        outY[idx] = group.Vy[at(member, idx)];
+    }
+}
+
+void FluidEnsemble::copyChannel(int member, int channel, float* out) const {
+    const Group& group = groups[member / LANES];
+    for (int idx = 0; idx < width * height; idx++) out[idx] = group.dye[channel][at(member, idx)];
+}
+
+void FluidEnsemble::setThreadCount(int threads) {
+    pool = std::make_unique<ThreadPool>(threads);
+}
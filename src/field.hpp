@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include "workspace.hpp"
+
+// Persistent field storage, WORKSPACE_ALIGNMENT aligned. A buffer either
+// owns its memory or borrows it from something kept alive alongside, such
+// as the mapped pages of a checkpoint. Borrowed memory must be writable;
+// copies always own theirs.
+template <typename T>
+class FieldBuffer {
+public:
+    FieldBuffer() = default;
+    FieldBuffer(std::size_t count, T value) { assign(count, value); }
+    ~FieldBuffer() { release(); }
+
+    FieldBuffer(const FieldBuffer& other) { *this = other; }
+    FieldBuffer& operator=(const FieldBuffer& other) {
+        if (this == &other) return *this;
+        if (!owned || count != other.count) {
+            release();
+            allocate(other.count);
+        }
+        std::copy(other.begin(), other.end(), memory);
+        return *this;
+    }
+
+    FieldBuffer(FieldBuffer&& other) noexcept { swap(other); }
+    FieldBuffer& operator=(FieldBuffer&& other) noexcept {
+        FieldBuffer moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    // count copies of value in owned memory, reusing it when the size matches
+    void assign(std::size_t count, T value) {
+        if (!owned || this->count != count) {
+            release();
+            allocate(count);
+        }
+        std::fill(begin(), end(), value);
+    }
+
+    // Uses count elements at memory, which keepAlive keeps valid
+    void adopt(T* memory, std::size_t count, std::shared_ptr<void> keepAlive) {
+        release();
+        this->memory = memory;
+        this->count = count;
+        this->keepAlive = std::move(keepAlive);
+    }
+
+    T* data() { return memory; }
+    const T* data() const { return memory; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isBorrowed() const { return keepAlive != nullptr; }
+
+    T* begin() { return memory; }
+    T* end() { return memory + count; }
+    const T* begin() const { return memory; }
+    const T* end() const { return memory + count; }
+
+    T& operator[](std::size_t i) { return memory[i]; }
+    const T& operator[](std::size_t i) const { return memory[i]; }
+
+    void swap(FieldBuffer& other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(count, other.count);
+        std::swap(owned, other.owned);
+        std::swap(keepAlive, other.keepAlive);
+    }
+
+private:
+    void allocate(std::size_t count) {
+        memory = count ? AlignedAllocator<T>().allocate(count) : nullptr;
+        this->count = count;
+        owned = true;
+    }
+
+    void release() {
+        if (owned && memory) AlignedAllocator<T>().deallocate(memory, count);
+        memory = nullptr;
+        count = 0;
+        owned = false;
+        keepAlive.reset();
+    }
+
+    T* memory = nullptr;
+    std::size_t count = 0;
+    bool owned = false;
+    std::shared_ptr<void> keepAlive;
+};
+
+using Field = FieldBuffer<float>;
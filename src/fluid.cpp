@@ -1,224 +1,749 @@
 #include "fluid.hpp"
+#include "resample.hpp"
 #include <algorithm>
 #include <cmath>
+#include <iostream>
 
 FluidSimulation::FluidSimulation(int width, int height, float diffusion, float viscosity, float dt)
-    : width(width), height(height), dt(dt), diff(diffusion), visc(viscosity) {
+    : width(width), height(height), dt(dt), diff(diffusion), visc(viscosity),
+      pool(std::make_unique<ThreadPool>(ThreadPool::defaultThreadCount())),
+      kernels(&selectKernels(detectSimdLevel())),
+      pressureSolver(makeSolver(SolverType::Relaxation)),
+      diffusionSolver(makeSolver(SolverType::Relaxation)) {
     int size = width * height;
-    densityR.resize(size, 0);
-    densityG.resize(size, 0);
-    densityB.resize(size, 0);
-    Vx.resize(size, 0);
-    Vy.resize(size, 0);
-    Vx0.resize(size, 0);
-    Vy0.resize(size, 0);
+    for (int c = 0; c < 3; c++) addChannel(diffusion);
+    Vx.assign(size, 0);
+    Vy.assign(size, 0);
+    Vx0.assign(size, 0);
+    Vy0.assign(size, 0);
+    pressure.assign(size, 0);
+    workspace = std::make_shared<Workspace>();
+    reserveWorkspace();
+    activeTiles.resize(width, height);
+    obstacles.resize(width, height);
+    const size_t tiles = static_cast<size_t>(activeTiles.getTilesX()) * activeTiles.getTilesY();
+    tileMagnitude.resize(tiles);
+    tileSpeed.resize(tiles);
+    tileReach.resize(tiles);
+    tileLive.resize(tiles);
+
+    diffusionSettings.warmStart = true;
+    solveStats.reserve(4 + getChannelCount());
+    splats.reserve(256);
 }
 
 FluidSimulation::~FluidSimulation() {}
 
 void FluidSimulation::step() {
-    std::vector<float> p(width * height);
-    std::vector<float> div(width * height);
+    solveStats.clear();
+    if (obstacles.isDirty()) updateObstacles();
+    applySplats();
+    if (activityEpsilon > 0) updateActiveTiles();
 
     // Velocity step
-    diffuse(1, Vx0, Vx, visc, dt);
-    diffuse(2, Vy0, Vy, visc, dt);
-    project(Vx0, Vy0, p, div);
-    advect(1, Vx, Vx0, Vx0, Vy0, dt);
-    advect(2, Vy, Vy0, Vx0, Vy0, dt);
-    project(Vx, Vy, p, div);
-
-    // Density step for each color channel
-    std::vector<float> density0(width * height);
-    
-    // Red channel
-    diffuse(0, density0, densityR, diff, dt);
-    advect(0, densityR, density0, Vx, Vy, dt);
-    
-    // Green channel
-    diffuse(0, density0, densityG, diff, dt);
-    advect(0, densityG, density0, Vx, Vy, dt);
-    
-    // Blue channel
-    diffuse(0, density0, densityB, diff, dt);
-    advect(0, densityB, density0, Vx, Vy, dt);
+    diffuse(1, Vx0.data(), Vx.data(), visc, dt);
+    diffuse(2, Vy0.data(), Vy.data(), visc, dt);
+    project(Vx0.data(), Vy0.data(), pressure.data());
+    advect(1, Vx.data(), Vx0.data(), Vx0.data(), Vy0.data(), dt);
+    advect(2, Vy.data(), Vy0.data(), Vx0.data(), Vy0.data(), dt);
+    project(Vx.data(), Vy.data(), pressure.data());
+
+    stepDye();
+
+    if (profiler.isEnabled()) {
+        for (const SolveRecord& record : solveStats) {
+            profiler.addCount(record.kind == SolveKind::Project ? Counter::PressureIterations
+                                                                : Counter::DiffusionIterations,
+                              record.stats.iterations);
+        }
+        if (endsProfilerFrames) profiler.endFrame();
+    }
+}
+
+void FluidSimulation::stepDye() {
+    const int channels = getChannelCount();
+    if (dyeStorage == DyeStorage::Float16) {
+        stepDyeHalf();
+        return;
+    }
+    if (dyeLayout == DyeLayout::Planar) {
+        for (int c = 0; c < channels; c++) {
+            float* d = &dye[dyeIndex(c, 0)];
+            float* d0 = &dyeScratch[dyeIndex(c, 0)];
+            diffuse(0, d0, d, channelDiffusion[c], dt);
+            advect(0, d, d0, Vx.data(), Vy.data(), dt);
+        }
+        return;
+    }
+
+    GridContext g = grid();
+    {
+        Profiler::Scope scope(profiler, Phase::Diffuse);
+        for (int c = 0; c < channels; c++) {
+            float a = dt * channelDiffusion[c] * (width - 2) * (height - 2);
+            channelA[c] = a;
+            channelInvC[c] = 1.0f / (1 + 4 * a);
+        }
+        if (!diffusionSettings.warmStart) dyeScratch = dye;
+        for (int k = 0; k < diffusionSettings.maxIterations; k++) {
+            dye::relax(g, dyeScratch.data(), dye.data(), channels, dyeStride, channelA.data(), channelInvC.data());
+        }
+        SolveStats stats;
+        stats.iterations = diffusionSettings.maxIterations;
+        solveStats.push_back({SolveKind::Diffuse, stats});
+    }
+    {
+        Profiler::Scope scope(profiler, Phase::Advect);
+        const float dtx = dt * (width - 2);
+        const float dty = dt * (height - 2);
+        float* d = dye.data();
+        const float* d0 = dyeScratch.data();
+        dye::advect(g, d, d0, channels, dyeStride, Vx.data(), Vy.data(), dtx, dty);
+        if (advectionScheme == AdvectionScheme::SemiLagrangian) return;
+
+        // Padding lanes take part too; they stay zero
+        Workspace::Scope scratch(*workspace);
+        float* back = workspace->allocateFloats(dye.size());
+        dye::advect(g, back, d, channels, dyeStride, Vx.data(), Vy.data(), -dtx, -dty);
+        if (advectionScheme == AdvectionScheme::MacCormack) {
+            advection::correct(g, d, d0, back, dyeStride, Vx.data(), Vy.data(), dtx, dty);
+        } else {
+            float* source = workspace->allocateFloats(dye.size());
+            advection::compensate(g, source, d0, back, dyeStride);
+            dye::setBnd(g, source, channels, dyeStride);
+            dye::advect(g, d, source, channels, dyeStride, Vx.data(), Vy.data(), dtx, dty);
+            advection::limit(g, d, d0, dyeStride, Vx.data(), Vy.data(), dtx, dty);
+        }
+        dye::setBnd(g, d, channels, dyeStride);
+    }
+}
+
+// Each channel is widened into workspace scratch, stepped in float and
+// narrowed back. Diffusion starts from the undiffused field since there is
+// no persistent float copy to warm start from.
+void FluidSimulation::stepDyeHalf() {
+    const size_t cells = static_cast<size_t>(width) * height;
+    Workspace::Scope scratch(*workspace);
+    float* plane = workspace->allocateFloats(cells);
+    float* diffused = workspace->allocateFloats(cells);
+    for (int c = 0; c < getChannelCount(); c++) {
+        Half* stored = &dyeHalf[dyeIndex(c, 0)];
+        kernels->halfToFloatRow(plane, stored, static_cast<int>(cells));
+        std::copy(plane, plane + cells, diffused);
+        diffuse(0, diffused, plane, channelDiffusion[c], dt);
+        advect(0, plane, diffused, Vx.data(), Vy.data(), dt);
+        kernels->floatToHalfRow(stored, plane, static_cast<int>(cells));
+    }
 }
 
 void FluidSimulation::addDensity(int x, int y, float amount, int r, int g, int b) {
-    int idx = IX(x, y);
+    int idx = inputIndex(x, y);
+    if (idx < 0) return;
     float normalizedAmount = amount / 255.0f;
-    densityR[idx] += normalizedAmount * r;
-    densityG[idx] += normalizedAmount * g;
-    densityB[idx] += normalizedAmount * b;
+    addDye(0, idx, normalizedAmount * r);
+    addDye(1, idx, normalizedAmount * g);
+    addDye(2, idx, normalizedAmount * b);
+}
+
+void FluidSimulation::addToChannel(int channel, int x, int y, float amount) {
+    int idx = inputIndex(x, y);
+    if (idx >= 0) addDye(channel, idx, amount);
+}
+
+void FluidSimulation::addDye(int channel, int idx, float amount) {
+    touch(idx);
+    size_t at = dyeIndex(channel, idx);
+    if (dyeStorage == DyeStorage::Float16) {
+        dyeHalf[at] = floatToHalf(halfToFloat(dyeHalf[at]) + amount);
+    } else {
+        dye[at] += amount;
+    }
+}
+
+float FluidSimulation::dyeValue(int channel, int idx) const {
+    size_t at = dyeIndex(channel, idx);
+    return dyeStorage == DyeStorage::Float16 ? halfToFloat(dyeHalf[at]) : dye[at];
+}
+
+int FluidSimulation::addChannel(float diffusion) {
+    int channel = getChannelCount();
+    resizeDye(dyeLayout, dyeStorage, channel + 1);
+    channelDiffusion.push_back(diffusion);
+    solveStats.reserve(4 + getChannelCount());
+    return channel;
+}
+
+ChannelView FluidSimulation::getChannel(int channel) const {
+    if (dyeStorage == DyeStorage::Float16) return ChannelView{nullptr, 1, &dyeHalf[dyeIndex(channel, 0)]};
+    return ChannelView{&dye[dyeIndex(channel, 0)], dyeStride};
+}
+
+void FluidSimulation::setDyeLayout(DyeLayout layout) {
+    if (layout == dyeLayout) return;
+    resizeDye(layout, layout == DyeLayout::Planar ? dyeStorage : DyeStorage::Float32, getChannelCount());
+}
+
+void FluidSimulation::setDyeStorage(DyeStorage storage) {
+    if (storage == dyeStorage) return;
+    resizeDye(storage == DyeStorage::Float16 ? DyeLayout::Planar : dyeLayout, storage, getChannelCount());
+}
+
+size_t FluidSimulation::dyeIndex(int channel, int idx) const {
+    if (dyeLayout == DyeLayout::Planar) return static_cast<size_t>(channel) * width * height + idx;
+    return static_cast<size_t>(idx) * dyeStride + channel;
+}
+
+// Repacks the dye into the given layout, storage and channel count, keeping
+// the values of channels that exist in both
+void FluidSimulation::resizeDye(DyeLayout layout, DyeStorage storage, int channels) {
+    const int cells = width * height;
+    int stride = 1;
+    if (layout == DyeLayout::Interleaved) stride = channels;
+    if (layout == DyeLayout::InterleavedPadded) stride = (channels + 3) / 4 * 4;
+    const size_t cellFloats = layout == DyeLayout::Planar ? channels : stride;
+
+    const bool half = storage == DyeStorage::Float16;
+
+    Field packed(half ? 0 : cellFloats * cells, 0.0f);
+    FieldBuffer<Half> packedHalf(half ? cellFloats * cells : 0, Half(0));
+    const int kept = std::min(channels, getChannelCount());
+    for (int c = 0; c < kept; c++) {
+        for (int idx = 0; idx < cells; idx++) {
+            size_t to = layout == DyeLayout::Planar ? static_cast<size_t>(c) * cells + idx
+                                                    : static_cast<size_t>(idx) * stride + c;
+            float value = dyeValue(c, idx);
+            if (half) {
+                packedHalf[to] = floatToHalf(value);
+            } else {
+                packed[to] = value;
+            }
+        }
+    }
+
+    // Moving in fresh buffers releases the old storage
+    dyeScratch = Field(packed.size(), 0.0f);
+    dye = std::move(packed);
+    dyeHalf = std::move(packedHalf);
+    channelA.resize(channels);
+    channelInvC.resize(channels);
+    dyeLayout = layout;
+    dyeStorage = storage;
+    dyeStride = stride;
 }
 
 void FluidSimulation::addVelocity(int x, int y, float amountX, float amountY) {
-    int index = IX(x, y);
+    int index = inputIndex(x, y);
+    if (index < 0) return;
+    touch(index);
     Vx[index] += amountX;
     Vy[index] += amountY;
 }
 
 void FluidSimulation::createExplosion(int x, int y, float power, int r, int g, int b) {
-    const float radius = 20.0f;  // Smaller, more concentrated radius
-    const float densityAmount = power * 10.0f;  // More concentrated density
-    const float velocityMultiplier = 50.0f;  // Much stronger outward force
-    
-    // Add density and velocity in a circular pattern
-    for (int i = -radius; i <= radius; i++) {
-        for (int j = -radius; j <= radius; j++) {
-            float dist = std::sqrt(i * i + j * j);
-            if (dist <= radius) {
-                int cx = x + i;
-                int cy = y + j;
-                
-                // Ensure we're within bounds
-                if (cx >= 0 && cx < width && cy >= 0 && cy < height) {
-                    // Calculate falloff based on distance from center
-                    float falloff = (radius - dist) / radius;
-                    falloff = falloff * falloff * falloff;  // Cubic falloff for sharper pressure point
-                    
-                    // Add density with color
-                    addDensity(cx, cy, densityAmount * falloff, r, g, b);
-                    
-                    if (dist > 0.1f) {  // Avoid division by zero
-                        // Add outward velocity with stronger force
-                        float velX = (i / dist) * power * falloff * velocityMultiplier;
-                        float velY = (j / dist) * power * falloff * velocityMultiplier;
-                        addVelocity(cx, cy, velX, velY);
-                    }
-                }
-            }
+    applySplat(Splat::explosion(static_cast<float>(x), static_cast<float>(y), power, r, g, b));
+}
+
+void FluidSimulation::applySplats() {
+    if (splats.empty()) return;
+    Profiler::Scope scope(profiler, Phase::Splat);
+    for (const Splat& splat : splats) applySplat(splat);
+    splats.clear();
+}
+
+void FluidSimulation::applySplat(const Splat& splat) {
+    const float normalizedAmount = splat.amount / 255.0f;
+    const float color[3] = {normalizedAmount * splat.r, normalizedAmount * splat.g, normalizedAmount * splat.b};
+    const SplatKernel& kernel = splatKernels.get(splat.falloff, splat.radius);
+    if (!splat.stroke) {
+        stamp(kernel, static_cast<int>(std::lround(splat.x)), static_cast<int>(std::lround(splat.y)), splat, color);
+        return;
+    }
+    const float dx = splat.endX - splat.x;
+    const float dy = splat.endY - splat.y;
+    const float spacing = std::max(1.0f, 0.5f * splat.radius);
+    const int stamps = std::max(1, static_cast<int>(std::ceil(std::max(std::fabs(dx), std::fabs(dy)) / spacing)));
+    for (int s = 1; s <= stamps; s++) {
+        const float t = static_cast<float>(s) / stamps;
+        stamp(kernel, static_cast<int>(std::lround(splat.x + dx * t)), static_cast<int>(std::lround(splat.y + dy * t)),
+              splat, color);
+    }
+}
+
+// Adds the kernel centred on global cell (cx, cy), clipped to the grid, row
+// by row; rows another slab owns are skipped, and with barriers only the
+// fluid spans of each row are stamped
+void FluidSimulation::stamp(const SplatKernel& kernel, int cx, int cy, const Splat& splat, const float* color) {
+    const int extent = kernel.extent;
+    const int x0 = std::max(cx - extent, 0);
+    const int x1 = std::min(cx + extent, width - 1);
+    const int y0 = std::max(cy - extent, 0);
+    const int y1 = std::min(cy + extent, globalHeight() - 1);
+    if (x0 > x1) return;
+
+    for (int y = y0; y <= y1; y++) {
+        // Column 0 is a wall, never solid, so this only fails for foreign rows
+        const int rowStart = inputIndex(0, y);
+        if (rowStart < 0) continue;
+        if (obstacles.empty()) {
+            stampRow(kernel, cx, cy, y, rowStart, x0, x1 + 1, splat, color);
+            continue;
+        }
+        for (const ObstacleMask::Span& span : obstacles.fluidSpans(y)) {
+            const int begin = std::max(x0, span.begin);
+            const int end = std::min(x1 + 1, span.end);
+            if (begin < end) stampRow(kernel, cx, cy, y, rowStart, begin, end, splat, color);
         }
     }
 }
 
-void FluidSimulation::diffuse(int b, std::vector<float>& x, std::vector<float>& x0, float diff, float dt) {
-    float a = dt * diff * (width - 2) * (height - 2);
-    for (int k = 0; k < 20; k++) {
-        for (int i = 1; i < width - 1; i++) {
-            for (int j = 1; j < height - 1; j++) {
-                x[IX(i, j)] = (x0[IX(i, j)] + a * (
-                    x[IX(i+1, j)] + x[IX(i-1, j)] +
-                    x[IX(i, j+1)] + x[IX(i, j-1)]
-                )) / (1 + 4 * a);
+// Columns [begin, end) of the kernel's row over global row y
+void FluidSimulation::stampRow(const SplatKernel& kernel, int cx, int cy, int y, int rowStart, int begin, int end,
+                               const Splat& splat, const float* color) {
+    const int extent = kernel.extent;
+    const int side = 2 * extent + 1;
+    const int count = end - begin;
+    const bool half = dyeStorage == DyeStorage::Float16;
+    const size_t stride = dyeStride;
+    const int row = rowStart + begin;
+    const size_t k = static_cast<size_t>(y - cy + extent) * side + (begin - cx + extent);
+    const float* weight = &kernel.weight[k];
+    const float* outwardX = &kernel.outwardX[k];
+    const float* outwardY = &kernel.outwardY[k];
+
+    float* vx = &Vx[row];
+    float* vy = &Vy[row];
+    for (int i = 0; i < count; i++) {
+        vx[i] += weight[i] * splat.velocityX + outwardX[i] * splat.push;
+        vy[i] += weight[i] * splat.velocityY + outwardY[i] * splat.push;
+    }
+    for (int c = 0; c < 3; c++) {
+        if (half) {
+            for (int i = 0; i < count; i++) {
+                if (weight[i] != 0) addDye(c, row + i, weight[i] * color[c]);
             }
+            continue;
+        }
+        float* d = &dye[dyeIndex(c, row)];
+        for (int i = 0; i < count; i++) d[i * stride] += weight[i] * color[c];
+    }
+    if (activityEpsilon > 0) {
+        for (int i = 0; i < count; i++) {
+            if (weight[i] != 0) touch(row + i);
         }
-        setBnd(b, x);
     }
 }
 
-void FluidSimulation::project(std::vector<float>& velocX, std::vector<float>& velocY, std::vector<float>& p, std::vector<float>& div) {
-    for (int i = 1; i < width - 1; i++) {
-        for (int j = 1; j < height - 1; j++) {
-            div[IX(i, j)] = -0.5f * (
-                velocX[IX(i+1, j)] - velocX[IX(i-1, j)] +
-                velocY[IX(i, j+1)] - velocY[IX(i, j-1)]
-            ) / width;
-            p[IX(i, j)] = 0;
+void FluidSimulation::setThreadCount(int threads) {
+    pool = std::make_unique<ThreadPool>(threads);
+}
+
+void FluidSimulation::setSimdLevel(SimdLevel level) {
+    kernels = &selectKernels(level);
+}
+
+void FluidSimulation::setPressureSolver(SolverType type, const SolverSettings& settings) {
+    if (pressureSolver->type() != type) pressureSolver = makeSolver(type);
+    pressureSettings = settings;
+}
+
+void FluidSimulation::setDiffusionSolver(SolverType type, const SolverSettings& settings) {
+    if (diffusionSolver->type() != type) diffusionSolver = makeSolver(type);
+    diffusionSettings = settings;
+}
+
+GridContext FluidSimulation::grid() {
+    return GridContext{width, height, pool.get(), kernels, &profiler, relaxation, workspace.get(), temporalDepth,
+                       getActiveTiles(), halo.get(), obstacles.empty() ? nullptr : &obstacles};
+}
+
+int FluidSimulation::autotuneTemporalDepth() {
+    temporalDepth = ::autotuneTemporalDepth(grid(), std::max(pressureSettings.maxIterations,
+                                                              diffusionSettings.maxIterations));
+    return temporalDepth;
+}
+
+void FluidSimulation::setWorkspace(std::shared_ptr<Workspace> workspace) {
+    this->workspace = std::move(workspace);
+    reserveWorkspace();
+}
+
+// Worst case over the solvers: the divergence plus conjugate gradient's
+// four vectors and mean-free rhs (multigrid needs about three fields)
+void FluidSimulation::reserveWorkspace() {
+    const size_t fieldBytes = static_cast<size_t>(width) * height * sizeof(float) + WORKSPACE_ALIGNMENT;
+    workspace->reserve(6 * fieldBytes);
+}
+
+void FluidSimulation::diffuse(int b, float* x, const float* x0, float diff, float dt) {
+    Profiler::Scope scope(profiler, Phase::Diffuse);
+    float a = dt * diff * (width - 2) * (globalHeight() - 2);
+    if (!diffusionSettings.warmStart) std::copy(x0, x0 + width * height, x);
+    SolveStats stats = diffusionSolver->solve(grid(), b, x, x0, a, 1 + 4 * a, diffusionSettings);
+    solveStats.push_back({SolveKind::Diffuse, stats});
+}
+
+void FluidSimulation::project(float* velocX, float* velocY, float* p) {
+    Profiler::Scope scope(profiler, Phase::Project);
+    // Pressure couples the whole domain, so projection ignores the active tiles
+    GridContext g = grid();
+    g.activeTiles = nullptr;
+    Workspace::Scope scratch(*workspace);
+    float* div = workspace->allocateFloats(static_cast<size_t>(width) * height);
+    const bool clearPressure = !pressureSettings.warmStart;
+    const float divScale = -0.5f / width;
+    g.forRows([&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            g.forSpans(j, [&](int begin, int end) {
+                int row = IX(begin, j);
+                kernels->divergenceRow(&div[row], &velocX[row], &velocY[row - width], &velocY[row + width],
+                                       end - begin, divScale);
+                if (clearPressure) std::fill(&p[row], &p[row] + (end - begin), 0.0f);
+            });
+        }
+    });
+    g.setBnd(0, div);
+    g.setBnd(0, p);
+
+    SolveStats stats = pressureSolver->solve(g, 0, p, div, 1, 4, pressureSettings);
+    solveStats.push_back({SolveKind::Project, stats});
+
+    const float gradScale = 0.5f * width;
+    g.forRows([&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            g.forSpans(j, [&](int begin, int end) {
+                int row = IX(begin, j);
+                kernels->gradientRow(&velocX[row], &velocY[row], &p[row], &p[row - width], &p[row + width],
+                                     end - begin, gradScale);
+            });
         }
+    });
+    g.setBnd(1, velocX);
+    g.setBnd(2, velocY);
+}
+
+void FluidSimulation::advect(int b, float* d, const float* d0, const float* velocX, const float* velocY, float dt) {
+    Profiler::Scope scope(profiler, Phase::Advect);
+    GridContext g = grid();
+    const int fullHeight = globalHeight();
+    const int rowOffset = g.rowOffset();
+    float dtx = dt * (width - 2);
+    float dty = dt * (fullHeight - 2);
+    Workspace::Scope scratch(*workspace);
+    if (halo) d0 = gatherBacktrace(d0, velocY, dty);
+
+    // One semi-Lagrangian pass from src into out, backwards in time when
+    // the steps are negated
+    auto pass = [&](float* out, const float* src, float stepX, float stepY) {
+        g.forRows([&](int rowBegin, int rowEnd) {
+            for (int j = rowBegin; j < rowEnd; j++) {
+                g.forSpans(j, [&](int begin, int end) {
+                    int row = IX(begin, j);
+                    kernels->advectRow(&out[row], src, &velocX[row], &velocY[row], begin, j + rowOffset,
+                                       end - begin, width, fullHeight, stepX, stepY);
+                });
+            }
+        });
+        g.setBnd(b, out);
+    };
+
+    pass(d, d0, dtx, dty);
+    if (advectionScheme == AdvectionScheme::SemiLagrangian || halo) return;
+
+    const size_t cells = static_cast<size_t>(width) * height;
+    float* back = workspace->allocateFloats(cells);
+    pass(back, d, -dtx, -dty);
+    if (advectionScheme == AdvectionScheme::MacCormack) {
+        advection::correct(g, d, d0, back, 1, velocX, velocY, dtx, dty);
+    } else {
+        float* source = workspace->allocateFloats(cells);
+        advection::compensate(g, source, d0, back, 1);
+        g.setBnd(b, source);
+        pass(d, source, dtx, dty);
+        advection::limit(g, d, d0, 1, velocX, velocY, dtx, dty);
     }
-    setBnd(0, div);
-    setBnd(0, p);
+    g.setBnd(b, d);
+}
 
-    for (int k = 0; k < 20; k++) {
+// Fetches every row of the decomposed d0 the slab's backtraces can sample
+// into workspace scratch. The result is addressed like the global field, so
+// advectRow can index it with global coordinates; only the fetched rows
+// are read. One row of margin on each side absorbs rounding differences
+// between this bound and the kernels.
+const float* FluidSimulation::gatherBacktrace(const float* d0, const float* velocY, float dty) {
+    Profiler::Scope scope(profiler, Phase::Halo);
+    const Slab& slab = halo->slab();
+    float minV = 0;
+    float maxV = 0;
+    for (int j = 1; j < height - 1; j++) {
         for (int i = 1; i < width - 1; i++) {
-            for (int j = 1; j < height - 1; j++) {
-                p[IX(i, j)] = (div[IX(i, j)] + (
-                    p[IX(i+1, j)] + p[IX(i-1, j)] +
-                    p[IX(i, j+1)] + p[IX(i, j-1)]
-                )) / 4;
-            }
+            minV = std::min(minV, velocY[IX(i, j)]);
+            maxV = std::max(maxV, velocY[IX(i, j)]);
         }
-        setBnd(0, p);
     }
+    const int fullHeight = slab.globalHeight;
+    auto clampY = [&](float y) { return std::fmin(std::fmax(y, 0.5f), fullHeight - 1.5f); };
+    const int first = std::max(0, static_cast<int>(std::floor(clampY(slab.rowBegin - dty * maxV))) - 1);
+    const int last = std::min(fullHeight - 1, static_cast<int>(std::floor(clampY(slab.rowEnd - 1 - dty * minV))) + 2);
 
-    for (int i = 1; i < width - 1; i++) {
-        for (int j = 1; j < height - 1; j++) {
-            velocX[IX(i, j)] -= 0.5f * (p[IX(i+1, j)] - p[IX(i-1, j)]) * width;
-            velocY[IX(i, j)] -= 0.5f * (p[IX(i, j+1)] - p[IX(i, j-1)]) * width;
-        }
+    float* rows = workspace->allocateFloats(static_cast<size_t>(last - first + 1) * width);
+    halo->gatherRows(d0, first, last, rows);
+    return rows - static_cast<std::ptrdiff_t>(first) * width;
+}
+
+int FluidSimulation::inputIndex(int x, int y) const {
+    // Barriers take no input; whatever landed inside one would stay there
+    if (!halo) return obstacles.isSolid(x, y) ? -1 : IX(x, y);
+    const Slab& slab = halo->slab();
+    const int local = y - slab.rowOffset();
+    // Ghost rows belong to the neighbouring slab unless they are a wall
+    const bool owned = (local >= 1 && local < height - 1) || (local == 0 && slab.isFirst()) ||
+                       (local == height - 1 && slab.isLast());
+    return owned ? IX(x, local) : -1;
+}
+
+bool FluidSimulation::setHalo(std::shared_ptr<Halo> halo) {
+    if (halo && (halo->slab().width != width || halo->slab().localHeight() != height)) {
+        std::cerr << "Slab is " << halo->slab().width << "x" << halo->slab().localHeight()
+                  << " but the simulation is " << width << "x" << height << std::endl;
+        return false;
     }
-    setBnd(1, velocX);
-    setBnd(2, velocY);
+    this->halo = std::move(halo);
+    if (!this->halo) return true;
+    relaxation = Relaxation::RedBlack;
+    advectionScheme = AdvectionScheme::SemiLagrangian;
+    temporalDepth = 1;
+    setPressureSolver(SolverType::Relaxation, pressureSettings);
+    setDiffusionSolver(SolverType::Relaxation, diffusionSettings);
+    if (dyeLayout != DyeLayout::Planar) setDyeLayout(DyeLayout::Planar);
+    setActivityEpsilon(0);
+    obstacles.clear();
+    return true;
 }
 
-void FluidSimulation::advect(int b, std::vector<float>& d, std::vector<float>& d0, std::vector<float>& velocX, std::vector<float>& velocY, float dt) {
-    float i0, i1, j0, j1;
-    float dtx = dt * (width - 2);
-    float dty = dt * (height - 2);
-    float s0, s1, t0, t1;
-    float tmp1, tmp2, x, y;
+void FluidSimulation::setSolid(int x, int y, bool solid) {
+    if (!halo) obstacles.setSolid(x, y, solid);
+}
 
-    for (int i = 1; i < width - 1; i++) {
-        for (int j = 1; j < height - 1; j++) {
-            tmp1 = dtx * velocX[IX(i, j)];
-            tmp2 = dty * velocY[IX(i, j)];
-            x = i - tmp1;
-            y = j - tmp2;
+void FluidSimulation::fillObstacleCircle(int x, int y, float radius, bool solid) {
+    if (!halo) obstacles.fillCircle(x, y, radius, solid);
+}
+
+void FluidSimulation::clearObstacles() {
+    obstacles.clear();
+}
+
+void FluidSimulation::updateObstacles() {
+    obstacles.update();
+    if (obstacles.empty()) return;
+    setPressureSolver(SolverType::Relaxation, pressureSettings);
+    setDiffusionSolver(SolverType::Relaxation, diffusionSettings);
+    clearSolidCells();
+}
+
+// Zeroes every field on the solid cells, so backtraces that end inside a
+// barrier find nothing there
+void FluidSimulation::clearSolidCells() {
+    const int channels = getChannelCount();
+    obstacles.forEachSolid([&](int idx) {
+        Vx[idx] = Vy[idx] = Vx0[idx] = Vy0[idx] = pressure[idx] = 0;
+        for (int c = 0; c < channels; c++) {
+            size_t at = dyeIndex(c, idx);
+            if (dyeStorage == DyeStorage::Float16) {
+                dyeHalf[at] = Half(0);
+            } else {
+                dye[at] = dyeScratch[at] = 0;
+            }
+        }
+    });
+}
+
+// Sizes the activity tracking to the grid, every tile active
+void FluidSimulation::resizeTiles() {
+    activeTiles.resize(width, height);
+    const size_t tiles = static_cast<size_t>(activeTiles.getTilesX()) * activeTiles.getTilesY();
+    tileMagnitude.resize(tiles);
+    tileSpeed.resize(tiles);
+    tileReach.resize(tiles);
+    tileLive.assign(tiles, 1);
+}
 
-            if (x < 0.5f) x = 0.5f;
-            if (x > width - 1.5f) x = width - 1.5f;
-            i0 = std::floor(x);
-            i1 = i0 + 1.0f;
+void FluidSimulation::setActivityEpsilon(float epsilon) {
+    activityEpsilon = std::max(0.0f, epsilon);
+    // Tiles are only known to be quiet once an update has measured them
+    activeTiles.setAll(true);
+    std::fill(tileLive.begin(), tileLive.end(), 1);
+}
 
-            if (y < 0.5f) y = 0.5f;
-            if (y > height - 1.5f) y = height - 1.5f;
-            j0 = std::floor(y);
-            j1 = j0 + 1.0f;
+void FluidSimulation::touch(int idx) {
+    if (activityEpsilon > 0) activeTiles.activateCell(idx % width, idx / width);
+}
 
-            s1 = x - i0;
-            s0 = 1.0f - s1;
-            t1 = y - j0;
-            t0 = 1.0f - t1;
+// Measures every tile, clears the ones that went quiet and grows each
+// remaining one by the farthest its flow can carry anything this step
+void FluidSimulation::updateActiveTiles() {
+    Profiler::Scope scope(profiler, Phase::Activity);
+    const int tile = ActiveTiles::TILE_SIZE;
+    const int tilesX = activeTiles.getTilesX();
+    const int tilesY = activeTiles.getTilesY();
+    const int channels = getChannelCount();
+    const float cellsPerSpeed = dt * (std::max(width, height) - 2);
 
-            int i0i = static_cast<int>(i0);
-            int i1i = static_cast<int>(i1);
-            int j0i = static_cast<int>(j0);
-            int j1i = static_cast<int>(j1);
+    auto maxAbs = [](float m, const float* p, size_t stride, int count) {
+        if (stride == 1) {
+            for (int k = 0; k < count; k++) m = std::max(m, std::fabs(p[k]));
+        } else {
+            for (int k = 0; k < count; k++) m = std::max(m, std::fabs(p[k * stride]));
+        }
+        return m;
+    };
+    // Whole rows are streamed, each tile taking the maximum of its columns
+    pool->parallelFor(0, tilesY, [&](int tileRowBegin, int tileRowEnd) {
+        for (int ty = tileRowBegin; ty < tileRowEnd; ty++) {
+            float* speed = &tileSpeed[ty * tilesX];
+            float* magnitude = &tileMagnitude[ty * tilesX];
+            std::fill_n(speed, tilesX, 0.0f);
+            std::fill_n(magnitude, tilesX, 0.0f);
+            for (int y = ty * tile; y < std::min(height, (ty + 1) * tile); y++) {
+                for (int tx = 0; tx < tilesX; tx++) {
+                    const int x0 = tx * tile;
+                    const int count = std::min(width, x0 + tile) - x0;
+                    const int idx = IX(x0, y);
+                    speed[tx] = maxAbs(maxAbs(speed[tx], &Vx[idx], 1, count), &Vy[idx], 1, count);
+                    for (int c = 0; c < channels; c++) {
+                        if (dyeStorage == DyeStorage::Float16) {
+                            const Half* h = &dyeHalf[dyeIndex(c, idx)];
+                            for (int k = 0; k < count; k++) magnitude[tx] = std::max(magnitude[tx], std::fabs(halfToFloat(h[k])));
+                        } else {
+                            magnitude[tx] = maxAbs(magnitude[tx], &dye[dyeIndex(c, idx)], dyeStride, count);
+                        }
+                    }
+                }
+            }
+            for (int tx = 0; tx < tilesX; tx++) magnitude[tx] = std::max(magnitude[tx], speed[tx]);
+        }
+    });
 
-            d[IX(i, j)] =
-                s0 * (t0 * d0[IX(i0i, j0i)] + t1 * d0[IX(i0i, j1i)]) +
-                s1 * (t0 * d0[IX(i1i, j0i)] + t1 * d0[IX(i1i, j1i)]);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            const int t = tx + ty * tilesX;
+            // Tiles only woken by a neighbour's margin never rose above
+            // epsilon, so what they hold is left to decay in place
+            bool live = tileMagnitude[t] > activityEpsilon;
+            if (!live && tileLive[t]) clearTile(tx, ty);
+            tileLive[t] = live;
+            activeTiles.setActive(tx, ty, live);
+            float reach = tileSpeed[t] * cellsPerSpeed;
+            tileReach[t] = live ? 1 + static_cast<int>(std::ceil(reach / tile)) : 0;
         }
     }
-    setBnd(b, d);
+    activeTiles.dilate(tileReach.data());
 }
 
-void FluidSimulation::setBnd(int b, std::vector<float>& x) {
-    for (int i = 1; i < width - 1; i++) {
-        x[IX(i, 0)] = b == 2 ? -x[IX(i, 1)] : x[IX(i, 1)];
-        x[IX(i, height-1)] = b == 2 ? -x[IX(i, height-2)] : x[IX(i, height-2)];
-    }
-    for (int j = 1; j < height - 1; j++) {
-        x[IX(0, j)] = b == 1 ? -x[IX(1, j)] : x[IX(1, j)];
-        x[IX(width-1, j)] = b == 1 ? -x[IX(width-2, j)] : x[IX(width-2, j)];
+void FluidSimulation::clearTile(int tx, int ty) {
+    const int tile = ActiveTiles::TILE_SIZE;
+    const int x0 = tx * tile;
+    const int count = std::min(width, x0 + tile) - x0;
+    const int channels = getChannelCount();
+    for (int y = ty * tile; y < std::min(height, (ty + 1) * tile); y++) {
+        const int idx = IX(x0, y);
+        for (Field* field : {&Vx, &Vy, &Vx0, &Vy0}) {
+            std::fill_n(field->begin() + idx, count, 0.0f);
+        }
+        if (dyeStorage == DyeStorage::Float16) {
+            for (int c = 0; c < channels; c++) std::fill_n(dyeHalf.begin() + dyeIndex(c, idx), count, Half(0));
+        } else if (dyeLayout == DyeLayout::Planar) {
+            for (int c = 0; c < channels; c++) {
+                std::fill_n(dye.begin() + dyeIndex(c, idx), count, 0.0f);
+                std::fill_n(dyeScratch.begin() + dyeIndex(c, idx), count, 0.0f);
+            }
+        } else {
+            std::fill_n(dye.begin() + dyeIndex(0, idx), count * dyeStride, 0.0f);
+            std::fill_n(dyeScratch.begin() + dyeIndex(0, idx), count * dyeStride, 0.0f);
+        }
     }
-
-    x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
-    x[IX(0, height-1)] = 0.5f * (x[IX(1, height-1)] + x[IX(0, height-2)]);
-    x[IX(width-1, 0)] = 0.5f * (x[IX(width-2, 0)] + x[IX(width-1, 1)]);
-    x[IX(width-1, height-1)] = 0.5f * (x[IX(width-2, height-1)] + x[IX(width-1, height-2)]);
 }
 
 void FluidSimulation::reset() {
-    std::fill(densityR.begin(), densityR.end(), 0.0f);
-    std::fill(densityG.begin(), densityG.end(), 0.0f);
-    std::fill(densityB.begin(), densityB.end(), 0.0f);
+    std::fill(dye.begin(), dye.end(), 0.0f);
+    std::fill(dyeScratch.begin(), dyeScratch.end(), 0.0f);
+    std::fill(dyeHalf.begin(), dyeHalf.end(), Half(0));
     std::fill(Vx.begin(), Vx.end(), 0.0f);
     std::fill(Vy.begin(), Vy.end(), 0.0f);
     std::fill(Vx0.begin(), Vx0.end(), 0.0f);
     std::fill(Vy0.begin(), Vy0.end(), 0.0f);
+    std::fill(pressure.begin(), pressure.end(), 0.0f);
+    splats.clear();
 }
 
-void FluidSimulation::render(SDL_Renderer* renderer) {
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            int idx = IX(i, j);
-            int r = static_cast<int>(std::min(255.0f, std::max(0.0f, densityR[idx] * 255)));
-            int g = static_cast<int>(std::min(255.0f, std::max(0.0f, densityG[idx] * 255)));
-            int b = static_cast<int>(std::min(255.0f, std::max(0.0f, densityB[idx] * 255)));
-            SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-            SDL_RenderDrawPoint(renderer, i, j);
+bool FluidSimulation::resize(int newWidth, int newHeight) {
+    if (halo) {
+        std::cerr << "A decomposed simulation cannot be resized" << std::endl;
+        return false;
+    }
+    if (newWidth < 3 || newHeight < 3) {
+        std::cerr << "Invalid grid size " << newWidth << "x" << newHeight << std::endl;
+        return false;
+    }
+    if (newWidth == width && newHeight == height) return true;
+
+    // Channel views stay valid once the buffers are moved out
+    const int channels = getChannelCount();
+    std::vector<ChannelView> oldChannels;
+    for (int c = 0; c < channels; c++) oldChannels.push_back(getChannel(c));
+    Field oldFields[5] = {std::move(Vx), std::move(Vy), std::move(Vx0), std::move(Vy0), std::move(pressure)};
+    Field oldDye = std::move(dye);
+    FieldBuffer<Half> oldDyeHalf = std::move(dyeHalf);
+    const ObstacleMask oldObstacles = obstacles;
+    const int oldWidth = width;
+    const int oldHeight = height;
+
+    width = newWidth;
+    height = newHeight;
+    const size_t cells = static_cast<size_t>(width) * height;
+    AreaResampler resampler(oldWidth, oldHeight, width, height);
+
+    // Barriers first, so setBnd below already sees them
+    obstacles.resize(width, height);
+    if (!oldObstacles.empty()) {
+        for (int j = 1; j < height - 1; j++) {
+            const int oldJ = 1 + static_cast<int>((j - 0.5f) * (oldHeight - 2) / (height - 2));
+            for (int i = 1; i < width - 1; i++) {
+                const int oldI = 1 + static_cast<int>((i - 0.5f) * (oldWidth - 2) / (width - 2));
+                if (oldObstacles.isSolid(oldI, oldJ)) obstacles.setSolid(i, j, true);
+            }
+        }
+        obstacles.update();
+    }
+    GridContext g = grid();
+
+    Field* fields[5] = {&Vx, &Vy, &Vx0, &Vy0, &pressure};
+    const int boundaries[5] = {1, 2, 1, 2, 0};
+    for (int f = 0; f < 5; f++) {
+        fields[f]->assign(cells, 0.0f);
+        resampler.resample(ChannelView{oldFields[f].data(), 1}, fields[f]->data());
+        g.setBnd(boundaries[f], fields[f]->data());
+    }
+
+    // Each channel goes through a planar float copy into the unchanged layout
+    const bool half = dyeStorage == DyeStorage::Float16;
+    const size_t cellFloats = dyeLayout == DyeLayout::Planar ? channels : dyeStride;
+    dye = Field(half ? 0 : cellFloats * cells, 0.0f);
+    dyeHalf = FieldBuffer<Half>(half ? cellFloats * cells : 0, Half(0));
+    Field plane(cells, 0.0f);
+    for (int c = 0; c < channels; c++) {
+        resampler.resample(oldChannels[c], plane.data());
+        g.setBnd(0, plane.data());
+        if (half) {
+            kernels->floatToHalfRow(&dyeHalf[dyeIndex(c, 0)], plane.data(), static_cast<int>(cells));
+            continue;
         }
+        for (size_t idx = 0; idx < cells; idx++) dye[dyeIndex(c, static_cast<int>(idx))] = plane[idx];
     }
+    // Diffusion warm starts from the resampled dye
+    dyeScratch = dye;
+
+    resizeTiles();
+    if (!obstacles.empty()) clearSolidCells();
+    reserveWorkspace();
+    return true;
 }
@@ -1,6 +1,31 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
-#include <SDL2/SDL.h>
+#include "active_tiles.hpp"
+#include "advection.hpp"
+#include "dye.hpp"
+#include "field.hpp"
+#include "grid.hpp"
+#include "kernels.hpp"
+#include "linear_solver.hpp"
+#include "obstacles.hpp"
+#include "profiler.hpp"
+#include "splat.hpp"
+#include "thread_pool.hpp"
+
+// Which solver slot a linear solve went through
+enum class SolveKind {
+    Diffuse,  // viscosity and dye diffusion
+    Project   // pressure
+};
+
+struct SolveRecord {
+    SolveKind kind;
+    SolveStats stats;
+};
 
 class FluidSimulation {
 public:
@@ -11,9 +36,146 @@ public:
     void addDensity(int x, int y, float amount, int r, int g, int b);
     void addVelocity(int x, int y, float amountX, float amountY);
     void createExplosion(int x, int y, float power, int r, int g, int b);
-    void render(SDL_Renderer* renderer);
+    // Queues a splat for the start of the next step(), which stamps all
+    // queued splats in one pass through cached footprint tables (see
+    // splat.hpp). reset() drops the queue.
+    void queueSplat(const Splat& splat) { splats.push_back(splat); }
+    int getQueuedSplatCount() const { return static_cast<int>(splats.size()); }
     void reset();  // Reset simulation to initial state
 
+    // Resamples every field onto a newWidth x newHeight grid, conserving
+    // each field's integral over the domain (see resample.hpp): dye mass and
+    // momentum are kept, and velocities, being in domain units, keep their
+    // meaning. Barriers are resampled by cell centre, dropping whatever
+    // lands on solid cells, and activity tracking starts over. Not
+    // supported on a decomposed grid; errors go to std::cerr and return
+    // false.
+    bool resize(int newWidth, int newHeight);
+
+    // Snapshot of every field, the barriers, the dye format and dt,
+    // diffusion and viscosity (see checkpoint.hpp). Loading maps the file
+    // and adopts its pages instead of copying them, so it costs about the
+    // same for any grid size; it may change the grid size and channel
+    // count, and it drops queued splats. Loading is not supported on a
+    // decomposed grid. Both report errors to std::cerr and return false,
+    // and a failed load leaves the simulation untouched.
+    bool saveCheckpoint(const std::string& path) const;
+    bool loadCheckpoint(const std::string& path);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    float getDt() const { return dt; }
+
+    // Velocity components, width * height each
+    const float* getVelocityX() const { return Vx.data(); }
+    const float* getVelocityY() const { return Vy.data(); }
+
+    // Dye channels. The first three are the R, G and B written by addDensity();
+    // more can be added, each with its own diffusion rate.
+    int addChannel(float diffusion);
+    int getChannelCount() const { return static_cast<int>(channelDiffusion.size()); }
+    void setChannelDiffusion(int channel, float diffusion) { channelDiffusion[channel] = diffusion; }
+    float getChannelDiffusion(int channel) const { return channelDiffusion[channel]; }
+    void addToChannel(int channel, int x, int y, float amount);
+    ChannelView getChannel(int channel) const;
+
+    // Interleaved layouts diffuse and advect all channels in one fused pass.
+    // Their diffusion always uses red-black relaxation with the diffusion
+    // solver's iteration count; the planar layout goes through the solver.
+    void setDyeLayout(DyeLayout layout);
+    DyeLayout getDyeLayout() const { return dyeLayout; }
+
+    // Float16 keeps the dye as 16-bit halves between steps and switches to
+    // the planar layout; choosing an interleaved layout switches back to Float32
+    void setDyeStorage(DyeStorage storage);
+    DyeStorage getDyeStorage() const { return dyeStorage; }
+
+    // Sparse activity tracking. With a positive epsilon the grid is split
+    // into ActiveTiles::TILE_SIZE tiles and diffusion and advection skip the
+    // tiles whose velocity and dye are all within epsilon of zero; such
+    // tiles are cleared to zero when they go quiet. Inputs wake the tiles
+    // they touch, and the active set is grown each step by the distance the
+    // fastest flow can carry anything. The pressure solve stays global.
+    // 0 (the default) disables tracking and steps every cell.
+    void setActivityEpsilon(float epsilon);
+    float getActivityEpsilon() const { return activityEpsilon; }
+    float getActiveFraction() const { return activityEpsilon > 0 ? activeTiles.getActiveFraction() : 1.0f; }
+    // Null while tracking is disabled
+    const ActiveTiles* getActiveTiles() const { return activityEpsilon > 0 ? &activeTiles : nullptr; }
+
+    // Solid barriers inside the grid, in input coordinates. Edits take
+    // effect at the next step(): every phase then steps only the fluid
+    // cells, and setBnd fills the solid cells next to fluid so the barrier
+    // walls are free-slip like the outer ones. Cells that turn solid lose
+    // their velocity and dye. Barriers need the red-black relaxation
+    // solvers, which the first one selects; they must not be changed while
+    // barriers exist. Ignored on a decomposed grid.
+    void setSolid(int x, int y, bool solid);
+    void fillObstacleCircle(int x, int y, float radius, bool solid);
+    void clearObstacles();
+    const ObstacleMask& getObstacles() const { return obstacles; }
+
+    // Per-phase timing and solver iteration counts, disabled by default.
+    // Each step() is one profiler frame, unless the caller ends the frames
+    // itself so that work it does after step() lands in the same sample.
+    Profiler& getProfiler() { return profiler; }
+    const Profiler& getProfiler() const { return profiler; }
+    void setEndsProfilerFrames(bool ends) { endsProfilerFrames = ends; }
+
+    // Worker threads used by the solver (defaults to the hardware thread count)
+    void setThreadCount(int threads);
+    int getThreadCount() const { return pool->getThreadCount(); }
+
+    // Advection of velocity and dye (semi-Lagrangian by default). MacCormack
+    // costs about two semi-Lagrangian passes and BFECC three, plus a limiter
+    // pass each, and both keep far more detail on the same grid.
+    void setAdvectionScheme(AdvectionScheme scheme) { advectionScheme = scheme; }
+    AdvectionScheme getAdvectionScheme() const { return advectionScheme; }
+
+    void setRelaxation(Relaxation relaxation) { this->relaxation = relaxation; }
+    Relaxation getRelaxation() const { return relaxation; }
+
+    // Red-black sweeps the relaxation solvers fuse into one pass over the
+    // grid (1, the default, sweeps the whole grid each time). Results do not
+    // depend on it; autotuneTemporalDepth() picks and sets the fastest one
+    // for this grid width on this machine.
+    void setTemporalDepth(int depth) { temporalDepth = std::max(1, depth); }
+    int getTemporalDepth() const { return temporalDepth; }
+    int autotuneTemporalDepth();
+
+    // Caps the instruction set of the row kernels (defaults to the best the CPU supports)
+    void setSimdLevel(SimdLevel level);
+    SimdLevel getSimdLevel() const { return kernels->level; }
+
+    // Linear solvers behind project() and diffuse(). Defaults reproduce the
+    // classic scheme: 20 relaxation sweeps, pressure started from zero and
+    // diffusion started from the previous frame's field.
+    void setPressureSolver(SolverType type, const SolverSettings& settings);
+    void setDiffusionSolver(SolverType type, const SolverSettings& settings);
+    const SolverSettings& getPressureSettings() const { return pressureSettings; }
+    const SolverSettings& getDiffusionSettings() const { return diffusionSettings; }
+
+    // Iterations and residuals of every linear solve in the last step()
+    const std::vector<SolveRecord>& getLastSolveStats() const { return solveStats; }
+
+    // Scratch arena for the divergence and the solvers' temporaries. After
+    // construction step() does not allocate; pass one workspace to several
+    // simulations to share it, provided they never step concurrently.
+    void setWorkspace(std::shared_ptr<Workspace> workspace);
+    const Workspace& getWorkspace() const { return *workspace; }
+
+    // Makes this simulation one slab of a grid decomposed across processes
+    // (see halo.hpp): it must have been constructed with the slab's width
+    // and local height, and every rank must step in lockstep. Results match
+    // an undecomposed simulation with the same settings. Inputs then take
+    // global coordinates and are ignored outside the slab; fields stay
+    // local. Only the planar dye layouts, red-black relaxation solvers,
+    // semi-Lagrangian advection and disabled activity tracking are
+    // supported, so they are selected here and must not be changed
+    // afterwards. Returns false if the size does not match.
+    bool setHalo(std::shared_ptr<Halo> halo);
+    const Halo* getHalo() const { return halo.get(); }
+
 private:
     int width;
     int height;
@@ -21,17 +183,75 @@ private:
     float diff;
     float visc;
 
-    std::vector<float> densityR;
-    std::vector<float> densityG;
-    std::vector<float> densityB;
-    std::vector<float> Vx;
-    std::vector<float> Vy;
-    std::vector<float> Vx0;
-    std::vector<float> Vy0;
-
-    void diffuse(int b, std::vector<float>& x, std::vector<float>& x0, float diff, float dt);
-    void project(std::vector<float>& velocX, std::vector<float>& velocY, std::vector<float>& p, std::vector<float>& div);
-    void advect(int b, std::vector<float>& d, std::vector<float>& d0, std::vector<float>& velocX, std::vector<float>& velocY, float dt);
-    void setBnd(int b, std::vector<float>& x);
-    int IX(int x, int y) { return x + y * width; }
+    Field dye;                      // see dyeIndex()
+    Field dyeScratch;               // diffused dye, same layout
+    FieldBuffer<Half> dyeHalf;      // replaces both with Float16 storage
+    DyeStorage dyeStorage = DyeStorage::Float32;
+    std::vector<float> channelDiffusion;
+    DyeLayout dyeLayout = DyeLayout::Planar;
+    int dyeStride = 1;              // floats per cell when interleaved
+    std::vector<float> channelA;    // fused diffusion coefficients
+    std::vector<float> channelInvC;
+    Field Vx;
+    Field Vy;
+    Field Vx0;
+    Field Vy0;
+    Field pressure;                 // kept between steps for warm starts
+    std::shared_ptr<Workspace> workspace;
+    std::shared_ptr<Halo> halo;
+
+    ActiveTiles activeTiles;
+    float activityEpsilon = 0;
+    std::vector<float> tileMagnitude;  // per tile largest |velocity| or |dye|
+    std::vector<float> tileSpeed;      // per tile largest |velocity component|
+    std::vector<int> tileReach;        // per tile dilation radius
+    std::vector<std::uint8_t> tileLive;  // measured above epsilon at the last update
+
+    ObstacleMask obstacles;
+
+    Profiler profiler;
+    bool endsProfilerFrames = true;
+    std::unique_ptr<ThreadPool> pool;
+    Relaxation relaxation = Relaxation::RedBlack;
+    AdvectionScheme advectionScheme = AdvectionScheme::SemiLagrangian;
+    int temporalDepth = 1;
+    const RowKernels* kernels;
+
+    std::unique_ptr<LinearSolver> pressureSolver;
+    std::unique_ptr<LinearSolver> diffusionSolver;
+    SolverSettings pressureSettings;
+    SolverSettings diffusionSettings;
+    std::vector<SolveRecord> solveStats;
+
+    std::vector<Splat> splats;  // queued for the next step
+    SplatKernels splatKernels;
+
+    GridContext grid();
+    void diffuse(int b, float* x, const float* x0, float diff, float dt);
+    void project(float* velocX, float* velocY, float* p);
+    void advect(int b, float* d, const float* d0, const float* velocX, const float* velocY, float dt);
+    void stepDye();
+    void updateActiveTiles();
+    void resizeTiles();
+    void updateObstacles();
+    void clearSolidCells();
+    void clearTile(int tx, int ty);
+    void touch(int idx);
+    void reserveWorkspace();
+    void stepDyeHalf();
+    void resizeDye(DyeLayout layout, DyeStorage storage, int channels);
+    size_t dyeIndex(int channel, int idx) const;
+    float dyeValue(int channel, int idx) const;
+    void addDye(int channel, int idx, float amount);
+    void applySplats();
+    void applySplat(const Splat& splat);
+    void stamp(const SplatKernel& kernel, int cx, int cy, const Splat& splat, const float* color);
+    void stampRow(const SplatKernel& kernel, int cx, int cy, int y, int rowStart, int begin, int end,
+                  const Splat& splat, const float* color);
+    const float* gatherBacktrace(const float* d0, const float* velocY, float dty);
+    int IX(int x, int y) const { return x + y * width; }
+    int globalHeight() const { return halo ? halo->slab().globalHeight : height; }
+    // Index of the input cell at global (x, y), or -1 when another slab owns
+    // it or it is solid
+    int inputIndex(int x, int y) const;
 };
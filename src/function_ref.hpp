@@ -0,0 +1,27 @@
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class FunctionRef;
+
+// Non-owning reference to a callable, for parameters that are only invoked
+// during the call. Unlike std::function it never allocates, so lambdas with
+// many captures can be passed to the parallel loops from inside step().
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+public:
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, FunctionRef>>>
+    FunctionRef(F&& fn)
+        : object(const_cast<void*>(static_cast<const void*>(std::addressof(fn)))),
+          callback([](void* object, Args... args) -> R {
+              return (*static_cast<std::remove_reference_t<F>*>(object))(std::forward<Args>(args)...);
+          }) {}
+
+    R operator()(Args... args) const { return callback(object, std::forward<Args>(args)...); }
+
+private:
+    void* object;
+    R (*callback)(void*, Args...);
+};
@@ -0,0 +1,300 @@
+#include "grid.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+namespace {
+// Minimum rows per parallel chunk, and edge cells per chunk in setBnd
+constexpr int ROW_GRAIN = 8;
+constexpr int EDGE_GRAIN = 4096;
+
+// Wavefront passes split the rows into at most this many bands, one per
+// thread, each at least BAND_GRAIN rows tall
+constexpr int MAX_BANDS = 64;
+constexpr int BAND_GRAIN = 16;
+
+// Autotuning: candidate depths, and the rows of the band that is timed
+constexpr int TUNE_DEPTHS[] = {1, 2, 3, 4, 5, 6, 8, 10, 12, 16, 20};
+constexpr int TUNE_ROWS = 512;
+
+// One colour of a red-black sweep over the updated spans of row j
+void relaxRowSpans(const GridContext& g, float* x, const float* rhs, int j, int color, float a, float invC) {
+    g.forSpans(j, [&](int begin, int end) {
+        int row = g.IX(begin, j);
+        g.kernels->relaxRow(&x[row], &rhs[row], &x[row - g.width], &x[row + g.width],
+                            end - begin, (j + g.rowOffset() + color + begin) & 1, a, invC);
+    });
+}
+
+struct alignas(64) BandProgress {
+    std::atomic<int> steps{0};  // wavefront steps the band has finished
+};
+
+// setBnd restricted to what changes when row j finishes a sweep: its side
+// ghosts, plus the top or bottom ghost row and corners next to it
+void finishRow(const GridContext& g, int b, float* x, int j) {
+    const int width = g.width;
+    const int height = g.height;
+    x[g.IX(0, j)] = b == 1 ? -x[g.IX(1, j)] : x[g.IX(1, j)];
+    x[g.IX(width-1, j)] = b == 1 ? -x[g.IX(width-2, j)] : x[g.IX(width-2, j)];
+    if (j == 1) {
+        for (int i = 1; i < width - 1; i++) x[g.IX(i, 0)] = b == 2 ? -x[g.IX(i, 1)] : x[g.IX(i, 1)];
+        x[g.IX(0, 0)] = 0.5f * (x[g.IX(1, 0)] + x[g.IX(0, 1)]);
+        x[g.IX(width-1, 0)] = 0.5f * (x[g.IX(width-2, 0)] + x[g.IX(width-1, 1)]);
+    }
+    if (j == height - 2) {
+        for (int i = 1; i < width - 1; i++) {
+            x[g.IX(i, height-1)] = b == 2 ? -x[g.IX(i, height-2)] : x[g.IX(i, height-2)];
+        }
+        x[g.IX(0, height-1)] = 0.5f * (x[g.IX(1, height-1)] + x[g.IX(0, height-2)]);
+        x[g.IX(width-1, height-1)] = 0.5f * (x[g.IX(width-2, height-1)] + x[g.IX(width-1, height-2)]);
+    }
+}
+
+// `sweeps` red-black sweeps in one pass. Half-sweep h updates row j at step
+// t = j - 1 + 2h: two steps behind half-sweep h - 1, so the rows it reads
+// are final for h - 1 and not yet overwritten by h + 1. Rows touched in one
+// step are two apart and independent; each band of rows waits for its
+// neighbours to finish the previous step before starting the next.
+void relaxWavefront(const GridContext& g, int b, float* x, const float* rhs, float a, float c, int sweeps) {
+    const int rows = g.height - 2;
+    const int halfSweeps = 2 * sweeps;
+    const int steps = rows + 2 * (halfSweeps - 1);
+    const int bands = std::max(1, std::min({rows / BAND_GRAIN, g.pool->getThreadCount(), MAX_BANDS}));
+    const float invC = 1.0f / c;
+    BandProgress progress[MAX_BANDS];
+
+    auto waitFor = [&](int band, int step) {
+        if (band < 0 || band >= bands) return;
+        for (int spins = 0; progress[band].steps.load(std::memory_order_acquire) < step; spins++) {
+            if (spins > 64) std::this_thread::yield();
+        }
+    };
+
+    g.pool->parallelFor(0, bands, [&](int bandBegin, int bandEnd) {
+        for (int t = 0; t < steps; t++) {
+            for (int band = bandBegin; band < bandEnd; band++) {
+                waitFor(band - 1, t);
+                waitFor(band + 1, t);
+                const int rowBegin = 1 + static_cast<int>(static_cast<long long>(rows) * band / bands);
+                const int rowEnd = 1 + static_cast<int>(static_cast<long long>(rows) * (band + 1) / bands);
+                // Rows j = 1 + t - 2h of this band, newest half-sweep first
+                int first = std::max(rowBegin, 1 + t - 2 * (halfSweeps - 1));
+                first += (1 + t - first) & 1;
+                for (int j = first; j < rowEnd && j <= 1 + t; j += 2) {
+                    int color = ((1 + t - j) / 2) & 1;
+                    relaxRowSpans(g, x, rhs, j, color, a, invC);
+                    if (color == 1) finishRow(g, b, x, j);
+                }
+                progress[band].steps.store(t + 1, std::memory_order_release);
+            }
+        }
+    });
+}
+}
+
+GridContext GridContext::resized(int newWidth, int newHeight) const {
+    GridContext grid = *this;
+    grid.width = newWidth;
+    grid.height = newHeight;
+    grid.activeTiles = nullptr;
+    grid.halo = nullptr;
+    grid.obstacles = nullptr;
+    return grid;
+}
+
+void GridContext::forRows(FunctionRef<void(int, int)> fn) const {
+    pool->parallelFor(1, height - 1, fn, ROW_GRAIN);
+}
+
+void GridContext::forSpans(int j, FunctionRef<void(int, int)> fn) const {
+    if (!activeTiles) {
+        forFluidSpans(j, fn);
+        return;
+    }
+    forFluidSpans(j, [&](int fluidBegin, int fluidEnd) {
+        for (const ActiveTiles::Span& span : activeTiles->rowSpans(j)) {
+            int begin = std::max(fluidBegin, span.begin);
+            int end = std::min(fluidEnd, span.end);
+            if (begin < end) fn(begin, end);
+        }
+    });
+}
+
+void GridContext::forFluidSpans(int j, FunctionRef<void(int, int)> fn) const {
+    if (!obstacles) {
+        fn(1, width - 1);
+        return;
+    }
+    for (const ObstacleMask::Span& span : obstacles->fluidSpans(j)) fn(span.begin, span.end);
+}
+
+void GridContext::setBnd(int b, float* x) const {
+    Profiler::Scope scope(*profiler, Phase::SetBnd);
+    // A slab only has the top or bottom wall when it is the first or last
+    const bool top = !halo || halo->slab().isFirst();
+    const bool bottom = !halo || halo->slab().isLast();
+    // Edge k covers column k of the top/bottom rows and row k of the side columns
+    pool->parallelFor(1, std::max(width, height) - 1, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            if (k < width - 1) {
+                if (top) x[IX(k, 0)] = b == 2 ? -x[IX(k, 1)] : x[IX(k, 1)];
+                if (bottom) x[IX(k, height-1)] = b == 2 ? -x[IX(k, height-2)] : x[IX(k, height-2)];
+            }
+            if (k < height - 1) {
+                x[IX(0, k)] = b == 1 ? -x[IX(1, k)] : x[IX(1, k)];
+                x[IX(width-1, k)] = b == 1 ? -x[IX(width-2, k)] : x[IX(width-2, k)];
+            }
+        }
+    }, EDGE_GRAIN);
+
+    if (top) {
+        x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
+        x[IX(width-1, 0)] = 0.5f * (x[IX(width-2, 0)] + x[IX(width-1, 1)]);
+    }
+    if (bottom) {
+        x[IX(0, height-1)] = 0.5f * (x[IX(1, height-1)] + x[IX(0, height-2)]);
+        x[IX(width-1, height-1)] = 0.5f * (x[IX(width-2, height-1)] + x[IX(width-1, height-2)]);
+    }
+    if (obstacles) obstacles->setBoundary(b, x);
+    exchangeHalo(x);
+}
+
+void GridContext::exchangeHalo(float* x) const {
+    if (!halo) return;
+    Profiler::Scope scope(*profiler, Phase::Halo);
+    halo->exchange(x);
+}
+
+void GridContext::relax(int b, float* x, const float* rhs, float a, float c) const {
+    if (relaxation == Relaxation::Lexicographic && !halo && !obstacles) {
+        for (int i = 1; i < width - 1; i++) {
+            for (int j = 1; j < height - 1; j++) {
+                x[IX(i, j)] = (rhs[IX(i, j)] + a * (
+                    x[IX(i+1, j)] + x[IX(i-1, j)] +
+                    x[IX(i, j+1)] + x[IX(i, j-1)]
+                )) / c;
+            }
+        }
+    } else {
+        // Cells of one colour only read cells of the other, so each
+        // half-sweep is order independent and rows can run in parallel
+        float invC = 1.0f / c;
+        for (int color = 0; color < 2; color++) {
+            forRows([&](int rowBegin, int rowEnd) {
+                for (int j = rowBegin; j < rowEnd; j++) relaxRowSpans(*this, x, rhs, j, color, a, invC);
+            });
+            // The second colour reads the first one's cells in the ghost rows
+            if (color == 0) exchangeHalo(x);
+        }
+    }
+    setBnd(b, x);
+}
+
+void GridContext::relaxSweeps(int b, float* x, const float* rhs, float a, float c, int sweeps) const {
+    if (relaxation != Relaxation::RedBlack || temporalDepth <= 1 || halo || obstacles) {
+        for (int k = 0; k < sweeps; k++) relax(b, x, rhs, a, c);
+        return;
+    }
+    for (int k = 0; k < sweeps; k += temporalDepth) {
+        relaxWavefront(*this, b, x, rhs, a, c, std::min(temporalDepth, sweeps - k));
+    }
+}
+
+double GridContext::sumRows(FunctionRef<double(int, int)> fn) const {
+    std::mutex mutex;
+    double total = 0;
+    forRows([&](int rowBegin, int rowEnd) {
+        double partial = fn(rowBegin, rowEnd);
+        std::lock_guard<std::mutex> lock(mutex);
+        total += partial;
+    });
+    return halo ? halo->getTransport().sum(total) : total;
+}
+
+double GridContext::residual(float* r, const float* x, const float* rhs, float a, float c) const {
+    double total = sumRows([&](int rowBegin, int rowEnd) {
+        double partial = 0;
+        for (int j = rowBegin; j < rowEnd; j++) {
+            forFluidSpans(j, [&](int begin, int end) {
+                double span = 0;
+                for (int i = begin; i < end; i++) {
+                    int idx = IX(i, j);
+                    float ri = rhs[idx] - (c * x[idx] - a * (x[idx - 1] + x[idx + 1] + x[idx - width] + x[idx + width]));
+                    if (r) r[idx] = ri;
+                    span += static_cast<double>(ri) * ri;
+                }
+                partial += span;
+            });
+        }
+        return partial;
+    });
+    return std::sqrt(total / interiorCells());
+}
+
+double GridContext::norm(const float* v) const {
+    double total = sumRows([&](int rowBegin, int rowEnd) {
+        double partial = 0;
+        for (int j = rowBegin; j < rowEnd; j++) {
+            forFluidSpans(j, [&](int begin, int end) {
+                const float* row = &v[IX(begin, j)];
+                double span = 0;
+                for (int i = 0; i < end - begin; i++) {
+                    span += static_cast<double>(row[i]) * row[i];
+                }
+                partial += span;
+            });
+        }
+        return partial;
+    });
+    return std::sqrt(total / interiorCells());
+}
+
+int autotuneTemporalDepth(const GridContext& grid, int sweeps) {
+    static std::mutex cacheMutex;
+    static std::map<std::tuple<int, int, int>, int> cache;
+    const auto key = std::make_tuple(grid.width, grid.pool->getThreadCount(), sweeps);
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto found = cache.find(key);
+        if (found != cache.end()) return found->second;
+    }
+
+    // Reuse of a row depends on the row length, not the grid height
+    GridContext band = grid.resized(grid.width, std::min(grid.height, TUNE_ROWS));
+    band.relaxation = Relaxation::RedBlack;
+    const size_t cells = static_cast<size_t>(band.width) * band.height;
+    Workspace::Scope scratch(*band.workspace);
+    float* x = band.workspace->allocateFloats(cells);
+    float* rhs = band.workspace->allocateFloats(cells);
+    for (size_t i = 0; i < cells; i++) rhs[i] = static_cast<float>(i * 7919 % 1024) / 1024.0f - 0.5f;
+
+    int best = 1;
+    double bestSeconds = 0;
+    for (int depth : TUNE_DEPTHS) {
+        if (depth > std::max(1, sweeps)) break;
+        band.temporalDepth = depth;
+        double seconds = 0;
+        for (int run = 0; run < 3; run++) {
+            std::fill(x, x + cells, 0.0f);
+            auto start = std::chrono::steady_clock::now();
+            band.relaxSweeps(0, x, rhs, 1.0f, 4.0f, sweeps);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            // The first run only warms the caches and the pool
+            if (run == 1 || (run > 1 && elapsed < seconds)) seconds = elapsed;
+        }
+        if (depth == 1 || seconds < bestSeconds) {
+            best = depth;
+            bestSeconds = seconds;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache[key] = best;
+    return best;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "active_tiles.hpp"
+#include "function_ref.hpp"
+#include "halo.hpp"
+#include "kernels.hpp"
+#include "obstacles.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "workspace.hpp"
+
+// Update order of the relaxation sweeps in diffuse() and project()
+enum class Relaxation {
+    Lexicographic,  // in-place row-by-row Gauss-Seidel, single threaded
+    RedBlack        // checkerboard Gauss-Seidel, rows split across the thread pool
+};
+
+// Grid geometry plus the execution resources the solver phases run on.
+// Fields are width x height with a one-cell ghost border; b selects the
+// boundary condition as in setBnd (0 = scalar, 1 = x velocity, 2 = y velocity).
+// Every linear system here has the form c * x - a * (sum of 4 neighbours) = rhs.
+struct GridContext {
+    int width;
+    int height;
+    ThreadPool* pool;
+    const RowKernels* kernels;
+    Profiler* profiler;
+    Relaxation relaxation;
+    Workspace* workspace;  // scratch for the solvers
+    int temporalDepth;     // red-black sweeps fused per pass in relaxSweeps()
+    const ActiveTiles* activeTiles;  // when set, relaxation and advection skip inactive tiles
+    // When set, the grid is one slab of a decomposed domain and height is
+    // the slab's local height (see halo.hpp). setBnd then only applies the
+    // walls the slab touches and refreshes the ghost rows, the relaxation
+    // is always red-black without temporal blocking, and sums are global.
+    Halo* halo = nullptr;
+    // When set, only its fluid cells are stepped and setBnd also fills the
+    // solid cells next to fluid. Lexicographic relaxation and temporal
+    // blocking are then unavailable, and sums and norms skip solid cells.
+    const ObstacleMask* obstacles = nullptr;
+
+    int IX(int x, int y) const { return x + y * width; }
+    int globalHeight() const { return halo ? halo->slab().globalHeight : height; }
+    int rowOffset() const { return halo ? halo->slab().rowOffset() : 0; }  // global row of row 0
+    int interiorCells() const {
+        return (width - 2) * (globalHeight() - 2) - (obstacles ? obstacles->getSolidCount() : 0);
+    }
+
+    // Same resources on a grid of a different size, without active tiles or obstacles
+    GridContext resized(int newWidth, int newHeight) const;
+
+    // Runs fn(rowBegin, rowEnd) over the interior rows in parallel
+    void forRows(FunctionRef<void(int, int)> fn) const;
+
+    // Calls fn(begin, end) for the interior columns of row j that are
+    // updated: all fluid ones, or only those in active tiles
+    void forSpans(int j, FunctionRef<void(int, int)> fn) const;
+
+    // Like forSpans, ignoring the active tiles
+    void forFluidSpans(int j, FunctionRef<void(int, int)> fn) const;
+
+    // Like forRows, summing the values fn returns for its rows
+    double sumRows(FunctionRef<double(int, int)> fn) const;
+
+    void setBnd(int b, float* x) const;
+
+    // Refreshes the ghost rows of a decomposed grid; does nothing otherwise
+    void exchangeHalo(float* x) const;
+
+    // One relaxation sweep followed by setBnd
+    void relax(int b, float* x, const float* rhs, float a, float c) const;
+
+    // `sweeps` calls to relax(). With red-black relaxation and a temporalDepth
+    // above 1, up to temporalDepth sweeps share one wavefront pass over the
+    // rows, so each row gets all of them while it is still in cache. The
+    // result is bit-identical to sweeping the whole grid each time.
+    void relaxSweeps(int b, float* x, const float* rhs, float a, float c, int sweeps) const;
+
+    // r = rhs - (c * x - a * neighbours) on interior cells; x must have its
+    // boundary set. Returns the RMS of r. r may be null to only get the norm.
+    double residual(float* r, const float* x, const float* rhs, float a, float c) const;
+
+    // RMS over interior cells
+    double norm(const float* v) const;
+};
+
+// Times relaxSweeps() at several temporal depths on a band of the grid's
+// width and returns the fastest. Results are cached per width, thread
+// count and sweep count, so only the first call for a shape is slow.
+int autotuneTemporalDepth(const GridContext& grid, int sweeps);
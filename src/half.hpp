@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 binary16 storage for fields that do not need single precision.
+// Arithmetic is always done in float; bulk conversion goes through the
+// halfToFloatRow / floatToHalfRow kernels.
+using Half = std::uint16_t;
+
+// Round to nearest even; overflow becomes infinity
+inline Half floatToHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint32_t sign = (bits >> 16) & 0x8000u;
+    std::uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if (magnitude >= 0x7F800000u) return static_cast<Half>(sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u));
+    if (magnitude >= 0x477FF000u) return static_cast<Half>(sign | 0x7C00u);
+    if (magnitude < 0x38800000u) {
+        // Subnormal half (or zero)
+        if (magnitude < 0x33000000u) return static_cast<Half>(sign);
+        std::uint32_t mantissa = (magnitude & 0x007FFFFFu) | 0x00800000u;
+        int shift = 126 - static_cast<int>(magnitude >> 23);
+        std::uint32_t result = mantissa >> shift;
+        std::uint32_t rest = mantissa & ((1u << shift) - 1);
+        std::uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (result & 1))) result++;
+        return static_cast<Half>(sign | result);
+    }
+
+    std::uint32_t result = (magnitude >> 13) - (112u << 10);
+    std::uint32_t rest = magnitude & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (result & 1))) result++;
+    return static_cast<Half>(sign | result);
+}
+
+inline float halfToFloat(Half value) {
+    std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000u) << 16;
+    std::uint32_t exponent = (value >> 10) & 0x1Fu;
+    std::uint32_t mantissa = value & 0x3FFu;
+    std::uint32_t bits;
+    if (exponent == 0) {
+        // Zero or subnormal: mantissa * 2^-24, exact in float
+        float magnitude = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+        return sign ? -magnitude : magnitude;
+    } else if (exponent == 31) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
@@ -0,0 +1,69 @@
+#include "halo.hpp"
+#include <algorithm>
+#include <cstring>
+
+Slab slabFor(int width, int height, int rank, int ranks) {
+    const long long rows = height - 2;
+    Slab slab;
+    slab.width = width;
+    slab.globalHeight = height;
+    slab.rowBegin = 1 + static_cast<int>(rows * rank / ranks);
+    slab.rowEnd = 1 + static_cast<int>(rows * (rank + 1) / ranks);
+    return slab;
+}
+
+Halo::Halo(int width, int height, HaloTransport& transport)
+    : transport(transport), local(slabFor(width, height, transport.rank(), transport.size())) {}
+
+std::size_t Halo::windowFloats(int width, int height, int ranks) {
+    // The tallest slab, ghost rows included
+    const int rows = height - 2;
+    return static_cast<std::size_t>(width) * ((rows + ranks - 1) / ranks + 2);
+}
+
+int Halo::ownerOf(int row) const {
+    const int ranks = transport.size();
+    if (row <= 0) return 0;
+    if (row >= local.globalHeight - 1) return ranks - 1;
+    for (int r = 0; r < ranks; r++) {
+        if (row < slabFor(local.width, local.globalHeight, r, ranks).rowEnd) return r;
+    }
+    return ranks - 1;
+}
+
+void Halo::exchange(float* field) {
+    const int width = local.width;
+    const int last = local.localHeight() - 1;
+    if (transport.size() == 1) return;
+    transport.put(0, &field[width], width);
+    transport.put(width, &field[(last - 1) * width], width);
+    transport.fence();
+    if (!local.isFirst()) transport.get(transport.rank() - 1, width, field, width);
+    if (!local.isLast()) transport.get(transport.rank() + 1, 0, &field[last * width], width);
+}
+
+// Every slab is published whole, since which rows the others need is only
+// known to them
+void Halo::gatherRows(const float* field, int first, int last, float* out) {
+    const int width = local.width;
+    if (transport.size() > 1) {
+        transport.put(0, field, static_cast<std::size_t>(width) * local.localHeight());
+        transport.fence();
+    }
+
+    int row = first;
+    while (row <= last) {
+        const int owner = ownerOf(row);
+        const Slab slab = slabFor(width, local.globalHeight, owner, transport.size());
+        const int runEnd = std::min(last + 1, owner == transport.size() - 1 ? last + 1 : slab.rowEnd);
+        const std::size_t offset = static_cast<std::size_t>(row - slab.rowOffset()) * width;
+        const std::size_t count = static_cast<std::size_t>(runEnd - row) * width;
+        float* to = &out[static_cast<std::size_t>(row - first) * width];
+        if (owner == transport.rank()) {
+            std::memcpy(to, &field[offset], count * sizeof(float));
+        } else {
+            transport.get(owner, offset, to, count);
+        }
+        row = runEnd;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+
+// Domain decomposition of a width x height grid into horizontal slabs, one
+// per rank (process). A rank owns the global interior rows
+// [rowBegin, rowEnd) and stores them with one ghost row above and below,
+// so its fields are width x localHeight() and local row 0 is global row
+// rowBegin - 1. Ghost rows next to another slab are copies of that slab's
+// rows; on the first and last slab they are the physical boundary.
+struct Slab {
+    int width;
+    int globalHeight;
+    int rowBegin;
+    int rowEnd;
+
+    int localHeight() const { return rowEnd - rowBegin + 2; }
+    int rowOffset() const { return rowBegin - 1; }  // global row of local row 0
+    bool isFirst() const { return rowBegin == 1; }
+    bool isLast() const { return rowEnd == globalHeight - 1; }
+};
+
+// Slab of rank out of ranks: the interior rows split as evenly as possible.
+// Needs at least one interior row per rank.
+Slab slabFor(int width, int height, int rank, int ranks);
+
+// Message layer between ranks. Each rank exposes a window of floats that
+// the others can read; puts and gets are separated by collective fences,
+// the same epoch model as MPI one-sided communication, so a socket or MPI
+// backend only has to provide these calls. All collective calls must be
+// made by every rank in the same order.
+class HaloTransport {
+public:
+    virtual ~HaloTransport() = default;
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+    // Floats in each rank's window
+    virtual std::size_t windowFloats() const = 0;
+
+    // Writes count floats at offset of this rank's window. They become
+    // visible to the other ranks at the next fence().
+    virtual void put(std::size_t offset, const float* data, std::size_t count) = 0;
+    // Collective. Publishes the puts made since the last fence.
+    virtual void fence() = 0;
+    // Reads what rank put before the last fence
+    virtual void get(int rank, std::size_t offset, float* out, std::size_t count) = 0;
+
+    // Collective reductions. Every rank gets the same result: sums are
+    // accumulated in rank order.
+    virtual double sum(double value) = 0;
+    virtual double max(double value) = 0;
+};
+
+// Ghost-row exchange for the fields of one slab, layered on a transport.
+// Used by GridContext::setBnd, the red-black relaxation and advect().
+class Halo {
+public:
+    Halo(int width, int height, HaloTransport& transport);
+
+    const Slab& slab() const { return local; }
+    HaloTransport& getTransport() { return transport; }
+
+    // Floats each rank's transport window needs for a width x height grid
+    // split across ranks
+    static std::size_t windowFloats(int width, int height, int ranks);
+
+    // Collective. Copies the first and last owned rows of each slab into
+    // the neighbouring slabs' ghost rows.
+    void exchange(float* field);
+
+    // Collective. Copies global rows [first, last] of the distributed field
+    // into out, one row after the other; first > last requests nothing.
+    // Boundary rows 0 and height - 1 come from the first and last slab.
+    void gatherRows(const float* field, int first, int last, float* out);
+
+private:
+    // Rank whose stored rows include global row
+    int ownerOf(int row) const;
+
+    HaloTransport& transport;
+    Slab local;
+};
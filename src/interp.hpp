@@ -0,0 +1,49 @@
+#pragma once
+#include <cmath>
+
+// Corner index and weights of a bilinear sample. idx addresses the top-left
+// corner; the others are idx + 1, idx + width and idx + width + 1.
+struct BilinearWeights {
+    int idx;
+    float s0, s1;  // left / right
+    float t0, t1;  // top / bottom
+};
+
+// Weights for grid position (x, y) on a width x height field. The position
+// is clamped half a cell inside the boundary, as advect() does.
+inline BilinearWeights bilinearWeights(int width, int height, float x, float y) {
+    x = std::fmin(std::fmax(x, 0.5f), width - 1.5f);
+    y = std::fmin(std::fmax(y, 0.5f), height - 1.5f);
+
+    float i0 = std::floor(x);
+    float j0 = std::floor(y);
+
+    BilinearWeights w;
+    w.idx = static_cast<int>(i0) + static_cast<int>(j0) * width;
+    w.s1 = x - i0;
+    w.s0 = 1.0f - w.s1;
+    w.t1 = y - j0;
+    w.t0 = 1.0f - w.t1;
+    return w;
+}
+
+inline float sampleBilinear(const float* field, int width, const BilinearWeights& w) {
+    return w.s0 * (w.t0 * field[w.idx] + w.t1 * field[w.idx + width]) +
+           w.s1 * (w.t0 * field[w.idx + 1] + w.t1 * field[w.idx + width + 1]);
+}
+
+inline float sampleBilinear(const float* field, int width, int height, float x, float y) {
+    return sampleBilinear(field, width, bilinearWeights(width, height, x, y));
+}
+
+// One midpoint step of a passive particle at grid position (x, y) through
+// the velocity field (u, v); the result is clamped like a sample position
+inline void advectParticle(const float* u, const float* v, int width, int height, float dtx, float dty,
+                           float& x, float& y) {
+    BilinearWeights w = bilinearWeights(width, height, x, y);
+    const float mx = x + 0.5f * dtx * sampleBilinear(u, width, w);
+    const float my = y + 0.5f * dty * sampleBilinear(v, width, w);
+    w = bilinearWeights(width, height, mx, my);
+    x = std::fmin(std::fmax(x + dtx * sampleBilinear(u, width, w), 0.5f), width - 1.5f);
+    y = std::fmin(std::fmax(y + dty * sampleBilinear(v, width, w), 0.5f), height - 1.5f);
+}
@@ -0,0 +1,138 @@
+#include "kernels.hpp"
+#include "interp.hpp"
+#include <initializer_list>
+
+#if defined(_MSC_VER) && defined(FLUID_HAVE_X86_KERNELS)
+#include <intrin.h>
+#endif
+
+namespace {
+
+void relaxRowScalar(float* x, const float* x0, const float* up, const float* down,
+                    int count, int parity, float a, float invC) {
+    for (int k = parity; k < count; k += 2) {
+        x[k] = (x0[k] + a * (x[k - 1] + x[k + 1] + up[k] + down[k])) * invC;
+    }
+}
+
+void divergenceRowScalar(float* div, const float* u, const float* vUp, const float* vDown,
+                         int count, float scale) {
+    for (int k = 0; k < count; k++) {
+        div[k] = scale * (u[k + 1] - u[k - 1] + vDown[k] - vUp[k]);
+    }
+}
+
+void gradientRowScalar(float* u, float* v, const float* p, const float* pUp, const float* pDown,
+                       int count, float scale) {
+    for (int k = 0; k < count; k++) {
+        u[k] -= scale * (p[k + 1] - p[k - 1]);
+        v[k] -= scale * (pDown[k] - pUp[k]);
+    }
+}
+
+void advectRowScalar(float* d, const float* d0, const float* u, const float* v,
+                     int i, int j, int count, int width, int height, float dtx, float dty) {
+    for (int k = 0; k < count; k++) {
+        d[k] = sampleBilinear(d0, width, height, (i + k) - dtx * u[k], j - dty * v[k]);
+    }
+}
+
+void advectParticlesScalar(float* x, float* y, const float* u, const float* v,
+                           int count, int width, int height, float dtx, float dty) {
+    for (int k = 0; k < count; k++) advectParticle(u, v, width, height, dtx, dty, x[k], y[k]);
+}
+
+void halfToFloatRowScalar(float* out, const Half* in, int count) {
+    for (int k = 0; k < count; k++) out[k] = halfToFloat(in[k]);
+}
+
+void floatToHalfRowScalar(Half* out, const float* in, int count) {
+    for (int k = 0; k < count; k++) out[k] = floatToHalf(in[k]);
+}
+
+bool cpuSupports(SimdLevel level) {
+#if defined(FLUID_HAVE_X86_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    switch (level) {
+        case SimdLevel::Scalar: return true;
+        case SimdLevel::SSE41: return __builtin_cpu_supports("sse4.1");
+        case SimdLevel::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                   __builtin_cpu_supports("f16c");
+        case SimdLevel::AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#elif defined(FLUID_HAVE_X86_KERNELS) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool f16c = (info[2] & (1 << 29)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avxState = (xcr0 & 0x6) == 0x6;
+    bool avx512State = (xcr0 & 0xe6) == 0xe6;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0;
+    }
+    switch (level) {
+        case SimdLevel::Scalar: return true;
+        case SimdLevel::SSE41: return sse41;
+        case SimdLevel::AVX2: return avx2 && fma && f16c && avxState;
+        case SimdLevel::AVX512: return avx512 && avx512State;
+    }
+    return false;
+#else
+    return level == SimdLevel::Scalar;
+#endif
+}
+
+}  // namespace
+
+const RowKernels& kernels::scalar() {
+    static const RowKernels table = {
+        SimdLevel::Scalar, relaxRowScalar, divergenceRowScalar, gradientRowScalar, advectRowScalar,
+        advectParticlesScalar, halfToFloatRowScalar, floatToHalfRowScalar
+    };
+    return table;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE41: return "sse4.1";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+SimdLevel detectSimdLevel() {
+    static const SimdLevel detected = [] {
+        for (SimdLevel level : {SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE41}) {
+            if (cpuSupports(level)) return level;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return detected;
+}
+
+const RowKernels& selectKernels(SimdLevel maxLevel) {
+    SimdLevel level = detectSimdLevel();
+    if (static_cast<int>(maxLevel) < static_cast<int>(level)) level = maxLevel;
+
+    switch (level) {
+#ifdef FLUID_HAVE_X86_KERNELS
+        case SimdLevel::AVX512: return kernels::avx512();
+        case SimdLevel::AVX2: return kernels::avx2();
+        case SimdLevel::SSE41: return kernels::sse41();
+#endif
+        default: return kernels::scalar();
+    }
+}
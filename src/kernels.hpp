@@ -0,0 +1,65 @@
+#pragma once
+#include "half.hpp"
+
+// Instruction set used by the row kernels
+enum class SimdLevel {
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+// Kernels over one contiguous span of a grid row, such as a fluid span
+// between barriers (see GridContext::forSpans). Row pointers address the
+// span's first cell, at column begin; count is the number of cells in it.
+// Parities are of the offset from that first cell.
+struct RowKernels {
+    SimdLevel level;
+
+    // Red-black relaxation: x = (x0 + a * (left + right + up + down)) * invC
+    // for cells at offsets with the given parity (0 = even, 1 = odd).
+    void (*relaxRow)(float* x, const float* x0, const float* up, const float* down,
+                     int count, int parity, float a, float invC);
+
+    // div = scale * (u[+1] - u[-1] + vDown - vUp)
+    void (*divergenceRow)(float* div, const float* u, const float* vUp, const float* vDown,
+                          int count, float scale);
+
+    // u -= scale * (p[+1] - p[-1]), v -= scale * (pDown - pUp)
+    void (*gradientRow)(float* u, float* v, const float* p, const float* pUp, const float* pDown,
+                        int count, float scale);
+
+    // Semi-Lagrangian bilinear advection of count cells of row j starting
+    // at column i. Here d, u and v address cell (i, j) but d0 is the whole
+    // source field.
+    void (*advectRow)(float* d, const float* d0, const float* u, const float* v,
+                      int i, int j, int count, int width, int height, float dtx, float dty);
+
+    // Moves count passive particles at grid positions (x, y) one midpoint
+    // step of dtx, dty through the velocity field (u, v), sampling it the way
+    // advectRow samples d0. Positions stay within the range it clamps to.
+    void (*advectParticles)(float* x, float* y, const float* u, const float* v,
+                            int count, int width, int height, float dtx, float dty);
+
+    // Conversion between 16-bit storage and float over count contiguous values
+    void (*halfToFloatRow)(float* out, const Half* in, int count);
+    void (*floatToHalfRow)(Half* out, const float* in, int count);
+};
+
+const char* simdLevelName(SimdLevel level);
+
+// Highest level supported by the running CPU
+SimdLevel detectSimdLevel();
+
+// Kernels for the highest supported level not above maxLevel
+const RowKernels& selectKernels(SimdLevel maxLevel);
+
+namespace kernels {
+const RowKernels& scalar();
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FLUID_HAVE_X86_KERNELS 1
+const RowKernels& sse41();
+const RowKernels& avx2();
+const RowKernels& avx512();
+#endif
+}
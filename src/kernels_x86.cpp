@@ -0,0 +1,581 @@
+// SSE4.1, AVX2 and AVX-512 row kernels. Each function is compiled for its
+// own instruction set so the binary runs on any x86 CPU; selectKernels()
+// only hands out a table the running CPU supports.
+#include "kernels.hpp"
+
+#ifdef FLUID_HAVE_X86_KERNELS
+#include "interp.hpp"
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FLUID_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FLUID_TARGET(isa)
+#endif
+
+namespace {
+
+// Scalar tails shared by all widths
+inline void relaxTail(float* x, const float* x0, const float* up, const float* down,
+                      int begin, int count, int parity, float a, float invC) {
+    for (int k = begin + parity; k < count; k += 2) {
+        x[k] = (x0[k] + a * (x[k - 1] + x[k + 1] + up[k] + down[k])) * invC;
+    }
+}
+
+inline void divergenceTail(float* div, const float* u, const float* vUp, const float* vDown,
+                           int begin, int count, float scale) {
+    for (int k = begin; k < count; k++) {
+        div[k] = scale * (u[k + 1] - u[k - 1] + vDown[k] - vUp[k]);
+    }
+}
+
+inline void gradientTail(float* u, float* v, const float* p, const float* pUp, const float* pDown,
+                         int begin, int count, float scale) {
+    for (int k = begin; k < count; k++) {
+        u[k] -= scale * (p[k + 1] - p[k - 1]);
+        v[k] -= scale * (pDown[k] - pUp[k]);
+    }
+}
+
+inline void advectTail(float* d, const float* d0, const float* u, const float* v,
+                       int begin, int i, int j, int count, int width, int height, float dtx, float dty) {
+    for (int k = begin; k < count; k++) {
+        d[k] = sampleBilinear(d0, width, height, (i + k) - dtx * u[k], j - dty * v[k]);
+    }
+}
+
+inline void advectParticlesTail(float* x, float* y, const float* u, const float* v,
+                                int begin, int count, int width, int height, float dtx, float dty) {
+    for (int k = begin; k < count; k++) advectParticle(u, v, width, height, dtx, dty, x[k], y[k]);
+}
+
+inline void halfToFloatTail(float* out, const Half* in, int begin, int count) {
+    for (int k = begin; k < count; k++) out[k] = halfToFloat(in[k]);
+}
+
+inline void floatToHalfTail(Half* out, const float* in, int begin, int count) {
+    for (int k = begin; k < count; k++) out[k] = floatToHalf(in[k]);
+}
+
+// ---------------------------------------------------------------- SSE4.1
+
+FLUID_TARGET("sse4.1")
+void relaxRowSse41(float* x, const float* x0, const float* up, const float* down,
+                   int count, int parity, float a, float invC) {
+    const __m128 va = _mm_set1_ps(a);
+    const __m128 vInvC = _mm_set1_ps(invC);
+    int k = 0;
+    if (count >= 4) {
+        // Operands of the next block are loaded before the current block is
+        // stored, so loads never wait on an overlapping partial store
+        __m128 left = _mm_loadu_ps(x - 1);
+        __m128 right = _mm_loadu_ps(x + 1);
+        __m128 vert = _mm_add_ps(_mm_loadu_ps(up), _mm_loadu_ps(down));
+        __m128 src = _mm_loadu_ps(x0);
+        for (;;) {
+            __m128 sum = _mm_add_ps(_mm_add_ps(left, right), vert);
+            __m128 r = _mm_mul_ps(_mm_add_ps(src, _mm_mul_ps(va, sum)), vInvC);
+            bool more = k + 8 <= count;
+            if (more) {
+                left = _mm_loadu_ps(x + k + 3);
+                right = _mm_loadu_ps(x + k + 5);
+                vert = _mm_add_ps(_mm_loadu_ps(up + k + 4), _mm_loadu_ps(down + k + 4));
+                src = _mm_loadu_ps(x0 + k + 4);
+            }
+            // Store only this colour's lanes; the others are being read by neighbouring rows
+            if (parity == 0) {
+                _mm_store_ss(x + k, r);
+                _mm_store_ss(x + k + 2, _mm_movehl_ps(r, r));
+            } else {
+                _mm_store_ss(x + k + 1, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)));
+                _mm_store_ss(x + k + 3, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+            }
+            k += 4;
+            if (!more) break;
+        }
+    }
+    relaxTail(x, x0, up, down, k, count, parity, a, invC);
+}
+
+FLUID_TARGET("sse4.1")
+void divergenceRowSse41(float* div, const float* u, const float* vUp, const float* vDown,
+                        int count, float scale) {
+    const __m128 vScale = _mm_set1_ps(scale);
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 du = _mm_sub_ps(_mm_loadu_ps(u + k + 1), _mm_loadu_ps(u + k - 1));
+        __m128 dv = _mm_sub_ps(_mm_loadu_ps(vDown + k), _mm_loadu_ps(vUp + k));
+        _mm_storeu_ps(div + k, _mm_mul_ps(vScale, _mm_add_ps(du, dv)));
+    }
+    divergenceTail(div, u, vUp, vDown, k, count, scale);
+}
+
+FLUID_TARGET("sse4.1")
+void gradientRowSse41(float* u, float* v, const float* p, const float* pUp, const float* pDown,
+                      int count, float scale) {
+    const __m128 vScale = _mm_set1_ps(scale);
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 dpx = _mm_sub_ps(_mm_loadu_ps(p + k + 1), _mm_loadu_ps(p + k - 1));
+        __m128 dpy = _mm_sub_ps(_mm_loadu_ps(pDown + k), _mm_loadu_ps(pUp + k));
+        _mm_storeu_ps(u + k, _mm_sub_ps(_mm_loadu_ps(u + k), _mm_mul_ps(vScale, dpx)));
+        _mm_storeu_ps(v + k, _mm_sub_ps(_mm_loadu_ps(v + k), _mm_mul_ps(vScale, dpy)));
+    }
+    gradientTail(u, v, p, pUp, pDown, k, count, scale);
+}
+
+// Corner indices and weights of four bilinear samples, as bilinearWeights()
+struct Bilinear4 {
+    alignas(16) int idx[4];
+    __m128 s0, s1, t0, t1;
+};
+
+FLUID_TARGET("sse4.1")
+inline void bilinearSse41(Bilinear4& w, __m128 x, __m128 y, int width, int height) {
+    const __m128 lo = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    x = _mm_min_ps(_mm_max_ps(x, lo), _mm_set1_ps(width - 1.5f));
+    y = _mm_min_ps(_mm_max_ps(y, lo), _mm_set1_ps(height - 1.5f));
+
+    __m128 i0 = _mm_floor_ps(x);
+    __m128 j0 = _mm_floor_ps(y);
+    w.s1 = _mm_sub_ps(x, i0);
+    w.s0 = _mm_sub_ps(one, w.s1);
+    w.t1 = _mm_sub_ps(y, j0);
+    w.t0 = _mm_sub_ps(one, w.t1);
+
+    __m128i base = _mm_add_epi32(_mm_cvttps_epi32(i0), _mm_mullo_epi32(_mm_cvttps_epi32(j0), _mm_set1_epi32(width)));
+    _mm_store_si128(reinterpret_cast<__m128i*>(w.idx), base);
+}
+
+FLUID_TARGET("sse4.1")
+inline __m128 sampleSse41(const float* field, int width, const Bilinear4& w) {
+    const int* idx = w.idx;
+    __m128 d00 = _mm_setr_ps(field[idx[0]], field[idx[1]], field[idx[2]], field[idx[3]]);
+    __m128 d10 = _mm_setr_ps(field[idx[0] + 1], field[idx[1] + 1], field[idx[2] + 1], field[idx[3] + 1]);
+    __m128 d01 = _mm_setr_ps(field[idx[0] + width], field[idx[1] + width], field[idx[2] + width],
+                             field[idx[3] + width]);
+    __m128 d11 = _mm_setr_ps(field[idx[0] + width + 1], field[idx[1] + width + 1],
+                             field[idx[2] + width + 1], field[idx[3] + width + 1]);
+
+    __m128 left = _mm_add_ps(_mm_mul_ps(w.t0, d00), _mm_mul_ps(w.t1, d01));
+    __m128 right = _mm_add_ps(_mm_mul_ps(w.t0, d10), _mm_mul_ps(w.t1, d11));
+    return _mm_add_ps(_mm_mul_ps(w.s0, left), _mm_mul_ps(w.s1, right));
+}
+
+FLUID_TARGET("sse4.1")
+void advectRowSse41(float* d, const float* d0, const float* u, const float* v,
+                    int i, int j, int count, int width, int height, float dtx, float dty) {
+    const __m128 vDtx = _mm_set1_ps(dtx);
+    const __m128 vDty = _mm_set1_ps(dty);
+    const __m128 row = _mm_set1_ps(static_cast<float>(j));
+    __m128 col = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    const __m128 step = _mm_set1_ps(4.0f);
+
+    Bilinear4 w;
+    int k = 0;
+    for (; k + 4 <= count; k += 4, col = _mm_add_ps(col, step)) {
+        __m128 x = _mm_sub_ps(col, _mm_mul_ps(vDtx, _mm_loadu_ps(u + k)));
+        __m128 y = _mm_sub_ps(row, _mm_mul_ps(vDty, _mm_loadu_ps(v + k)));
+        bilinearSse41(w, x, y, width, height);
+        _mm_storeu_ps(d + k, sampleSse41(d0, width, w));
+    }
+    advectTail(d, d0, u, v, k, i, j, count, width, height, dtx, dty);
+}
+
+FLUID_TARGET("sse4.1")
+void advectParticlesSse41(float* x, float* y, const float* u, const float* v,
+                          int count, int width, int height, float dtx, float dty) {
+    const __m128 vDtx = _mm_set1_ps(dtx);
+    const __m128 vDty = _mm_set1_ps(dty);
+    const __m128 halfDtx = _mm_set1_ps(0.5f * dtx);
+    const __m128 halfDty = _mm_set1_ps(0.5f * dty);
+    const __m128 lo = _mm_set1_ps(0.5f);
+    const __m128 maxX = _mm_set1_ps(width - 1.5f);
+    const __m128 maxY = _mm_set1_ps(height - 1.5f);
+
+    Bilinear4 w;
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 px = _mm_loadu_ps(x + k);
+        __m128 py = _mm_loadu_ps(y + k);
+        bilinearSse41(w, px, py, width, height);
+        __m128 mx = _mm_add_ps(px, _mm_mul_ps(halfDtx, sampleSse41(u, width, w)));
+        __m128 my = _mm_add_ps(py, _mm_mul_ps(halfDty, sampleSse41(v, width, w)));
+        bilinearSse41(w, mx, my, width, height);
+        px = _mm_add_ps(px, _mm_mul_ps(vDtx, sampleSse41(u, width, w)));
+        py = _mm_add_ps(py, _mm_mul_ps(vDty, sampleSse41(v, width, w)));
+        _mm_storeu_ps(x + k, _mm_min_ps(_mm_max_ps(px, lo), maxX));
+        _mm_storeu_ps(y + k, _mm_min_ps(_mm_max_ps(py, lo), maxY));
+    }
+    advectParticlesTail(x, y, u, v, k, count, width, height, dtx, dty);
+}
+
+// SSE4.1 has no half conversion instructions
+void halfToFloatRowSse41(float* out, const Half* in, int count) {
+    halfToFloatTail(out, in, 0, count);
+}
+
+void floatToHalfRowSse41(Half* out, const float* in, int count) {
+    floatToHalfTail(out, in, 0, count);
+}
+
+// ------------------------------------------------------------------ AVX2
+
+FLUID_TARGET("avx2,fma")
+void relaxRowAvx2(float* x, const float* x0, const float* up, const float* down,
+                  int count, int parity, float a, float invC) {
+    const __m256 va = _mm256_set1_ps(a);
+    const __m256 vInvC = _mm256_set1_ps(invC);
+    const __m256i mask = parity == 0 ? _mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0)
+                                     : _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+    int k = 0;
+    if (count >= 8) {
+        __m256 left = _mm256_loadu_ps(x - 1);
+        __m256 right = _mm256_loadu_ps(x + 1);
+        __m256 vert = _mm256_add_ps(_mm256_loadu_ps(up), _mm256_loadu_ps(down));
+        __m256 src = _mm256_loadu_ps(x0);
+        for (;;) {
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(left, right), vert);
+            __m256 r = _mm256_mul_ps(_mm256_fmadd_ps(va, sum, src), vInvC);
+            bool more = k + 16 <= count;
+            if (more) {
+                left = _mm256_loadu_ps(x + k + 7);
+                right = _mm256_loadu_ps(x + k + 9);
+                vert = _mm256_add_ps(_mm256_loadu_ps(up + k + 8), _mm256_loadu_ps(down + k + 8));
+                src = _mm256_loadu_ps(x0 + k + 8);
+            }
+            _mm256_maskstore_ps(x + k, mask, r);
+            k += 8;
+            if (!more) break;
+        }
+    }
+    relaxTail(x, x0, up, down, k, count, parity, a, invC);
+}
+
+FLUID_TARGET("avx2,fma")
+void divergenceRowAvx2(float* div, const float* u, const float* vUp, const float* vDown,
+                       int count, float scale) {
+    const __m256 vScale = _mm256_set1_ps(scale);
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 du = _mm256_sub_ps(_mm256_loadu_ps(u + k + 1), _mm256_loadu_ps(u + k - 1));
+        __m256 dv = _mm256_sub_ps(_mm256_loadu_ps(vDown + k), _mm256_loadu_ps(vUp + k));
+        _mm256_storeu_ps(div + k, _mm256_mul_ps(vScale, _mm256_add_ps(du, dv)));
+    }
+    divergenceTail(div, u, vUp, vDown, k, count, scale);
+}
+
+FLUID_TARGET("avx2,fma")
+void gradientRowAvx2(float* u, float* v, const float* p, const float* pUp, const float* pDown,
+                     int count, float scale) {
+    const __m256 vScale = _mm256_set1_ps(scale);
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 dpx = _mm256_sub_ps(_mm256_loadu_ps(p + k + 1), _mm256_loadu_ps(p + k - 1));
+        __m256 dpy = _mm256_sub_ps(_mm256_loadu_ps(pDown + k), _mm256_loadu_ps(pUp + k));
+        _mm256_storeu_ps(u + k, _mm256_fnmadd_ps(vScale, dpx, _mm256_loadu_ps(u + k)));
+        _mm256_storeu_ps(v + k, _mm256_fnmadd_ps(vScale, dpy, _mm256_loadu_ps(v + k)));
+    }
+    gradientTail(u, v, p, pUp, pDown, k, count, scale);
+}
+
+struct Bilinear8 {
+    __m256i idx;
+    __m256 s0, s1, t0, t1;
+};
+
+FLUID_TARGET("avx2,fma")
+inline void bilinearAvx2(Bilinear8& w, __m256 x, __m256 y, int width, int height) {
+    const __m256 lo = _mm256_set1_ps(0.5f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    x = _mm256_min_ps(_mm256_max_ps(x, lo), _mm256_set1_ps(width - 1.5f));
+    y = _mm256_min_ps(_mm256_max_ps(y, lo), _mm256_set1_ps(height - 1.5f));
+
+    __m256 i0 = _mm256_floor_ps(x);
+    __m256 j0 = _mm256_floor_ps(y);
+    w.s1 = _mm256_sub_ps(x, i0);
+    w.s0 = _mm256_sub_ps(one, w.s1);
+    w.t1 = _mm256_sub_ps(y, j0);
+    w.t0 = _mm256_sub_ps(one, w.t1);
+    w.idx = _mm256_add_epi32(_mm256_cvttps_epi32(i0),
+                             _mm256_mullo_epi32(_mm256_cvttps_epi32(j0), _mm256_set1_epi32(width)));
+}
+
+FLUID_TARGET("avx2,fma")
+inline __m256 sampleAvx2(const float* field, int width, const Bilinear8& w) {
+    const __m256i right = _mm256_set1_epi32(1);
+    __m256i below = _mm256_add_epi32(w.idx, _mm256_set1_epi32(width));
+    __m256 d00 = _mm256_i32gather_ps(field, w.idx, 4);
+    __m256 d10 = _mm256_i32gather_ps(field, _mm256_add_epi32(w.idx, right), 4);
+    __m256 d01 = _mm256_i32gather_ps(field, below, 4);
+    __m256 d11 = _mm256_i32gather_ps(field, _mm256_add_epi32(below, right), 4);
+
+    __m256 leftCol = _mm256_fmadd_ps(w.t0, d00, _mm256_mul_ps(w.t1, d01));
+    __m256 rightCol = _mm256_fmadd_ps(w.t0, d10, _mm256_mul_ps(w.t1, d11));
+    return _mm256_fmadd_ps(w.s0, leftCol, _mm256_mul_ps(w.s1, rightCol));
+}
+
+FLUID_TARGET("avx2,fma")
+void advectRowAvx2(float* d, const float* d0, const float* u, const float* v,
+                   int i, int j, int count, int width, int height, float dtx, float dty) {
+    const __m256 vDtx = _mm256_set1_ps(dtx);
+    const __m256 vDty = _mm256_set1_ps(dty);
+    const __m256 row = _mm256_set1_ps(static_cast<float>(j));
+    __m256 col = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)),
+                               _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+    const __m256 step = _mm256_set1_ps(8.0f);
+
+    Bilinear8 w;
+    int k = 0;
+    for (; k + 8 <= count; k += 8, col = _mm256_add_ps(col, step)) {
+        __m256 x = _mm256_fnmadd_ps(vDtx, _mm256_loadu_ps(u + k), col);
+        __m256 y = _mm256_fnmadd_ps(vDty, _mm256_loadu_ps(v + k), row);
+        bilinearAvx2(w, x, y, width, height);
+        _mm256_storeu_ps(d + k, sampleAvx2(d0, width, w));
+    }
+    advectTail(d, d0, u, v, k, i, j, count, width, height, dtx, dty);
+}
+
+FLUID_TARGET("avx2,fma")
+void advectParticlesAvx2(float* x, float* y, const float* u, const float* v,
+                         int count, int width, int height, float dtx, float dty) {
+    const __m256 vDtx = _mm256_set1_ps(dtx);
+    const __m256 vDty = _mm256_set1_ps(dty);
+    const __m256 halfDtx = _mm256_set1_ps(0.5f * dtx);
+    const __m256 halfDty = _mm256_set1_ps(0.5f * dty);
+    const __m256 lo = _mm256_set1_ps(0.5f);
+    const __m256 maxX = _mm256_set1_ps(width - 1.5f);
+    const __m256 maxY = _mm256_set1_ps(height - 1.5f);
+
+    Bilinear8 w;
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 px = _mm256_loadu_ps(x + k);
+        __m256 py = _mm256_loadu_ps(y + k);
+        bilinearAvx2(w, px, py, width, height);
+        __m256 mx = _mm256_fmadd_ps(halfDtx, sampleAvx2(u, width, w), px);
+        __m256 my = _mm256_fmadd_ps(halfDty, sampleAvx2(v, width, w), py);
+        bilinearAvx2(w, mx, my, width, height);
+        px = _mm256_fmadd_ps(vDtx, sampleAvx2(u, width, w), px);
+        py = _mm256_fmadd_ps(vDty, sampleAvx2(v, width, w), py);
+        _mm256_storeu_ps(x + k, _mm256_min_ps(_mm256_max_ps(px, lo), maxX));
+        _mm256_storeu_ps(y + k, _mm256_min_ps(_mm256_max_ps(py, lo), maxY));
+    }
+    advectParticlesTail(x, y, u, v, k, count, width, height, dtx, dty);
+}
+
+// F16C ships with every AVX2 CPU and is checked alongside it
+FLUID_TARGET("avx2,f16c")
+void halfToFloatRowAvx2(float* out, const Half* in, int count) {
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k));
+        _mm256_storeu_ps(out + k, _mm256_cvtph_ps(h));
+    }
+    halfToFloatTail(out, in, k, count);
+}
+
+FLUID_TARGET("avx2,f16c")
+void floatToHalfRowAvx2(Half* out, const float* in, int count) {
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), h);
+    }
+    floatToHalfTail(out, in, k, count);
+}
+
+// --------------------------------------------------------------- AVX-512
+
+FLUID_TARGET("avx512f")
+void relaxRowAvx512(float* x, const float* x0, const float* up, const float* down,
+                    int count, int parity, float a, float invC) {
+    const __m512 va = _mm512_set1_ps(a);
+    const __m512 vInvC = _mm512_set1_ps(invC);
+    const __mmask16 mask = parity == 0 ? 0x5555 : 0xAAAA;
+    int k = 0;
+    if (count >= 16) {
+        __m512 left = _mm512_loadu_ps(x - 1);
+        __m512 right = _mm512_loadu_ps(x + 1);
+        __m512 vert = _mm512_add_ps(_mm512_loadu_ps(up), _mm512_loadu_ps(down));
+        __m512 src = _mm512_loadu_ps(x0);
+        for (;;) {
+            __m512 sum = _mm512_add_ps(_mm512_add_ps(left, right), vert);
+            __m512 r = _mm512_mul_ps(_mm512_fmadd_ps(va, sum, src), vInvC);
+            bool more = k + 32 <= count;
+            if (more) {
+                left = _mm512_loadu_ps(x + k + 15);
+                right = _mm512_loadu_ps(x + k + 17);
+                vert = _mm512_add_ps(_mm512_loadu_ps(up + k + 16), _mm512_loadu_ps(down + k + 16));
+                src = _mm512_loadu_ps(x0 + k + 16);
+            }
+            _mm512_mask_storeu_ps(x + k, mask, r);
+            k += 16;
+            if (!more) break;
+        }
+    }
+    relaxTail(x, x0, up, down, k, count, parity, a, invC);
+}
+
+FLUID_TARGET("avx512f")
+void divergenceRowAvx512(float* div, const float* u, const float* vUp, const float* vDown,
+                         int count, float scale) {
+    const __m512 vScale = _mm512_set1_ps(scale);
+    int k = 0;
+    for (; k + 16 <= count; k += 16) {
+        __m512 du = _mm512_sub_ps(_mm512_loadu_ps(u + k + 1), _mm512_loadu_ps(u + k - 1));
+        __m512 dv = _mm512_sub_ps(_mm512_loadu_ps(vDown + k), _mm512_loadu_ps(vUp + k));
+        _mm512_storeu_ps(div + k, _mm512_mul_ps(vScale, _mm512_add_ps(du, dv)));
+    }
+    divergenceTail(div, u, vUp, vDown, k, count, scale);
+}
+
+FLUID_TARGET("avx512f")
+void gradientRowAvx512(float* u, float* v, const float* p, const float* pUp, const float* pDown,
+                       int count, float scale) {
+    const __m512 vScale = _mm512_set1_ps(scale);
+    int k = 0;
+    for (; k + 16 <= count; k += 16) {
+        __m512 dpx = _mm512_sub_ps(_mm512_loadu_ps(p + k + 1), _mm512_loadu_ps(p + k - 1));
+        __m512 dpy = _mm512_sub_ps(_mm512_loadu_ps(pDown + k), _mm512_loadu_ps(pUp + k));
+        _mm512_storeu_ps(u + k, _mm512_fnmadd_ps(vScale, dpx, _mm512_loadu_ps(u + k)));
+        _mm512_storeu_ps(v + k, _mm512_fnmadd_ps(vScale, dpy, _mm512_loadu_ps(v + k)));
+    }
+    gradientTail(u, v, p, pUp, pDown, k, count, scale);
+}
+
+struct Bilinear16 {
+    __m512i idx;
+    __m512 s0, s1, t0, t1;
+};
+
+FLUID_TARGET("avx512f")
+inline void bilinearAvx512(Bilinear16& w, __m512 x, __m512 y, int width, int height) {
+    const __m512 lo = _mm512_set1_ps(0.5f);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    x = _mm512_min_ps(_mm512_max_ps(x, lo), _mm512_set1_ps(width - 1.5f));
+    y = _mm512_min_ps(_mm512_max_ps(y, lo), _mm512_set1_ps(height - 1.5f));
+
+    __m512 i0 = _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __m512 j0 = _mm512_roundscale_ps(y, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    w.s1 = _mm512_sub_ps(x, i0);
+    w.s0 = _mm512_sub_ps(one, w.s1);
+    w.t1 = _mm512_sub_ps(y, j0);
+    w.t0 = _mm512_sub_ps(one, w.t1);
+    w.idx = _mm512_add_epi32(_mm512_cvttps_epi32(i0),
+                             _mm512_mullo_epi32(_mm512_cvttps_epi32(j0), _mm512_set1_epi32(width)));
+}
+
+FLUID_TARGET("avx512f")
+inline __m512 sampleAvx512(const float* field, int width, const Bilinear16& w) {
+    const __m512i right = _mm512_set1_epi32(1);
+    __m512i below = _mm512_add_epi32(w.idx, _mm512_set1_epi32(width));
+    __m512 d00 = _mm512_i32gather_ps(w.idx, field, 4);
+    __m512 d10 = _mm512_i32gather_ps(_mm512_add_epi32(w.idx, right), field, 4);
+    __m512 d01 = _mm512_i32gather_ps(below, field, 4);
+    __m512 d11 = _mm512_i32gather_ps(_mm512_add_epi32(below, right), field, 4);
+
+    __m512 leftCol = _mm512_fmadd_ps(w.t0, d00, _mm512_mul_ps(w.t1, d01));
+    __m512 rightCol = _mm512_fmadd_ps(w.t0, d10, _mm512_mul_ps(w.t1, d11));
+    return _mm512_fmadd_ps(w.s0, leftCol, _mm512_mul_ps(w.s1, rightCol));
+}
+
+FLUID_TARGET("avx512f")
+void advectRowAvx512(float* d, const float* d0, const float* u, const float* v,
+                     int i, int j, int count, int width, int height, float dtx, float dty) {
+    const __m512 vDtx = _mm512_set1_ps(dtx);
+    const __m512 vDty = _mm512_set1_ps(dty);
+    const __m512 row = _mm512_set1_ps(static_cast<float>(j));
+    __m512 col = _mm512_add_ps(_mm512_set1_ps(static_cast<float>(i)),
+                               _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+                                              8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f));
+    const __m512 step = _mm512_set1_ps(16.0f);
+
+    Bilinear16 w;
+    int k = 0;
+    for (; k + 16 <= count; k += 16, col = _mm512_add_ps(col, step)) {
+        __m512 x = _mm512_fnmadd_ps(vDtx, _mm512_loadu_ps(u + k), col);
+        __m512 y = _mm512_fnmadd_ps(vDty, _mm512_loadu_ps(v + k), row);
+        bilinearAvx512(w, x, y, width, height);
+        _mm512_storeu_ps(d + k, sampleAvx512(d0, width, w));
+    }
+    advectTail(d, d0, u, v, k, i, j, count, width, height, dtx, dty);
+}
+
+FLUID_TARGET("avx512f")
+void advectParticlesAvx512(float* x, float* y, const float* u, const float* v,
+                           int count, int width, int height, float dtx, float dty) {
+    const __m512 vDtx = _mm512_set1_ps(dtx);
+    const __m512 vDty = _mm512_set1_ps(dty);
+    const __m512 halfDtx = _mm512_set1_ps(0.5f * dtx);
+    const __m512 halfDty = _mm512_set1_ps(0.5f * dty);
+    const __m512 lo = _mm512_set1_ps(0.5f);
+    const __m512 maxX = _mm512_set1_ps(width - 1.5f);
+    const __m512 maxY = _mm512_set1_ps(height - 1.5f);
+
+    Bilinear16 w;
+    int k = 0;
+    for (; k + 16 <= count; k += 16) {
+        __m512 px = _mm512_loadu_ps(x + k);
+        __m512 py = _mm512_loadu_ps(y + k);
+        bilinearAvx512(w, px, py, width, height);
+        __m512 mx = _mm512_fmadd_ps(halfDtx, sampleAvx512(u, width, w), px);
+        __m512 my = _mm512_fmadd_ps(halfDty, sampleAvx512(v, width, w), py);
+        bilinearAvx512(w, mx, my, width, height);
+        px = _mm512_fmadd_ps(vDtx, sampleAvx512(u, width, w), px);
+        py = _mm512_fmadd_ps(vDty, sampleAvx512(v, width, w), py);
+        _mm512_storeu_ps(x + k, _mm512_min_ps(_mm512_max_ps(px, lo), maxX));
+        _mm512_storeu_ps(y + k, _mm512_min_ps(_mm512_max_ps(py, lo), maxY));
+    }
+    advectParticlesTail(x, y, u, v, k, count, width, height, dtx, dty);
+}
+
+FLUID_TARGET("avx512f")
+void halfToFloatRowAvx512(float* out, const Half* in, int count) {
+    int k = 0;
+    for (; k + 16 <= count; k += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + k));
+        _mm512_storeu_ps(out + k, _mm512_cvtph_ps(h));
+    }
+    halfToFloatTail(out, in, k, count);
+}
+
+FLUID_TARGET("avx512f")
+void floatToHalfRowAvx512(Half* out, const float* in, int count) {
+    int k = 0;
+    for (; k + 16 <= count; k += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), h);
+    }
+    floatToHalfTail(out, in, k, count);
+}
+
+}  // namespace
+
+const RowKernels& kernels::sse41() {
+    static const RowKernels table = {
+        SimdLevel::SSE41, relaxRowSse41, divergenceRowSse41, gradientRowSse41, advectRowSse41,
+        advectParticlesSse41, halfToFloatRowSse41, floatToHalfRowSse41
+    };
+    return table;
+}
+
+const RowKernels& kernels::avx2() {
+    static const RowKernels table = {
+        SimdLevel::AVX2, relaxRowAvx2, divergenceRowAvx2, gradientRowAvx2, advectRowAvx2,
+        advectParticlesAvx2, halfToFloatRowAvx2, floatToHalfRowAvx2
+    };
+    return table;
+}
+
+const RowKernels& kernels::avx512() {
+    static const RowKernels table = {
+        SimdLevel::AVX512, relaxRowAvx512, divergenceRowAvx512, gradientRowAvx512, advectRowAvx512,
+        advectParticlesAvx512, halfToFloatRowAvx512, floatToHalfRowAvx512
+    };
+    return table;
+}
+
+#endif  // FLUID_HAVE_X86_KERNELS
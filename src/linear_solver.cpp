@@ -0,0 +1,348 @@
+#include "linear_solver.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <mutex>
+
+namespace {
+
+// Relaxation checks the residual every few sweeps when a tolerance is set
+constexpr int RESIDUAL_CHECK_INTERVAL = 4;
+
+// Multigrid shape: smoothing sweeps per level, sweeps on the coarsest level,
+// and the smallest interior dimension that is still coarsened
+constexpr int PRE_SMOOTH = 2;
+constexpr int POST_SMOOTH = 2;
+constexpr int COARSEST_SWEEPS = 40;
+constexpr int MIN_COARSEN_SIZE = 8;
+constexpr int MAX_LEVELS = 24;
+
+bool hasTolerance(const SolverSettings& settings) {
+    return settings.tolerance > 0 || settings.absoluteTolerance > 0;
+}
+
+bool converged(double residual, double rhsNorm, const SolverSettings& settings) {
+    return residual <= settings.absoluteTolerance || residual <= settings.tolerance * rhsNorm;
+}
+
+// Pure Neumann problems (pressure) are singular; their right hand side must
+// have zero mean for Krylov and multigrid methods to converge
+bool isSingular(int b, float a, float c) {
+    return b == 0 && std::fabs(c - 4 * a) <= 1e-6f * c;
+}
+
+size_t fieldSize(const GridContext& grid) {
+    return static_cast<size_t>(grid.width) * grid.height;
+}
+
+// Writes the mean-free rhs to out and returns out
+const float* removeMean(const GridContext& grid, const float* rhs, float* out) {
+    double sum = grid.sumRows([&](int rowBegin, int rowEnd) {
+        double partial = 0;
+        for (int j = rowBegin; j < rowEnd; j++) {
+            for (int i = 1; i < grid.width - 1; i++) partial += rhs[grid.IX(i, j)];
+        }
+        return partial;
+    });
+    float mean = static_cast<float>(sum / grid.interiorCells());
+    grid.forRows([&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            for (int i = 1; i < grid.width - 1; i++) out[grid.IX(i, j)] = rhs[grid.IX(i, j)] - mean;
+        }
+    });
+    return out;
+}
+
+class RelaxationSolver : public LinearSolver {
+public:
+    SolverType type() const override { return SolverType::Relaxation; }
+
+    SolveStats solve(const GridContext& grid, int b, float* x, const float* rhs,
+                     float a, float c, const SolverSettings& settings) override {
+        SolveStats stats;
+        bool checking = hasTolerance(settings);
+        double rhsNorm = checking ? grid.norm(rhs) : 0;
+        // Sweeps between residual checks run as one batch so they can share
+        // wavefront passes
+        while (stats.iterations < settings.maxIterations) {
+            int sweeps = settings.maxIterations - stats.iterations;
+            if (checking) {
+                if (converged(grid.residual(nullptr, x, rhs, a, c), rhsNorm, settings)) break;
+                sweeps = std::min(sweeps, RESIDUAL_CHECK_INTERVAL);
+            }
+            grid.relaxSweeps(b, x, rhs, a, c, sweeps);
+            stats.iterations += sweeps;
+        }
+        if (checking || settings.measureResidual) {
+            stats.residual = static_cast<float>(grid.residual(nullptr, x, rhs, a, c));
+        }
+        return stats;
+    }
+};
+
+class MultigridSolver : public LinearSolver {
+public:
+    SolverType type() const override { return SolverType::Multigrid; }
+
+    SolveStats solve(const GridContext& grid, int b, float* x, const float* rhs,
+                     float a, float c, const SolverSettings& settings) override {
+        Workspace::Scope scratch(*grid.workspace);
+        buildLevels(grid);
+        if (isSingular(b, a, c)) {
+            rhs = removeMean(grid, rhs, grid.workspace->allocateFloats(fieldSize(grid)));
+        }
+
+        SolveStats stats;
+        bool checking = hasTolerance(settings);
+        double rhsNorm = checking ? grid.norm(rhs) : 0;
+        for (int k = 0; k < settings.maxIterations; k++) {
+            if (checking && converged(grid.residual(nullptr, x, rhs, a, c), rhsNorm, settings)) break;
+            vcycle(0, b, x, rhs, a, c);
+            stats.iterations++;
+        }
+        if (checking || settings.measureResidual) {
+            stats.residual = static_cast<float>(grid.residual(nullptr, x, rhs, a, c));
+        }
+        return stats;
+    }
+
+private:
+    // Level 0 is the caller's grid, whose x and rhs are the solve's own
+    struct Level {
+        GridContext grid;
+        float* x;
+        float* rhs;
+        float* r;
+    };
+
+    std::array<Level, MAX_LEVELS> levels;
+    size_t levelCount = 0;
+
+    // Carves the level buffers from the workspace for one solve
+    void buildLevels(const GridContext& grid) {
+        Workspace& workspace = *grid.workspace;
+        levelCount = 0;
+        int nx = grid.width - 2;
+        int ny = grid.height - 2;
+        for (;;) {
+            Level& level = levels[levelCount];
+            level.grid = grid.resized(nx + 2, ny + 2);
+            size_t size = fieldSize(level.grid);
+            level.r = workspace.allocateFloats(size);
+            level.x = levelCount > 0 ? workspace.allocateFloats(size) : nullptr;
+            level.rhs = levelCount > 0 ? workspace.allocateFloats(size) : nullptr;
+            levelCount++;
+            if (std::min(nx, ny) < MIN_COARSEN_SIZE || levelCount == MAX_LEVELS) break;
+            // Odd sizes are padded by one cell (see restrictResidual)
+            nx = (nx + 1) / 2;
+            ny = (ny + 1) / 2;
+        }
+    }
+
+    void vcycle(size_t l, int b, float* x, const float* rhs, float a, float c) {
+        const GridContext& grid = levels[l].grid;
+        if (l + 1 == levelCount) {
+            grid.relaxSweeps(b, x, rhs, a, c, COARSEST_SWEEPS);
+            return;
+        }
+
+        grid.relaxSweeps(b, x, rhs, a, c, PRE_SMOOTH);
+        grid.residual(levels[l].r, x, rhs, a, c);
+
+        // The error equation on a grid with twice the spacing has a quarter of
+        // the neighbour coupling and the same identity term (c - 4a)
+        Level& coarse = levels[l + 1];
+        restrictResidual(levels[l], coarse);
+        // A singular coarse problem is only solvable for a mean-free right
+        // hand side, which restriction does not preserve on padded levels
+        if (isSingular(b, a, c)) removeMean(coarse.grid, coarse.rhs, coarse.rhs);
+        std::fill(coarse.x, coarse.x + fieldSize(coarse.grid), 0.0f);
+        vcycle(l + 1, b, coarse.x, coarse.rhs, 0.25f * a, c - 3 * a);
+
+        prolongAdd(coarse, grid, x);
+        grid.setBnd(b, x);
+        grid.relaxSweeps(b, x, rhs, a, c, POST_SMOOTH);
+    }
+
+    // Each coarse cell averages the 2x2 fine residuals it covers. An odd
+    // fine dimension is padded to even with cells of zero residual, so every
+    // coarse cell spans exactly two fine cells and the coarse operator and
+    // prolongation can assume uniform 2:1 spacing.
+    static void restrictResidual(const Level& fine, Level& coarse) {
+        const GridContext& fg = fine.grid;
+        const GridContext& cg = coarse.grid;
+        int nx = fg.width - 2;
+        int ny = fg.height - 2;
+        cg.forRows([&](int rowBegin, int rowEnd) {
+            for (int J = rowBegin; J < rowEnd; J++) {
+                int j0 = 2 * J - 1;
+                int j1 = std::min(2 * J, ny);
+                for (int I = 1; I < cg.width - 1; I++) {
+                    int i0 = 2 * I - 1;
+                    int i1 = std::min(2 * I, nx);
+                    float sum = 0;
+                    for (int j = j0; j <= j1; j++) {
+                        for (int i = i0; i <= i1; i++) sum += fine.r[fg.IX(i, j)];
+                    }
+                    coarse.rhs[cg.IX(I, J)] = 0.25f * sum;
+                }
+            }
+        });
+    }
+
+    // Bilinear interpolation of the coarse correction onto the fine cells;
+    // the padding cells of an odd dimension are never written
+    static void prolongAdd(const Level& coarse, const GridContext& fg, float* x) {
+        const GridContext& cg = coarse.grid;
+        const float* e = coarse.x;
+        fg.forRows([&](int rowBegin, int rowEnd) {
+            for (int j = rowBegin; j < rowEnd; j++) {
+                int J = (j + 1) / 2;
+                int dJ = (j & 1) ? -1 : 1;
+                for (int i = 1; i < fg.width - 1; i++) {
+                    int I = (i + 1) / 2;
+                    int dI = (i & 1) ? -1 : 1;
+                    x[fg.IX(i, j)] += 0.5625f * e[cg.IX(I, J)] +
+                                      0.1875f * (e[cg.IX(I + dI, J)] + e[cg.IX(I, J + dJ)]) +
+                                      0.0625f * e[cg.IX(I + dI, J + dJ)];
+                }
+            }
+        });
+    }
+};
+
+class ConjugateGradientSolver : public LinearSolver {
+public:
+    SolverType type() const override { return SolverType::ConjugateGradient; }
+
+    SolveStats solve(const GridContext& grid, int b, float* x, const float* rhs,
+                     float a, float c, const SolverSettings& settings) override {
+        Workspace& workspace = *grid.workspace;
+        Workspace::Scope scratch(workspace);
+        size_t size = fieldSize(grid);
+        float* r = workspace.allocateFloats(size);
+        float* z = workspace.allocateFloats(size);
+        float* p = workspace.allocateFloats(size);
+        float* q = workspace.allocateFloats(size);
+        std::fill(p, p + size, 0.0f);
+        if (isSingular(b, a, c)) rhs = removeMean(grid, rhs, workspace.allocateFloats(size));
+
+        const int w = grid.width;
+        // Ghost cells mirror their interior neighbour with sign s, which folds
+        // into the diagonal of the cells along the boundary
+        const float sideSign = b == 1 ? -1.0f : 1.0f;
+        const float capSign = b == 2 ? -1.0f : 1.0f;
+
+        auto precondition = [&](int j) {
+            float rowDiag = c;
+            if (j == 1) rowDiag -= a * capSign;
+            if (j == grid.height - 2) rowDiag -= a * capSign;
+            float* zr = &z[grid.IX(1, j)];
+            const float* rr = &r[grid.IX(1, j)];
+            float inv = 1.0f / rowDiag;
+            for (int i = 0; i < w - 2; i++) zr[i] = rr[i] * inv;
+            float endDiag = rowDiag - a * sideSign;
+            if (w == 3) {
+                zr[0] = rr[0] / (endDiag - a * sideSign);
+            } else {
+                zr[0] = rr[0] / endDiag;
+                zr[w - 3] = rr[w - 3] / endDiag;
+            }
+        };
+
+        SolveStats stats;
+        bool checking = hasTolerance(settings);
+        double rhsNorm = checking ? grid.norm(rhs) : 0;
+        double residual = grid.residual(r, x, rhs, a, c);
+
+        double rz = grid.sumRows([&](int rowBegin, int rowEnd) {
+            double partial = 0;
+            for (int j = rowBegin; j < rowEnd; j++) {
+                precondition(j);
+                int row = grid.IX(1, j);
+                for (int i = 0; i < w - 2; i++) {
+                    p[row + i] = z[row + i];
+                    partial += static_cast<double>(r[row + i]) * z[row + i];
+                }
+            }
+            return partial;
+        });
+
+        for (int k = 0; k < settings.maxIterations; k++) {
+            if (checking && converged(residual, rhsNorm, settings)) break;
+
+            grid.setBnd(b, p);
+            double pq = grid.sumRows([&](int rowBegin, int rowEnd) {
+                double partial = 0;
+                for (int j = rowBegin; j < rowEnd; j++) {
+                    int row = grid.IX(1, j);
+                    for (int i = row; i < row + w - 2; i++) {
+                        q[i] = c * p[i] - a * (p[i - 1] + p[i + 1] + p[i - w] + p[i + w]);
+                        partial += static_cast<double>(p[i]) * q[i];
+                    }
+                }
+                return partial;
+            });
+            if (pq <= 0) break;
+
+            float alpha = static_cast<float>(rz / pq);
+            std::mutex rrMutex;
+            double rr = 0;
+            double rzNext = grid.sumRows([&](int rowBegin, int rowEnd) {
+                double partialRz = 0;
+                double partialRr = 0;
+                for (int j = rowBegin; j < rowEnd; j++) {
+                    int row = grid.IX(1, j);
+                    for (int i = row; i < row + w - 2; i++) {
+                        x[i] += alpha * p[i];
+                        r[i] -= alpha * q[i];
+                    }
+                    precondition(j);
+                    for (int i = row; i < row + w - 2; i++) {
+                        partialRz += static_cast<double>(r[i]) * z[i];
+                        partialRr += static_cast<double>(r[i]) * r[i];
+                    }
+                }
+                std::lock_guard<std::mutex> lock(rrMutex);
+                rr += partialRr;
+                return partialRz;
+            });
+            residual = std::sqrt(rr / grid.interiorCells());
+            stats.iterations++;
+
+            float beta = static_cast<float>(rzNext / rz);
+            rz = rzNext;
+            grid.forRows([&](int rowBegin, int rowEnd) {
+                for (int j = rowBegin; j < rowEnd; j++) {
+                    int row = grid.IX(1, j);
+                    for (int i = row; i < row + w - 2; i++) p[i] = z[i] + beta * p[i];
+                }
+            });
+        }
+
+        grid.setBnd(b, x);
+        if (checking || settings.measureResidual) {
+            stats.residual = static_cast<float>(grid.residual(nullptr, x, rhs, a, c));
+        }
+        return stats;
+    }
+};
+
+}  // namespace
+
+const char* solverTypeName(SolverType type) {
+    switch (type) {
+        case SolverType::Relaxation: return "relaxation";
+        case SolverType::Multigrid: return "multigrid";
+        case SolverType::ConjugateGradient: return "cg";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<LinearSolver> makeSolver(SolverType type) {
+    switch (type) {
+        case SolverType::Multigrid: return std::make_unique<MultigridSolver>();
+        case SolverType::ConjugateGradient: return std::make_unique<ConjugateGradientSolver>();
+        default: return std::make_unique<RelaxationSolver>();
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "grid.hpp"
+
+enum class SolverType {
+    Relaxation,         // fixed or residual-terminated Gauss-Seidel sweeps
+    Multigrid,          // geometric multigrid V-cycles
+    ConjugateGradient   // Jacobi-preconditioned conjugate gradient
+};
+
+const char* solverTypeName(SolverType type);
+
+struct SolverSettings {
+    int maxIterations = 20;        // sweeps, V-cycles or CG iterations
+    float tolerance = 0;           // stop once RMS residual <= tolerance * RMS(rhs); 0 disables
+    float absoluteTolerance = 0;   // ... or once RMS residual <= absoluteTolerance
+    bool warmStart = false;        // start from the previous solution instead of a cold guess
+    bool measureResidual = false;  // report the final residual even when no tolerance is set
+};
+
+struct SolveStats {
+    int iterations = 0;
+    float residual = -1;  // RMS residual after the solve, -1 when not measured
+};
+
+// Solves c * x - a * (sum of 4 neighbours) = rhs in place. x holds the
+// initial guess on entry and has its boundary set on return.
+class LinearSolver {
+public:
+    virtual ~LinearSolver() = default;
+
+    virtual SolverType type() const = 0;
+    virtual SolveStats solve(const GridContext& grid, int b, float* x, const float* rhs,
+                             float a, float c, const SolverSettings& settings) = 0;
+};
+
+std::unique_ptr<LinearSolver> makeSolver(SolverType type);
@@ -1,10 +1,16 @@
 #include <SDL2/SDL.h>
+#include <algorithm>
 #include <iostream>
 #include "fluid.hpp"
+#include "renderer.hpp"
+#include "sim_thread.hpp"
 #include "UI.hpp"
 #include <string>
 #include <array>
-#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
@@ -13,9 +19,21 @@ const int SIMULATION_HEIGHT = 200;
 
 enum class Tool {
     Fluid,
-    Explosion
+    Explosion,
+    Emitter,   // particle tools, available with --particles
+    Collector
 };
 
+const char* toolName(Tool tool) {
+    switch (tool) {
+        case Tool::Fluid: return "Fluid";
+        case Tool::Explosion: return "Explosion";
+        case Tool::Emitter: return "Emitter";
+        case Tool::Collector: return "Collector";
+    }
+    return "";
+}
+
 typedef struct {
     std::string name;
     int r;
@@ -44,6 +62,52 @@ int main(int argc, char* argv[]) {
     Color currentDrawColor = colors[currentColorIdx];
     Tool currentTool = Tool::Fluid;
     bool showHelp = false;
+    bool showProfile = false;
+
+    // --record PATH captures the run for offline analysis (see recorder.hpp)
+    std::string recordPath;
+    RecorderSettings recordSettings;
+    // --profile-csv / --profile-json PATH append the per-phase percentiles
+    // every PROFILE_INTERVAL for dashboards
+    std::string profileCsvPath;
+    std::string profileJsonPath;
+    // --budget-ms MS scales the grid to keep each step within MS (see resolution.hpp)
+    double budgetMs = 0;
+    // --particles N adds up to N tracer particles, half of them seeded over
+    // the grid, and the emitter and collector tools (see particles.hpp)
+    int particleCapacity = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--record" && hasValue) {
+            recordPath = argv[++i];
+        } else if (arg == "--record-every" && hasValue) {
+            recordSettings.decimation = std::atoi(argv[++i]);
+        } else if (arg == "--record-ppm" && hasValue) {
+            recordSettings.ppmDirectory = argv[++i];
+        } else if (arg == "--record-block") {
+            recordSettings.backpressure = Backpressure::Block;
+        } else if (arg == "--profile-csv" && hasValue) {
+            profileCsvPath = argv[++i];
+        } else if (arg == "--profile-json" && hasValue) {
+            profileJsonPath = argv[++i];
+        } else if (arg == "--budget-ms" && hasValue) {
+            budgetMs = std::atof(argv[++i]);
+        } else if (arg == "--particles" && hasValue) {
+            particleCapacity = std::max(0, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--record PATH] [--record-every N] [--record-ppm DIR] [--record-block]"
+                      << " [--profile-csv PATH] [--profile-json PATH] [--budget-ms MS] [--particles N]" << std::endl;
+            return 1;
+        }
+    }
+    // Recordings have one grid size, so every frame after the first resize
+    // would be dropped
+    if (!recordPath.empty() && budgetMs > 0) {
+        std::cerr << "--record cannot be combined with --budget-ms" << std::endl;
+        return 1;
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
@@ -90,12 +154,79 @@ int main(int argc, char* argv[]) {
 
     // Set up fluid simulation
     FluidSimulation fluid(SIMULATION_WIDTH, SIMULATION_HEIGHT, 0.0000001f, 0.0000001f, 0.016f);
+    FluidRenderer fluidRenderer(renderer);
+
+    // Times this thread's render and text drawing; the solver's own
+    // profiler reports through the published frames
+    Profiler uiProfiler;
+    fluidRenderer.setProfiler(&uiProfiler);
+    ui.setProfiler(&uiProfiler);
+
+    std::ofstream profileCsv;
+    std::ofstream profileJson;
+    if (!profileCsvPath.empty()) {
+        profileCsv.open(profileCsvPath, std::ios::trunc);
+        writeProfileCsvHeader(profileCsv);
+    }
+    if (!profileJsonPath.empty()) profileJson.open(profileJsonPath, std::ios::trunc);
+    const bool exportProfile = profileCsv.is_open() || profileJson.is_open();
+    if ((!profileCsvPath.empty() && !profileCsv) || (!profileJsonPath.empty() && !profileJson)) {
+        std::cerr << "Failed to create profile export" << std::endl;
+    }
+
+    // The solver steps on its own thread at a fixed rate; this thread only
+    // forwards input and draws the latest finished frame
+    SimulationThread simulation(fluid);
+    Recorder recorder;
+    if (!recordPath.empty()) {
+        if (!recorder.start(recordPath, fluid, recordSettings)) {
+            SDL_DestroyRenderer(renderer);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
+        simulation.setRecorder(&recorder);
+    }
+    ResolutionSettings resolutionSettings;
+    resolutionSettings.targetSeconds = budgetMs * 1e-3;
+    ResolutionController resolution(SIMULATION_WIDTH, SIMULATION_HEIGHT, resolutionSettings);
+    if (budgetMs > 0) simulation.setResolutionController(&resolution);
+    std::unique_ptr<ParticleSystem> particles;
+    if (particleCapacity > 0) {
+        particles = std::make_unique<ParticleSystem>(particleCapacity);
+        particles->seed(1, 1, SIMULATION_WIDTH - 2, SIMULATION_HEIGHT - 2, particleCapacity / 2);
+        // One image pixel per window pixel
+        simulation.setParticles(particles.get(), WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
+    // Emitters release enough to refill the seeded half in about ten seconds
+    const float emitterRate = std::max(1.0f, particleCapacity / 1200.0f);
+    if (exportProfile) {
+        uiProfiler.setEnabled(true);
+        simulation.post(InputEvent::profiling(true));
+    }
+    simulation.start();
 
     bool running = true;
     SDL_Event event;
     int mouseX, mouseY;
     bool mouseDown = false;
     int prevMouseX = 0, prevMouseY = 0;
+    // Grid size of the latest frame, which input coordinates are scaled to
+    int simWidth = SIMULATION_WIDTH;
+    int simHeight = SIMULATION_HEIGHT;
+
+    // Reused every frame so steady-state text drawing does not allocate
+    std::string colorLabel;
+    std::string toolLabel;
+    const std::string helpLabel = "Help (H)";
+
+    // Overlay text is refreshed a few times a second so it stays readable
+    // and the UI text cache keeps hitting in between
+    using Clock = std::chrono::steady_clock;
+    const auto PROFILE_INTERVAL = std::chrono::milliseconds(250);
+    auto lastProfile = Clock::now();
+    std::array<std::string, ProfileSnapshot::PHASE_COUNT + ProfileSnapshot::COUNTER_COUNT> profileLines;
+    int profileLineCount = 0;
 
     while (running) {
         while (SDL_PollEvent(&event)) {
@@ -105,26 +236,41 @@ int main(int argc, char* argv[]) {
                     break;
                 case SDL_KEYDOWN:
                     switch (event.key.keysym.sym) {
-                        case SDLK_t:
-                            currentTool = (currentTool == Tool::Fluid) ? Tool::Explosion : Tool::Fluid;
+                        case SDLK_t: {
+                            const int toolCount = particles ? 4 : 2;
+                            currentTool = static_cast<Tool>((static_cast<int>(currentTool) + 1) % toolCount);
                             break;
+                        }
                         case SDLK_c:
-                            fluid.reset();
+                            simulation.post(InputEvent::reset());
                             break;
                         case SDLK_h:
                             showHelp = !showHelp;
                             break;
+                        case SDLK_p:
+                            showProfile = !showProfile;
+                            if (!exportProfile) {
+                                if (showProfile) uiProfiler.reset();
+                                uiProfiler.setEnabled(showProfile);
+                                simulation.post(InputEvent::profiling(showProfile));
+                            }
+                            profileLineCount = 0;
+                            break;
                     }
                     break;
                 case SDL_MOUSEBUTTONDOWN:
                     if(event.button.button == SDL_BUTTON_LEFT) {
                         SDL_GetMouseState(&mouseX, &mouseY);
-                        int simX = (mouseX * SIMULATION_WIDTH) / WINDOW_WIDTH;
-                        int simY = (mouseY * SIMULATION_HEIGHT) / WINDOW_HEIGHT;
+                        int simX = (mouseX * simWidth) / WINDOW_WIDTH;
+                        int simY = (mouseY * simHeight) / WINDOW_HEIGHT;
                         
                         if (currentTool == Tool::Explosion) {
                             // Create explosion on click
-                            fluid.createExplosion(simX, simY, 100.0f, currentDrawColor.r, currentDrawColor.g, currentDrawColor.b);
+                            simulation.post(InputEvent::explosion(simX, simY, 100.0f, currentDrawColor.r, currentDrawColor.g, currentDrawColor.b));
+                        } else if (currentTool == Tool::Emitter) {
+                            simulation.post(InputEvent::emitter(simX, simY, 3.0f, emitterRate));
+                        } else if (currentTool == Tool::Collector) {
+                            simulation.post(InputEvent::collector(simX, simY, 6.0f));
                         } else {
                             mouseDown = true;
                             prevMouseX = mouseX;
@@ -141,20 +287,20 @@ int main(int argc, char* argv[]) {
                     if (mouseDown) {
                         SDL_GetMouseState(&mouseX, &mouseY);
                         // Scale mouse coordinates to simulation size
-                        int simX = (mouseX * SIMULATION_WIDTH) / WINDOW_WIDTH;
-                        int simY = (mouseY * SIMULATION_HEIGHT) / WINDOW_HEIGHT;
-                        int prevSimX = (prevMouseX * SIMULATION_WIDTH) / WINDOW_WIDTH;
-                        int prevSimY = (prevMouseY * SIMULATION_HEIGHT) / WINDOW_HEIGHT;
+                        int simX = (mouseX * simWidth) / WINDOW_WIDTH;
+                        int simY = (mouseY * simHeight) / WINDOW_HEIGHT;
+                        int prevSimX = (prevMouseX * simWidth) / WINDOW_WIDTH;
+                        int prevSimY = (prevMouseY * simHeight) / WINDOW_HEIGHT;
                         
                         // Only handle fluid tool during motion
                         if (currentTool == Tool::Fluid) {
-                            // Add density at mouse position with current color
-                            fluid.addDensity(simX, simY, 100, currentDrawColor.r, currentDrawColor.g, currentDrawColor.b);
-                            
-                            // Add velocity based on mouse movement
+                            // Paint density and velocity along the whole path since the
+                            // last event, so fast strokes leave no gaps
                             float velX = (mouseX - prevMouseX) * 2.0f;
                             float velY = (mouseY - prevMouseY) * 2.0f;
-                            fluid.addVelocity(simX, simY, velX, velY);
+                            simulation.post(InputEvent::fromSplat(Splat::segment(
+                                prevSimX, prevSimY, simX, simY, 0, 100,
+                                currentDrawColor.r, currentDrawColor.g, currentDrawColor.b, velX, velY)));
                         }
                         
                         prevMouseX = mouseX;
@@ -164,30 +310,55 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        // Update simulation
-        fluid.step();
-
         // Clear screen
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
 
-        // Scale rendering to window size
-        SDL_RenderSetScale(renderer, 
-            static_cast<float>(WINDOW_WIDTH) / SIMULATION_WIDTH,
-            static_cast<float>(WINDOW_HEIGHT) / SIMULATION_HEIGHT);
+        // Render fluid, stretched to the window
+        const DyeFrame& frame = simulation.latestFrame();
+        fluidRenderer.render(frame);
+        if (frame.width > 0) {
+            simWidth = frame.width;
+            simHeight = frame.height;
+        }
+
+        if (uiProfiler.isEnabled() && Clock::now() - lastProfile >= PROFILE_INTERVAL) {
+            lastProfile = Clock::now();
+            ProfileSnapshot profile;
+            uiProfiler.snapshot(profile);
+            if (frame.profiled) profile.merge(frame.profile);
+            if (profileCsv.is_open()) writeProfileCsvRow(profileCsv, profile);
+            if (profileJson.is_open()) writeProfileJson(profileJson, profile);
 
-        // Render fluid
-        fluid.render(renderer);
-        
-        // Reset scale for UI rendering
-        SDL_RenderSetScale(renderer, 1.0f, 1.0f);
+            char line[96];
+            profileLineCount = 0;
+            for (int p = 0; p < ProfileSnapshot::PHASE_COUNT; p++) {
+                if (!profile.phaseSamples[p]) continue;
+                std::snprintf(line, sizeof(line), "%-9s p50 %6.2f ms  p99 %6.2f ms", phaseName(static_cast<Phase>(p)),
+                              profile.phaseP50[p] * 1e-6, profile.phaseP99[p] * 1e-6);
+                profileLines[profileLineCount++].assign(line);
+            }
+            for (int c = 0; c < ProfileSnapshot::COUNTER_COUNT; c++) {
+                if (!profile.counterSamples[c]) continue;
+                std::snprintf(line, sizeof(line), "%s p50 %llu  p99 %llu", counterName(static_cast<Counter>(c)),
+                              static_cast<unsigned long long>(profile.counterP50[c]),
+                              static_cast<unsigned long long>(profile.counterP99[c]));
+                profileLines[profileLineCount++].assign(line);
+            }
+        }
 
         // Draw UI elements
-        std::stringstream ss;
-        ss << "Color: " << currentDrawColor.name;
-        ui.drawText(ss.str(), 10, 10);
-        ui.drawText("Tool: " + std::string(currentTool == Tool::Fluid ? "Fluid" : "Explosion"), 10, 40);
-        ui.drawText("Help (H)", WINDOW_WIDTH - 100, 10);
+        colorLabel.assign("Color: ").append(currentDrawColor.name);
+        toolLabel.assign("Tool: ").append(toolName(currentTool));
+        ui.drawText(colorLabel, 10, 10);
+        ui.drawText(toolLabel, 10, 40);
+        ui.drawText(helpLabel, WINDOW_WIDTH - 100, 10);
+
+        if (showProfile) {
+            for (int i = 0; i < profileLineCount; i++) {
+                ui.drawText(profileLines[i], 10, 80 + i * 24, {255, 255, 0, 255});
+            }
+        }
 
         if (showHelp) {
             // Semi-transparent black background for help popup
@@ -195,7 +366,7 @@ int main(int argc, char* argv[]) {
             const int margin = 50;  // Margin from window edges
             const int textPadding = 30;  // Padding for text from popup edges
             const int popupWidth = WINDOW_WIDTH - (margin * 2);
-            const int popupHeight = 250;  // Fixed height for the popup
+            const int popupHeight = 300;  // Fixed height for the popup
             const int popupX = margin;
             const int popupY = (WINDOW_HEIGHT - popupHeight) / 2;  // Centered vertically
 
@@ -212,15 +383,27 @@ int main(int argc, char* argv[]) {
             y += 35;
             ui.drawText("Right click - Cycle colors", popupX + textPadding, y);
             y += 35;
-            ui.drawText("T - Switch between fluid/explosion tools", popupX + textPadding, y);
+            ui.drawText(particles ? "T - Cycle fluid/explosion/emitter/collector tools"
+                                  : "T - Switch between fluid/explosion tools", popupX + textPadding, y);
             y += 35;
             ui.drawText("C - Clear simulation", popupX + textPadding, y);
             y += 35;
             ui.drawText("H - Toggle help", popupX + textPadding, y);
+            y += 35;
+            ui.drawText("P - Toggle profiler overlay", popupX + textPadding, y);
         }
 
         // Present render
         SDL_RenderPresent(renderer);
+        uiProfiler.endFrame();
+    }
+
+    simulation.stop();
+    if (recorder.isRecording()) {
+        recorder.stop();
+        std::cout << "Recorded " << recorder.getFramesWritten() << " frames, " << recorder.getBytesWritten()
+                  << " bytes (" << recorder.getRawBytes() << " raw), " << recorder.getFramesDropped()
+                  << " dropped" << std::endl;
     }
 
     SDL_DestroyRenderer(renderer);
@@ -0,0 +1,112 @@
+#include "obstacles.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Neighbour bits of ObstacleMask::BoundaryCell
+constexpr int LEFT = 0;
+constexpr int RIGHT = 1;
+constexpr int UP = 2;
+constexpr int DOWN = 3;
+}
+
+void ObstacleMask::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    wordsPerRow = (width + 63) / 64;
+    bits.assign(static_cast<size_t>(wordsPerRow) * height, 0);
+    dirty = true;
+    update();
+}
+
+void ObstacleMask::clear() {
+    std::fill(bits.begin(), bits.end(), 0);
+    dirty = true;
+    update();
+}
+
+void ObstacleMask::setSolid(int x, int y, bool solid) {
+    if (x < 1 || x >= width - 1 || y < 1 || y >= height - 1) return;
+    std::uint64_t& word = bits[static_cast<size_t>(y) * wordsPerRow + (x >> 6)];
+    const std::uint64_t bit = std::uint64_t(1) << (x & 63);
+    if (((word & bit) != 0) == solid) return;
+    word ^= bit;
+    dirty = true;
+}
+
+void ObstacleMask::fillCircle(int cx, int cy, float radius, bool solid) {
+    const int extent = static_cast<int>(std::floor(radius));
+    for (int j = -extent; j <= extent; j++) {
+        for (int i = -extent; i <= extent; i++) {
+            if (i * i + j * j <= radius * radius) setSolid(cx + i, cy + j, solid);
+        }
+    }
+}
+
+bool ObstacleMask::update() {
+    if (!dirty) return false;
+    dirty = false;
+    spans.clear();
+    boundary.clear();
+    rowSpans.assign(height + 1, 0);
+    solidCount = 0;
+
+    for (int y = 0; y < height; y++) {
+        rowSpans[y] = static_cast<int>(spans.size());
+        if (y == 0 || y == height - 1) continue;
+        const std::uint64_t* row = &bits[static_cast<size_t>(y) * wordsPerRow];
+        auto addFluid = [&](int begin, int end) {
+            if (static_cast<int>(spans.size()) > rowSpans[y] && spans.back().end == begin) {
+                spans.back().end = end;
+            } else {
+                spans.push_back(Span{begin, end});
+            }
+        };
+        auto fluid = [&](int i, int j) {
+            return i >= 1 && i < width - 1 && j >= 1 && j < height - 1 && !isSolid(i, j);
+        };
+        for (int x = 1; x < width - 1;) {
+            // Words without solid cells are taken whole
+            if ((x & 63) == 0 && row[x >> 6] == 0) {
+                const int end = std::min(x + 64, width - 1);
+                addFluid(x, end);
+                x = end;
+                continue;
+            }
+            if (!isSolid(x, y)) {
+                addFluid(x, x + 1);
+                x++;
+                continue;
+            }
+            solidCount++;
+            std::uint8_t neighbours = 0;
+            if (fluid(x - 1, y)) neighbours |= 1 << LEFT;
+            if (fluid(x + 1, y)) neighbours |= 1 << RIGHT;
+            if (fluid(x, y - 1)) neighbours |= 1 << UP;
+            if (fluid(x, y + 1)) neighbours |= 1 << DOWN;
+            if (neighbours) boundary.push_back(BoundaryCell{x + y * width, neighbours});
+            x++;
+        }
+    }
+    rowSpans[height] = static_cast<int>(spans.size());
+    return true;
+}
+
+void ObstacleMask::setBoundary(int b, float* x, int channels, int stride) const {
+    const std::ptrdiff_t offsets[4] = {-1, 1, -width, width};
+    for (const BoundaryCell& cell : boundary) {
+        float* out = x + static_cast<size_t>(cell.idx) * stride;
+        for (int c = 0; c < channels; c++) {
+            float sum = 0;
+            int count = 0;
+            for (int k = 0; k < 4; k++) {
+                if (!((cell.neighbours >> k) & 1)) continue;
+                const float value = out[offsets[k] * stride + c];
+                const bool normal = (b == 1 && k <= RIGHT) || (b == 2 && k >= UP);
+                sum += normal ? -value : value;
+                count++;
+            }
+            out[c] = sum / count;
+        }
+    }
+}
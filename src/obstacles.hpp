@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Solid cells inside a width x height field, one bit per cell with rows
+// padded to whole 64-bit words. Only interior cells can be solid; the
+// ghost border stays the outer wall. After edits, update() rebuilds the
+// fluid columns of every row as spans, so row loops can step over the
+// solid runs, and the list of solid cells next to fluid, which setBnd()
+// fills like the outer ghost cells.
+class ObstacleMask {
+public:
+    // Grid columns [begin, end)
+    struct Span {
+        int begin;
+        int end;
+    };
+
+    struct SpanRange {
+        const Span* first;
+        const Span* last;
+        const Span* begin() const { return first; }
+        const Span* end() const { return last; }
+    };
+
+    // Clears every cell
+    void resize(int width, int height);
+    void clear();
+
+    bool isSolid(int x, int y) const {
+        return (bits[static_cast<std::size_t>(y) * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+    }
+    // Cells outside the interior are ignored
+    void setSolid(int x, int y, bool solid);
+    void fillCircle(int cx, int cy, float radius, bool solid);
+
+    // Solid interior cells, as of the last update()
+    int getSolidCount() const { return solidCount; }
+    bool empty() const { return solidCount == 0; }
+
+    // True when edits since the last update() are pending
+    bool isDirty() const { return dirty; }
+    // Rebuilds the spans and boundary list if edited; returns whether it did
+    bool update();
+
+    // Fluid interior columns of row y, within [1, width - 1)
+    SpanRange fluidSpans(int y) const {
+        return {&spans[rowSpans[y]], &spans[rowSpans[y + 1]]};
+    }
+
+    // Sets every solid cell next to fluid from its fluid neighbours, like
+    // setBnd does for the ghost border: scalars (b = 0) take their mean;
+    // for velocity components (b = 1 for x, 2 for y) the neighbours along
+    // the component's axis enter negated, so no flow crosses the wall while
+    // flow along it slips freely. Cells hold `channels` values `stride`
+    // floats apart.
+    void setBoundary(int b, float* x, int channels = 1, int stride = 1) const;
+
+    // Calls fn(idx) for every solid interior cell
+    template <typename F>
+    void forEachSolid(F&& fn) const {
+        for (int y = 1; y < height - 1; y++) {
+            int x = 1;
+            for (const Span& span : fluidSpans(y)) {
+                for (; x < span.begin; x++) fn(x + y * width);
+                x = span.end;
+            }
+            for (; x < width - 1; x++) fn(x + y * width);
+        }
+    }
+
+private:
+    // A solid cell with fluid on at least one side; neighbours holds one
+    // bit per fluid side (left, right, up, down)
+    struct BoundaryCell {
+        int idx;
+        std::uint8_t neighbours;
+    };
+
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    std::vector<std::uint64_t> bits;
+    std::vector<Span> spans;
+    std::vector<int> rowSpans;  // spans of row y are [rowSpans[y], rowSpans[y + 1])
+    std::vector<BoundaryCell> boundary;
+    int solidCount = 0;
+    bool dirty = false;
+};
@@ -0,0 +1,280 @@
+#include "particles.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Minimum particles per parallel chunk when stepping
+constexpr int PARTICLE_GRAIN = 4096;
+// Steps between row sorts; a sort costs about as much as one step
+constexpr int SORT_INTERVAL = 16;
+constexpr float TWO_PI = 6.28318530718f;
+
+inline void increment(std::uint16_t& cell) {
+    if (cell != 0xffff) cell++;
+}
+}
+
+ParticleSystem::ParticleSystem(int capacity)
+    : pool(std::make_unique<ThreadPool>(ThreadPool::defaultThreadCount())),
+      kernels(&selectKernels(detectSimdLevel())) {
+    posX.assign(capacity, 0);
+    posY.assign(capacity, 0);
+    age.assign(capacity, 0);
+    sortedX.assign(capacity, 0);
+    sortedY.assign(capacity, 0);
+    sortedAge.assign(capacity, 0);
+    stepsSinceSort = SORT_INTERVAL;
+    tallies.resize(pool->getThreadCount());
+}
+
+void ParticleSystem::setThreadCount(int threads) {
+    pool = std::make_unique<ThreadPool>(std::max(1, threads));
+    tallies.resize(pool->getThreadCount());
+}
+
+void ParticleSystem::clear() {
+    count = 0;
+    std::fill(emitterCarry.begin(), emitterCarry.end(), 0.0f);
+}
+
+int ParticleSystem::addEmitter(const ParticleEmitter& emitter) {
+    emitters.push_back(emitter);
+    emitterCarry.push_back(0);
+    return static_cast<int>(emitters.size()) - 1;
+}
+
+int ParticleSystem::addCollector(const ParticleCollector& collector) {
+    collectors.push_back(collector);
+    return static_cast<int>(collectors.size()) - 1;
+}
+
+void ParticleSystem::clearRegions() {
+    emitters.clear();
+    emitterCarry.clear();
+    collectors.clear();
+}
+
+// Uniform in [0, 1), from a 32-bit LCG so runs are reproducible
+float ParticleSystem::uniform() {
+    rng = rng * 1664525u + 1013904223u;
+    return static_cast<float>(rng >> 8) * (1.0f / 16777216.0f);
+}
+
+void ParticleSystem::spawn(float x, float y) {
+    posX[count] = x;
+    posY[count] = y;
+    age[count] = 0;
+    count++;
+    emitted++;
+}
+
+void ParticleSystem::seed(float x0, float y0, float x1, float y1, int amount) {
+    amount = std::min(amount, getCapacity() - count);
+    for (int k = 0; k < amount; k++) spawn(x0 + (x1 - x0) * uniform(), y0 + (y1 - y0) * uniform());
+    // Scattered over the whole rectangle, so sort before the next step
+    stepsSinceSort = SORT_INTERVAL;
+}
+
+void ParticleSystem::step(const FluidSimulation& fluid) {
+    if (fluid.getHalo()) return;
+    Profiler::Scope scope(profiler, Phase::Particles);
+    const int width = fluid.getWidth();
+    const int height = fluid.getHeight();
+    if (gridWidth != 0 && (width != gridWidth || height != gridHeight)) {
+        rescale(width, height);
+        stepsSinceSort = SORT_INTERVAL;
+    }
+    gridWidth = width;
+    gridHeight = height;
+
+    for (size_t e = 0; e < emitters.size(); e++) {
+        const ParticleEmitter& emitter = emitters[e];
+        emitterCarry[e] += emitter.rate;
+        const int amount = std::min(static_cast<int>(emitterCarry[e]), getCapacity() - count);
+        emitterCarry[e] -= static_cast<float>(static_cast<int>(emitterCarry[e]));
+        for (int k = 0; k < amount; k++) {
+            // Uniform over the disc, kept inside the interior like the advection backtrace
+            const float r = emitter.radius * std::sqrt(uniform());
+            const float angle = TWO_PI * uniform();
+            spawn(std::clamp(emitter.x + r * std::cos(angle), 0.5f, width - 1.5f),
+                  std::clamp(emitter.y + r * std::sin(angle), 0.5f, height - 1.5f));
+        }
+    }
+    if (count == 0) return;
+    if (++stepsSinceSort >= SORT_INTERVAL) sortByRow();
+
+    // Same scaling from velocity to cells per step as advect()
+    const float dtx = fluid.getDt() * (width - 2);
+    const float dty = fluid.getDt() * (height - 2);
+    const float* u = fluid.getVelocityX();
+    const float* v = fluid.getVelocityY();
+    float* x = posX.data();
+    float* y = posY.data();
+    pool->parallelFor(0, count, [&](int begin, int end) {
+        kernels->advectParticles(&x[begin], &y[begin], u, v, end - begin, width, height, dtx, dty);
+    }, PARTICLE_GRAIN);
+
+    compact(fluid);
+}
+
+// Ages the particles and drops the dead ones. Each chunk packs its
+// survivors to its own start in parallel; the packed chunks are then moved
+// down next to each other.
+void ParticleSystem::compact(const FluidSimulation& fluid) {
+    const float dt = fluid.getDt();
+    const ObstacleMask& obstacles = fluid.getObstacles();
+    const bool solids = !obstacles.empty();
+    const int chunks = std::max(1, std::min(pool->getThreadCount(), count / PARTICLE_GRAIN));
+    float* x = posX.data();
+    float* y = posY.data();
+    float* a = age.data();
+    auto chunkBegin = [&](int c) { return static_cast<int>(static_cast<long long>(count) * c / chunks); };
+
+    pool->parallelFor(0, chunks, [&](int first, int last) {
+        for (int c = first; c < last; c++) {
+            ChunkTally tally{0, 0, 0};
+            const int begin = chunkBegin(c);
+            const int end = chunkBegin(c + 1);
+            int out = begin;
+            for (int k = begin; k < end; k++) {
+                const float older = a[k] + dt;
+                if (lifetime > 0 && older >= lifetime) {
+                    tally.expired++;
+                    continue;
+                }
+                bool caught = solids && obstacles.isSolid(static_cast<int>(x[k] + 0.5f), static_cast<int>(y[k] + 0.5f));
+                for (const ParticleCollector& collector : collectors) {
+                    const float dx = x[k] - collector.x;
+                    const float dy = y[k] - collector.y;
+                    caught = caught || dx * dx + dy * dy <= collector.radius * collector.radius;
+                }
+                if (caught) {
+                    tally.collected++;
+                    continue;
+                }
+                x[out] = x[k];
+                y[out] = y[k];
+                a[out] = older;
+                out++;
+            }
+            tally.kept = out - begin;
+            tallies[c] = tally;
+        }
+    });
+
+    int kept = 0;
+    for (int c = 0; c < chunks; c++) {
+        const int begin = chunkBegin(c);
+        const ChunkTally& tally = tallies[c];
+        if (begin != kept) {
+            std::copy(x + begin, x + begin + tally.kept, x + kept);
+            std::copy(y + begin, y + begin + tally.kept, y + kept);
+            std::copy(a + begin, a + begin + tally.kept, a + kept);
+        }
+        kept += tally.kept;
+        collected += tally.collected;
+        expired += tally.expired;
+    }
+    count = kept;
+}
+
+// Stable counting sort on the row each particle samples first, which also
+// brings newly emitted particles next to the ones around them
+void ParticleSystem::sortByRow() {
+    stepsSinceSort = 0;
+    rowStart.assign(gridHeight + 1, 0);
+    const float* y = posY.data();
+    auto rowOf = [&](int k) { return std::clamp(static_cast<int>(y[k]), 0, gridHeight - 1); };
+    for (int k = 0; k < count; k++) rowStart[rowOf(k) + 1]++;
+    for (int j = 0; j < gridHeight; j++) rowStart[j + 1] += rowStart[j];
+    for (int k = 0; k < count; k++) {
+        const int to = rowStart[rowOf(k)]++;
+        sortedX[to] = posX[k];
+        sortedY[to] = posY[k];
+        sortedAge[to] = age[k];
+    }
+    posX.swap(sortedX);
+    posY.swap(sortedY);
+    age.swap(sortedAge);
+}
+
+// Keeps particles, emitters and collectors at the same place in the
+// domain. AreaResampler maps the interiors onto each other: the domain
+// spans [0.5, width - 1.5] in grid coordinates, so x moves to
+// 0.5 + (x - 0.5) * (width - 2) / (oldWidth - 2). Radii scale by the
+// geometric mean of the two axes, which keeps a region's area.
+void ParticleSystem::rescale(int width, int height) {
+    const float sx = static_cast<float>(width - 2) / (gridWidth - 2);
+    const float sy = static_cast<float>(height - 2) / (gridHeight - 2);
+    auto mapX = [&](float v) { return std::fmin(std::fmax(0.5f + (v - 0.5f) * sx, 0.5f), width - 1.5f); };
+    auto mapY = [&](float v) { return std::fmin(std::fmax(0.5f + (v - 0.5f) * sy, 0.5f), height - 1.5f); };
+    float* x = posX.data();
+    float* y = posY.data();
+    pool->parallelFor(0, count, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            x[k] = mapX(x[k]);
+            y[k] = mapY(y[k]);
+        }
+    }, PARTICLE_GRAIN);
+
+    const float sr = std::sqrt(sx * sy);
+    for (ParticleEmitter& emitter : emitters) {
+        emitter.x = mapX(emitter.x);
+        emitter.y = mapY(emitter.y);
+        emitter.radius *= sr;
+    }
+    for (ParticleCollector& collector : collectors) {
+        collector.x = mapX(collector.x);
+        collector.y = mapY(collector.y);
+        collector.radius *= sr;
+    }
+}
+
+void ParticleSystem::rasterize(std::uint16_t* image, int imageWidth, int imageHeight) {
+    if (gridWidth == 0 || count == 0) return;
+    Profiler::Scope scope(profiler, Phase::Particles);
+    // Cell i spans pixels [i, i + 1) * scale, so its centre maps to (i + 0.5) * scale
+    const float sx = static_cast<float>(imageWidth) / gridWidth;
+    const float sy = static_cast<float>(imageHeight) / gridHeight;
+    const float* x = posX.data();
+    const float* y = posY.data();
+    auto countInto = [&](std::uint16_t* target, int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const int px = std::min(imageWidth - 1, static_cast<int>((x[k] + 0.5f) * sx));
+            const int py = std::min(imageHeight - 1, static_cast<int>((y[k] + 0.5f) * sy));
+            increment(target[py * imageWidth + px]);
+        }
+    };
+
+    const int chunks = std::max(1, std::min(pool->getThreadCount(), count / PARTICLE_GRAIN));
+    if (chunks == 1) {
+        countInto(image, 0, count);
+        return;
+    }
+
+    // The first chunk counts straight into the image
+    const size_t pixels = static_cast<size_t>(imageWidth) * imageHeight;
+    if (planes.size() < static_cast<size_t>(chunks - 1)) planes.resize(chunks - 1);
+    pool->parallelFor(0, chunks, [&](int first, int last) {
+        for (int c = first; c < last; c++) {
+            std::uint16_t* target = image;
+            if (c > 0) {
+                std::vector<std::uint16_t>& plane = planes[c - 1];
+                plane.assign(pixels, 0);
+                target = plane.data();
+            }
+            countInto(target, static_cast<int>(static_cast<long long>(count) * c / chunks),
+                      static_cast<int>(static_cast<long long>(count) * (c + 1) / chunks));
+        }
+    });
+    pool->parallelFor(0, imageHeight, [&](int rowBegin, int rowEnd) {
+        const size_t begin = static_cast<size_t>(rowBegin) * imageWidth;
+        const size_t end = static_cast<size_t>(rowEnd) * imageWidth;
+        for (int c = 1; c < chunks; c++) {
+            const std::uint16_t* plane = planes[c - 1].data();
+            for (size_t i = begin; i < end; i++) {
+                image[i] = static_cast<std::uint16_t>(std::min(0xffff, image[i] + plane[i]));
+            }
+        }
+    });
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "field.hpp"
+#include "fluid.hpp"
+#include "kernels.hpp"
+#include "thread_pool.hpp"
+
+// Disc that releases particles, in grid coordinates like FluidSimulation's inputs
+struct ParticleEmitter {
+    float x;
+    float y;
+    float radius;
+    float rate;  // particles per step; fractions carry over to the next step
+};
+
+// Disc that removes the particles entering it
+struct ParticleCollector {
+    float x;
+    float y;
+    float radius;
+};
+
+// Passive tracer particles carried by a FluidSimulation's velocity, for
+// visualizing the flow. Particles are stored as separate x, y and age
+// arrays so the stepping kernel (RowKernels::advectParticles, which shares
+// advectRow's bilinear sampling) runs across particles in full vectors.
+// step() moves them in parallel chunks and then removes, chunk by chunk,
+// those that reached a collector, a barrier or the end of their lifetime;
+// survivors keep their order. Every SORT_INTERVAL steps the particles are
+// reordered by grid row so neighbours in the arrays sample neighbouring
+// velocities; unsorted, the gathers miss the cache and a step costs about
+// twice as much. Storage is allocated up front for the capacity, so
+// stepping never allocates (after the first step on a grid size); emission
+// stops while it is full.
+//
+// Positions are in grid coordinates, cell (i, j) centred on (i, j). When
+// the grid is resized between steps they are rescaled with it, and so are
+// the emitters and collectors. Decomposed grids are not supported.
+class ParticleSystem {
+public:
+    explicit ParticleSystem(int capacity);
+
+    void step(const FluidSimulation& fluid);
+
+    // Removes every particle; emitters and collectors stay
+    void clear();
+    // count particles spread uniformly over the rectangle, as capacity allows
+    void seed(float x0, float y0, float x1, float y1, int count);
+
+    int addEmitter(const ParticleEmitter& emitter);
+    int addCollector(const ParticleCollector& collector);
+    void clearRegions();
+    const std::vector<ParticleEmitter>& getEmitters() const { return emitters; }
+    const std::vector<ParticleCollector>& getCollectors() const { return collectors; }
+
+    // Age in seconds at which particles are removed; 0 (the default) keeps them forever
+    void setLifetime(float seconds) { lifetime = seconds; }
+    float getLifetime() const { return lifetime; }
+
+    int getCount() const { return count; }
+    int getCapacity() const { return static_cast<int>(posX.size()); }
+    const float* getX() const { return posX.data(); }
+    const float* getY() const { return posY.data(); }
+    const float* getAge() const { return age.data(); }
+
+    // Totals since construction
+    std::uint64_t getEmitted() const { return emitted; }
+    std::uint64_t getCollected() const { return collected; }
+    std::uint64_t getExpired() const { return expired; }
+
+    // Adds the number of particles over each pixel to an imageWidth x
+    // imageHeight image stretched over the whole grid, the way the dye
+    // texture is drawn, saturating at 65535. Each thread counts its share of
+    // the particles into a private plane, and the planes are summed by rows.
+    void rasterize(std::uint16_t* image, int imageWidth, int imageHeight);
+
+    // Worker threads (defaults to the hardware thread count). Kept apart
+    // from the solver's pool; the two are used one after the other.
+    void setThreadCount(int threads);
+    int getThreadCount() const { return pool->getThreadCount(); }
+
+    // Times step() and rasterize() as Phase::Particles when set
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+
+    // Caps the instruction set of the stepping kernel (defaults to the best the CPU supports)
+    void setSimdLevel(SimdLevel level) { kernels = &selectKernels(level); }
+    SimdLevel getSimdLevel() const { return kernels->level; }
+
+private:
+    Field posX;
+    Field posY;
+    Field age;
+    // Destination of the row sort, swapped with the arrays above
+    Field sortedX;
+    Field sortedY;
+    Field sortedAge;
+    std::vector<int> rowStart;
+    int stepsSinceSort = 0;
+    int count = 0;
+    float lifetime = 0;
+
+    std::vector<ParticleEmitter> emitters;
+    std::vector<float> emitterCarry;  // fractional particles owed per emitter
+    std::vector<ParticleCollector> collectors;
+    std::uint32_t rng = 0x2545f491u;
+
+    // Grid the positions refer to; 0 before the first step
+    int gridWidth = 0;
+    int gridHeight = 0;
+
+    std::uint64_t emitted = 0;
+    std::uint64_t collected = 0;
+    std::uint64_t expired = 0;
+
+    std::unique_ptr<ThreadPool> pool;
+    const RowKernels* kernels;
+    Profiler* profiler = nullptr;
+    struct ChunkTally {
+        int kept;
+        int collected;
+        int expired;
+    };
+    std::vector<ChunkTally> tallies;  // per compaction chunk
+    std::vector<std::vector<std::uint16_t>> planes;  // per-thread rasterization counts
+
+    void spawn(float x, float y);
+    float uniform();
+    void rescale(int width, int height);
+    void compact(const FluidSimulation& fluid);
+    void sortByRow();
+};
@@ -0,0 +1,162 @@
+#include "profiler.hpp"
+#include <algorithm>
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Diffuse: return "diffuse";
+        case Phase::Project: return "project";
+        case Phase::Advect: return "advect";
+        case Phase::SetBnd: return "setBnd";
+        case Phase::Activity: return "activity";
+        case Phase::Render: return "render";
+        case Phase::DrawText: return "drawText";
+        case Phase::Halo: return "halo";
+        case Phase::Splat: return "splat";
+        case Phase::Particles: return "particles";
+        default: return "unknown";
+    }
+}
+
+const char* counterName(Counter counter) {
+    switch (counter) {
+        case Counter::PressureIterations: return "pressureIterations";
+        case Counter::DiffusionIterations: return "diffusionIterations";
+        default: return "unknown";
+    }
+}
+
+void ProfileSnapshot::merge(const ProfileSnapshot& other) {
+    frames = std::max(frames, other.frames);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (!other.phaseSamples[p]) continue;
+        phaseSamples[p] = other.phaseSamples[p];
+        phaseP50[p] = other.phaseP50[p];
+        phaseP99[p] = other.phaseP99[p];
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (!other.counterSamples[c]) continue;
+        counterSamples[c] = other.counterSamples[c];
+        counterP50[c] = other.counterP50[c];
+        counterP99[c] = other.counterP99[c];
+    }
+}
+
+void writeProfileCsvHeader(std::ostream& out) {
+    out << "frames";
+    for (int p = 0; p < ProfileSnapshot::PHASE_COUNT; p++) {
+        const char* name = phaseName(static_cast<Phase>(p));
+        out << "," << name << "_p50_ns," << name << "_p99_ns";
+    }
+    for (int c = 0; c < ProfileSnapshot::COUNTER_COUNT; c++) {
+        const char* name = counterName(static_cast<Counter>(c));
+        out << "," << name << "_p50," << name << "_p99";
+    }
+    out << "\n";
+}
+
+void writeProfileCsvRow(std::ostream& out, const ProfileSnapshot& snapshot) {
+    out << snapshot.frames;
+    for (int p = 0; p < ProfileSnapshot::PHASE_COUNT; p++) {
+        out << "," << snapshot.phaseP50[p] << "," << snapshot.phaseP99[p];
+    }
+    for (int c = 0; c < ProfileSnapshot::COUNTER_COUNT; c++) {
+        out << "," << snapshot.counterP50[c] << "," << snapshot.counterP99[c];
+    }
+    out << "\n";
+}
+
+void writeProfileJson(std::ostream& out, const ProfileSnapshot& snapshot) {
+    out << "{\"frames\": " << snapshot.frames << ", \"unit\": \"ns/frame\", \"phases\": {";
+    for (int p = 0; p < ProfileSnapshot::PHASE_COUNT; p++) {
+        out << (p ? ", " : "") << "\"" << phaseName(static_cast<Phase>(p)) << "\": {\"p50\": "
+            << snapshot.phaseP50[p] << ", \"p99\": " << snapshot.phaseP99[p] << "}";
+    }
+    out << "}, \"counters\": {";
+    for (int c = 0; c < ProfileSnapshot::COUNTER_COUNT; c++) {
+        out << (c ? ", " : "") << "\"" << counterName(static_cast<Counter>(c)) << "\": {\"p50\": "
+            << snapshot.counterP50[c] << ", \"p99\": " << snapshot.counterP99[c] << "}";
+    }
+    out << "}}\n";
+}
+
+#if FLUID_PROFILING
+Profiler::Scope::Scope(Profiler* profiler, Phase phase)
+    : profiler(profiler && profiler->enabled ? profiler : nullptr), parent(nullptr), phase(phase), childNanos(0) {
+    if (!this->profiler) return;
+    parent = profiler->current;
+    profiler->current = this;
+    start = std::chrono::steady_clock::now();
+}
+
+Profiler::Scope::~Scope() {
+    if (!profiler) return;
+    auto elapsed = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+    int idx = static_cast<int>(phase);
+    profiler->nanos[idx] += elapsed - childNanos;
+    profiler->calls[idx]++;
+    profiler->frameNanos[idx] += elapsed - childNanos;
+    profiler->frameCalls[idx]++;
+    if (parent) parent->childNanos += elapsed;
+    profiler->current = parent;
+}
+#endif
+
+void Profiler::reset() {
+    nanos.fill(0);
+    calls.fill(0);
+    frames = 0;
+    frameNanos.fill(0);
+    frameCalls.fill(0);
+    frameCounts.fill(0);
+    frameCounted.fill(false);
+    for (Window& window : phaseWindows) window = Window();
+    for (Window& window : counterWindows) window = Window();
+}
+
+void Profiler::endFrame() {
+    if (!enabled) return;
+    frames++;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (frameCalls[p]) phaseWindows[p].push(frameNanos[p]);
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (frameCounted[c]) counterWindows[c].push(frameCounts[c]);
+    }
+    frameNanos.fill(0);
+    frameCalls.fill(0);
+    frameCounts.fill(0);
+    frameCounted.fill(false);
+}
+
+void Profiler::snapshot(ProfileSnapshot& out) const {
+    out.frames = frames;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        out.phaseSamples[p] = phaseWindows[p].count;
+        phaseWindows[p].percentiles(out.phaseP50[p], out.phaseP99[p]);
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        out.counterSamples[c] = counterWindows[c].count;
+        counterWindows[c].percentiles(out.counterP50[c], out.counterP99[c]);
+    }
+}
+
+void Profiler::Window::push(std::uint64_t value) {
+    samples[next] = value;
+    next = (next + 1) % WINDOW;
+    count = std::min(count + 1, WINDOW);
+}
+
+// Nearest-rank percentiles over a sorted copy, which lives on the stack
+void Profiler::Window::percentiles(std::uint64_t& p50, std::uint64_t& p99) const {
+    if (!count) {
+        p50 = p99 = 0;
+        return;
+    }
+    std::array<std::uint64_t, WINDOW> sorted;
+    std::copy(samples.begin(), samples.begin() + count, sorted.begin());
+    std::sort(sorted.begin(), sorted.begin() + count);
+    p50 = sorted[(count - 1) / 2];
+    p99 = sorted[(count * 99 + 99) / 100 - 1];
+}
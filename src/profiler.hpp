@@ -0,0 +1,142 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Timers are compiled in unless the build sets FLUID_PROFILING=0, in which
+// case Profiler::Scope does nothing and every total stays zero
+#ifndef FLUID_PROFILING
+#define FLUID_PROFILING 1
+#endif
+
+// Solver phases that can be timed individually
+enum class Phase {
+    Diffuse,
+    Project,
+    Advect,
+    SetBnd,
+    Activity,  // active tile tracking
+    Render,    // dye tone mapping and upload
+    DrawText,  // UI::drawText
+    Halo,      // ghost row exchange between slabs
+    Splat,     // queued input splats
+    Particles, // tracer particle stepping and rasterization
+    Count
+};
+
+const char* phaseName(Phase phase);
+
+// Per-frame quantities tracked alongside the timers
+enum class Counter {
+    PressureIterations,   // summed over the frame's pressure solves
+    DiffusionIterations,  // summed over the frame's diffusion solves
+    Count
+};
+
+const char* counterName(Counter counter);
+
+// Rolling percentiles of the last Profiler::WINDOW frames. Phases and
+// counters without samples in the window report zero.
+struct ProfileSnapshot {
+    static constexpr int PHASE_COUNT = static_cast<int>(Phase::Count);
+    static constexpr int COUNTER_COUNT = static_cast<int>(Counter::Count);
+
+    std::uint64_t frames = 0;                         // ended since the last reset
+    std::array<int, PHASE_COUNT> phaseSamples{};
+    std::array<std::uint64_t, PHASE_COUNT> phaseP50{};  // nanoseconds per frame
+    std::array<std::uint64_t, PHASE_COUNT> phaseP99{};
+    std::array<int, COUNTER_COUNT> counterSamples{};
+    std::array<std::uint64_t, COUNTER_COUNT> counterP50{};
+    std::array<std::uint64_t, COUNTER_COUNT> counterP99{};
+
+    // Takes every phase and counter that has samples in other, so snapshots
+    // of profilers on different threads can be combined
+    void merge(const ProfileSnapshot& other);
+};
+
+// One CSV row per snapshot, columns <name>_p50_ns and <name>_p99_ns for every
+// phase and <name>_p50 and <name>_p99 for every counter
+void writeProfileCsvHeader(std::ostream& out);
+void writeProfileCsvRow(std::ostream& out, const ProfileSnapshot& snapshot);
+// One JSON object per snapshot, on a single line
+void writeProfileJson(std::ostream& out, const ProfileSnapshot& snapshot);
+
+// Not thread-safe: each thread that times work uses its own profiler.
+class Profiler {
+public:
+    static constexpr int WINDOW = 256;  // frames in the rolling percentiles
+
+    // RAII timer for one phase. Time spent in nested scopes is attributed to
+    // the nested phase only, so per-phase totals never double count.
+    class Scope {
+    public:
+#if FLUID_PROFILING
+        Scope(Profiler& profiler, Phase phase) : Scope(&profiler, phase) {}
+        // A null profiler times nothing
+        Scope(Profiler* profiler, Phase phase);
+        ~Scope();
+#else
+        Scope(Profiler&, Phase) {}
+        Scope(Profiler*, Phase) {}
+#endif
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+#if FLUID_PROFILING
+    private:
+        Profiler* profiler;
+        Scope* parent;
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+        std::uint64_t childNanos;
+#endif
+    };
+
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+    void reset();
+
+    // Exclusive time spent in a phase since the last reset
+    std::uint64_t totalNanos(Phase phase) const { return nanos[static_cast<int>(phase)]; }
+    std::uint64_t callCount(Phase phase) const { return calls[static_cast<int>(phase)]; }
+
+    void addCount(Counter counter, std::uint64_t value) {
+        if (!enabled) return;
+        frameCounts[static_cast<int>(counter)] += value;
+        frameCounted[static_cast<int>(counter)] = true;
+    }
+
+    // Closes the current frame: every phase timed and counter added since
+    // the last endFrame() becomes one sample of the rolling window
+    void endFrame();
+    void snapshot(ProfileSnapshot& out) const;
+
+private:
+    static constexpr int PHASE_COUNT = static_cast<int>(Phase::Count);
+    static constexpr int COUNTER_COUNT = static_cast<int>(Counter::Count);
+
+    // Last WINDOW samples of one quantity
+    struct Window {
+        std::array<std::uint64_t, WINDOW> samples{};
+        int count = 0;
+        int next = 0;
+
+        void push(std::uint64_t value);
+        void percentiles(std::uint64_t& p50, std::uint64_t& p99) const;
+    };
+
+    bool enabled = false;
+    Scope* current = nullptr;
+    std::array<std::uint64_t, PHASE_COUNT> nanos{};
+    std::array<std::uint64_t, PHASE_COUNT> calls{};
+
+    std::uint64_t frames = 0;
+    std::array<std::uint64_t, PHASE_COUNT> frameNanos{};
+    std::array<std::uint64_t, PHASE_COUNT> frameCalls{};
+    std::array<std::uint64_t, COUNTER_COUNT> frameCounts{};
+    std::array<bool, COUNTER_COUNT> frameCounted{};
+    std::array<Window, PHASE_COUNT> phaseWindows;
+    std::array<Window, COUNTER_COUNT> counterWindows;
+};
@@ -0,0 +1,344 @@
+#include "recorder.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr int FIELD_COUNT = static_cast<int>(RecordedField::Count);
+
+// Shorter runs stay inside literals, where they cost less than a token
+constexpr std::size_t MIN_RUN = 4;
+
+void putVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+bool getVarint(const std::uint8_t*& in, const std::uint8_t* end, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        std::uint8_t byte = *in++;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Appends data as run and literal tokens
+void encodeRuns(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out) {
+    std::size_t literal = 0;
+    std::size_t i = 0;
+    while (i < size) {
+        const std::uint8_t value = data[i];
+        std::size_t end = i + 1;
+        if (value == 0) {
+            // Unchanged cells make long zero runs, skipped a word at a time
+            std::uint64_t word;
+            while (end + sizeof(word) <= size && (std::memcpy(&word, data + end, sizeof(word)), word == 0)) {
+                end += sizeof(word);
+            }
+        }
+        while (end < size && data[end] == value) end++;
+        if (end - i >= MIN_RUN) {
+            if (i > literal) {
+                putVarint(out, (i - literal) << 1);
+                out.insert(out.end(), data + literal, data + i);
+            }
+            putVarint(out, (end - i) << 1 | 1);
+            out.push_back(value);
+            literal = end;
+        }
+        i = end;
+    }
+    if (size > literal) {
+        putVarint(out, (size - literal) << 1);
+        out.insert(out.end(), data + literal, data + size);
+    }
+}
+
+// Fills exactly size bytes; false if the tokens do not
+bool decodeRuns(const std::uint8_t* in, const std::uint8_t* end, std::uint8_t* data, std::size_t size) {
+    std::size_t at = 0;
+    while (in < end) {
+        std::uint64_t token;
+        if (!getVarint(in, end, token)) return false;
+        std::uint64_t length = token >> 1;
+        if (length > size - at) return false;
+        if (token & 1) {
+            if (in == end) return false;
+            std::memset(data + at, *in++, length);
+        } else {
+            if (length > static_cast<std::uint64_t>(end - in)) return false;
+            std::memcpy(data + at, in, length);
+            in += length;
+        }
+        at += length;
+    }
+    return at == size;
+}
+
+}  // namespace
+
+Recorder::~Recorder() {
+    stop();
+}
+
+bool Recorder::start(const std::string& path, const FluidSimulation& fluid, const RecorderSettings& settings) {
+    stop();
+    if ((settings.fields & ~((1u << FIELD_COUNT) - 1)) || !settings.fields) {
+        std::cerr << "Invalid recorded fields" << std::endl;
+        return false;
+    }
+    if (!settings.ppmDirectory.empty() && (settings.fields & RECORD_DYE) != RECORD_DYE) {
+        std::cerr << "PPM frames need the dye to be recorded" << std::endl;
+        return false;
+    }
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to create recording " << path << std::endl;
+        return false;
+    }
+
+    this->settings = settings;
+    this->settings.decimation = std::max(1, settings.decimation);
+    this->settings.keyframeInterval = std::max(1, settings.keyframeInterval);
+    this->settings.capacity = std::max(1, settings.capacity);
+    width = fluid.getWidth();
+    height = fluid.getHeight();
+    fields.clear();
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (settings.fields & recordedFieldBit(static_cast<RecordedField>(f))) {
+            fields.push_back(static_cast<RecordedField>(f));
+        }
+    }
+
+    // Everything capture() and the writer touch is sized up front
+    const std::size_t cells = static_cast<std::size_t>(width) * height;
+    const std::size_t values = cells * fields.size();
+    slots.assign(this->settings.capacity, Slot());
+    for (Slot& slot : slots) slot.values.resize(values);
+    previous.assign(values, 0);
+    planes.resize(values * sizeof(float));
+    encoded.clear();
+    encoded.reserve(planes.size() * 2);
+    if (!settings.ppmDirectory.empty()) pixels.resize(cells * 3);
+    head = 0;
+    tail = 0;
+    chunks = 0;
+    stopping = false;
+    captured = 0;
+    written = 0;
+    dropped = 0;
+    rawBytes = 0;
+
+    RecordingHeader header = {};
+    std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.headerBytes = sizeof(RecordingHeader);
+    header.width = width;
+    header.height = height;
+    header.fields = settings.fields;
+    header.decimation = static_cast<std::uint32_t>(this->settings.decimation);
+    header.dt = fluid.getDt();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bytesWritten = sizeof(header);
+
+    writing = true;
+    thread = std::thread(&Recorder::run, this);
+    return true;
+}
+
+void Recorder::stop() {
+    if (!writing) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    filled.notify_one();
+    thread.join();
+    writing = false;
+    out.close();
+    if (!out) std::cerr << "Failed to write recording" << std::endl;
+}
+
+void Recorder::capture(const FluidSimulation& fluid, std::uint64_t step) {
+    if (!writing || step % settings.decimation != 0) return;
+    if (fluid.getWidth() != width || fluid.getHeight() != height) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Slot* slot;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (head - tail == slots.size()) {
+            if (settings.backpressure == Backpressure::Drop) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            freed.wait(lock, [&] { return head - tail < slots.size(); });
+        }
+        slot = &slots[head % slots.size()];
+    }
+
+    // The writer never reads the slot at head, so it is filled unlocked
+    const std::size_t cells = static_cast<std::size_t>(width) * height;
+    slot->step = step;
+    float* values = slot->values.data();
+    for (RecordedField field : fields) {
+        switch (field) {
+            case RecordedField::Vx:
+                std::copy(fluid.getVelocityX(), fluid.getVelocityX() + cells, values);
+                break;
+            case RecordedField::Vy:
+                std::copy(fluid.getVelocityY(), fluid.getVelocityY() + cells, values);
+                break;
+            default: {
+                ChannelView view = fluid.getChannel(static_cast<int>(field));
+                if (!view.half && view.stride == 1) {
+                    std::copy(view.data, view.data + cells, values);
+                } else {
+                    for (std::size_t idx = 0; idx < cells; idx++) values[idx] = view[static_cast<int>(idx)];
+                }
+                break;
+            }
+        }
+        values += cells;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        head++;
+    }
+    filled.notify_one();
+    captured.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Recorder::run() {
+    for (;;) {
+        const Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            filled.wait(lock, [&] { return head != tail || stopping; });
+            if (head == tail) return;
+            slot = &slots[tail % slots.size()];
+        }
+        writeChunk(*slot);
+        if (!settings.ppmDirectory.empty()) writePpm(*slot);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tail++;
+        }
+        freed.notify_one();
+        written.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Recorder::writeChunk(const Slot& slot) {
+    const std::size_t count = slot.values.size();
+    const bool keyframe = chunks % settings.keyframeInterval == 0;
+    for (std::size_t i = 0; i < count; i++) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &slot.values[i], sizeof(bits));
+        const std::uint32_t delta = keyframe ? bits : bits ^ previous[i];
+        previous[i] = bits;
+        for (std::size_t b = 0; b < sizeof(bits); b++) {
+            planes[b * count + i] = static_cast<std::uint8_t>(delta >> (8 * b));
+        }
+    }
+    encoded.clear();
+    encodeRuns(planes.data(), planes.size(), encoded);
+
+    RecordingChunk chunk = {};
+    chunk.step = slot.step;
+    chunk.keyframe = keyframe ? 1 : 0;
+    chunk.encodedBytes = encoded.size();
+    out.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+    out.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    chunks++;
+    bytesWritten.fetch_add(sizeof(chunk) + encoded.size(), std::memory_order_relaxed);
+    rawBytes.fetch_add(count * sizeof(float), std::memory_order_relaxed);
+}
+
+// Dye clamped to [0, 1] and scaled to 8 bits, as on screen
+void Recorder::writePpm(const Slot& slot) {
+    const std::size_t cells = static_cast<std::size_t>(width) * height;
+    const float* dye = slot.values.data();  // R, G and B are the first recorded fields
+    for (std::size_t idx = 0; idx < cells; idx++) {
+        for (int c = 0; c < 3; c++) {
+            float value = std::min(std::max(dye[c * cells + idx], 0.0f), 1.0f);
+            pixels[idx * 3 + c] = static_cast<std::uint8_t>(value * 255.0f);
+        }
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%08llu.ppm", static_cast<unsigned long long>(slot.step));
+    std::ofstream ppm(settings.ppmDirectory + name, std::ios::binary | std::ios::trunc);
+    char header[32];
+    const int headerBytes = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    ppm.write(header, headerBytes);
+    ppm.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+    if (!ppm) {
+        std::cerr << "Failed to write " << settings.ppmDirectory << name << std::endl;
+        return;
+    }
+    bytesWritten.fetch_add(headerBytes + pixels.size(), std::memory_order_relaxed);
+}
+
+bool RecordingReader::open(const std::string& path) {
+    in.open(path, std::ios::binary);
+    if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a recording: " << path << std::endl;
+        return false;
+    }
+    if (header.version != RECORDING_VERSION || header.headerBytes != sizeof(RecordingHeader) ||
+        header.width < 1 || header.height < 1 || !header.fields ||
+        (header.fields & ~((1u << FIELD_COUNT) - 1))) {
+        std::cerr << "Unsupported recording " << path << std::endl;
+        return false;
+    }
+    fieldCount = 0;
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (header.fields & (1u << f)) fieldCount++;
+    }
+    const std::size_t values = static_cast<std::size_t>(header.width) * header.height * fieldCount;
+    previous.assign(values, 0);
+    planes.resize(values * sizeof(float));
+    return true;
+}
+
+bool RecordingReader::next(std::uint64_t& step, std::vector<float>& values) {
+    RecordingChunk chunk;
+    if (!in.read(reinterpret_cast<char*>(&chunk), sizeof(chunk))) return false;
+    // Incompressible data grows by a few token bytes at most
+    if (chunk.encodedBytes > planes.size() * 2 + 16) {
+        std::cerr << "Bad recording chunk at step " << chunk.step << std::endl;
+        return false;
+    }
+    encoded.resize(chunk.encodedBytes);
+    if (!in.read(reinterpret_cast<char*>(encoded.data()), static_cast<std::streamsize>(encoded.size())) ||
+        !decodeRuns(encoded.data(), encoded.data() + encoded.size(), planes.data(), planes.size())) {
+        std::cerr << "Bad recording chunk at step " << chunk.step << std::endl;
+        return false;
+    }
+
+    const std::size_t count = previous.size();
+    values.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+        std::uint32_t bits = 0;
+        for (std::size_t b = 0; b < sizeof(bits); b++) {
+            bits |= static_cast<std::uint32_t>(planes[b * count + i]) << (8 * b);
+        }
+        if (!chunk.keyframe) bits ^= previous[i];
+        previous[i] = bits;
+        std::memcpy(&values[i], &bits, sizeof(bits));
+    }
+    step = chunk.step;
+    return true;
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "fluid.hpp"
+
+// On-disk layout of a Recorder file.
+//
+// A RecordingHeader is followed by one chunk per recorded step: a
+// RecordingChunk and its encoded payload. The payload holds the recorded
+// fields one after the other, in RecordedField order, each
+// width * height floats. Before encoding, every float is XORed with the
+// same cell of the previous chunk (except in keyframes, which stand alone)
+// and the bytes of the field are split into four planes, lowest byte
+// first, so unchanged and slowly changing cells become long runs. The
+// encoded stream is a sequence of tokens, each a LEB128 varint
+// (length << 1 | isRun) followed by the repeated byte for a run or by
+// length raw bytes for a literal.
+// Values are in the byte order of the machine that wrote them.
+constexpr char RECORDING_MAGIC[8] = {'F', 'L', 'U', 'I', 'D', 'R', 'E', 'C'};
+constexpr std::uint32_t RECORDING_VERSION = 1;
+
+enum class RecordedField : std::uint32_t {
+    DyeR,
+    DyeG,
+    DyeB,
+    Vx,
+    Vy,
+    Count
+};
+
+constexpr std::uint32_t recordedFieldBit(RecordedField field) { return 1u << static_cast<std::uint32_t>(field); }
+constexpr std::uint32_t RECORD_DYE = recordedFieldBit(RecordedField::DyeR) | recordedFieldBit(RecordedField::DyeG) |
+                                     recordedFieldBit(RecordedField::DyeB);
+constexpr std::uint32_t RECORD_VELOCITY = recordedFieldBit(RecordedField::Vx) | recordedFieldBit(RecordedField::Vy);
+
+struct RecordingHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t headerBytes;  // sizeof(RecordingHeader)
+    std::int32_t width;
+    std::int32_t height;
+    std::uint32_t fields;       // RecordedField bits
+    std::uint32_t decimation;   // steps between recorded chunks
+    float dt;
+    std::uint32_t reserved;
+};
+
+struct RecordingChunk {
+    std::uint64_t step;
+    std::uint32_t keyframe;      // 1 if not delta encoded
+    std::uint32_t reserved;
+    std::uint64_t encodedBytes;  // payload that follows
+};
+
+enum class Backpressure {
+    Block,  // capture() waits for the writer to free a slot
+    Drop    // capture() discards the frame and counts it
+};
+
+struct RecorderSettings {
+    std::uint32_t fields = RECORD_DYE | RECORD_VELOCITY;
+    int decimation = 1;         // record every Nth step
+    int keyframeInterval = 60;  // recorded chunks between keyframes
+    int capacity = 8;           // frames buffered between capture() and the writer
+    Backpressure backpressure = Backpressure::Drop;
+    std::string ppmDirectory;   // also write frame_<step>.ppm of the dye here when set
+};
+
+// Records a FluidSimulation to disk without stalling it. capture() copies
+// the selected fields into a preallocated ring slot and returns; a
+// background thread delta encodes, compresses and writes them (see the
+// format above). capture() is called from the thread that steps the
+// simulation, right after step(); start() and stop() from any one thread
+// while nothing captures. Steady-state capture does not allocate.
+class Recorder {
+public:
+    Recorder() = default;
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // Opens path and starts the writer for fluid's grid size. Reports
+    // errors to std::cerr and returns false.
+    bool start(const std::string& path, const FluidSimulation& fluid, const RecorderSettings& settings);
+    // Writes everything still buffered and closes the file
+    void stop();
+    bool isRecording() const { return writing; }
+
+    // Records fluid if step is a multiple of the decimation. The file has
+    // one grid size, so frames after fluid is resized are dropped (counted
+    // in getFramesDropped()).
+    void capture(const FluidSimulation& fluid, std::uint64_t step);
+
+    std::uint64_t getFramesCaptured() const { return captured.load(std::memory_order_relaxed); }
+    std::uint64_t getFramesWritten() const { return written.load(std::memory_order_relaxed); }
+    std::uint64_t getFramesDropped() const { return dropped.load(std::memory_order_relaxed); }
+    std::uint64_t getBytesWritten() const { return bytesWritten.load(std::memory_order_relaxed); }
+    // Field bytes before encoding, for the compression ratio
+    std::uint64_t getRawBytes() const { return rawBytes.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::uint64_t step = 0;
+        std::vector<float> values;  // recorded fields back to back
+    };
+
+    void run();
+    void writeChunk(const Slot& slot);
+    void writePpm(const Slot& slot);
+
+    RecorderSettings settings;
+    int width = 0;
+    int height = 0;
+    std::vector<RecordedField> fields;
+
+    std::vector<Slot> slots;
+    std::size_t head = 0;  // next slot to fill, guarded by mutex
+    std::size_t tail = 0;  // next slot to write, guarded by mutex
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable filled;
+    std::condition_variable freed;
+
+    // Writer thread only
+    std::ofstream out;
+    std::vector<std::uint32_t> previous;
+    std::vector<std::uint8_t> planes;
+    std::vector<std::uint8_t> encoded;
+    std::vector<std::uint8_t> pixels;
+    std::uint64_t chunks = 0;
+
+    std::thread thread;
+    bool writing = false;
+    std::atomic<std::uint64_t> captured{0};
+    std::atomic<std::uint64_t> written{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::uint64_t> bytesWritten{0};
+    std::atomic<std::uint64_t> rawBytes{0};
+};
+
+// Reads a Recorder file back, chunk by chunk
+class RecordingReader {
+public:
+    // Reports errors to std::cerr and returns false
+    bool open(const std::string& path);
+    const RecordingHeader& getHeader() const { return header; }
+
+    // Decodes the next chunk into step and values (the recorded fields back
+    // to back, as in the file). Returns false at the end or on a bad chunk.
+    bool next(std::uint64_t& step, std::vector<float>& values);
+
+private:
+    std::ifstream in;
+    RecordingHeader header = {};
+    std::size_t fieldCount = 0;
+    std::vector<std::uint32_t> previous;
+    std::vector<std::uint8_t> encoded;
+    std::vector<std::uint8_t> planes;
+};
@@ -0,0 +1,153 @@
+#include "reference.hpp"
+#include <algorithm>
+#include <cmath>
+
+ReferenceSimulation::ReferenceSimulation(int width, int height, float diffusion, float viscosity, float dt,
+                                         int channels)
+    : width(width), height(height), dt(dt), diff(diffusion), visc(viscosity) {
+    int size = width * height;
+    dye.assign(channels, std::vector<float>(size, 0));
+    dye0.assign(channels, std::vector<float>(size, 0));
+    Vx.resize(size, 0);
+    Vy.resize(size, 0);
+    Vx0.resize(size, 0);
+    Vy0.resize(size, 0);
+    p.resize(size, 0);
+    div.resize(size, 0);
+}
+
+void ReferenceSimulation::step() {
+    // Velocity step
+    diffuse(1, Vx0, Vx, visc);
+    diffuse(2, Vy0, Vy, visc);
+    project(Vx0, Vy0);
+    advect(1, Vx, Vx0, Vx0, Vy0);
+    advect(2, Vy, Vy0, Vx0, Vy0);
+    project(Vx, Vy);
+
+    // Dye step for each channel
+    for (size_t c = 0; c < dye.size(); c++) {
+        diffuse(0, dye0[c], dye[c], diff);
+        advect(0, dye[c], dye0[c], Vx, Vy);
+    }
+}
+
+void ReferenceSimulation::addVelocity(int x, int y, float amountX, float amountY) {
+    if (x < 0 || x >= width || y < 0 || y >= height) return;
+    Vx[IX(x, y)] += amountX;
+    Vy[IX(x, y)] += amountY;
+}
+
+void ReferenceSimulation::addToChannel(int channel, int x, int y, float amount) {
+    if (x < 0 || x >= width || y < 0 || y >= height) return;
+    dye[channel][IX(x, y)] += amount;
+}
+
+void ReferenceSimulation::diffuse(int b, std::vector<float>& x, const std::vector<float>& x0, float diff) {
+    float a = dt * diff * (width - 2) * (height - 2);
+    linSolve(b, x, x0, a, 1 + 4 * a);
+}
+
+void ReferenceSimulation::project(std::vector<float>& velocX, std::vector<float>& velocY) {
+    for (int i = 1; i < width - 1; i++) {
+        for (int j = 1; j < height - 1; j++) {
+            div[IX(i, j)] = -0.5f * (
+                velocX[IX(i+1, j)] - velocX[IX(i-1, j)] +
+                velocY[IX(i, j+1)] - velocY[IX(i, j-1)]
+            ) / width;
+            p[IX(i, j)] = 0;
+        }
+    }
+    setBnd(0, div);
+    setBnd(0, p);
+
+    linSolve(0, p, div, 1, 4);
+
+    for (int i = 1; i < width - 1; i++) {
+        for (int j = 1; j < height - 1; j++) {
+            velocX[IX(i, j)] -= 0.5f * (p[IX(i+1, j)] - p[IX(i-1, j)]) * width;
+            velocY[IX(i, j)] -= 0.5f * (p[IX(i, j+1)] - p[IX(i, j-1)]) * width;
+        }
+    }
+    setBnd(1, velocX);
+    setBnd(2, velocY);
+}
+
+void ReferenceSimulation::advect(int b, std::vector<float>& d, const std::vector<float>& d0,
+                                 const std::vector<float>& velocX, const std::vector<float>& velocY) {
+    float dtx = dt * (width - 2);
+    float dty = dt * (height - 2);
+
+    for (int i = 1; i < width - 1; i++) {
+        for (int j = 1; j < height - 1; j++) {
+            float x = i - dtx * velocX[IX(i, j)];
+            float y = j - dty * velocY[IX(i, j)];
+
+            if (x < 0.5f) x = 0.5f;
+            if (x > width - 1.5f) x = width - 1.5f;
+            float i0 = std::floor(x);
+
+            if (y < 0.5f) y = 0.5f;
+            if (y > height - 1.5f) y = height - 1.5f;
+            float j0 = std::floor(y);
+
+            float s1 = x - i0;
+            float s0 = 1.0f - s1;
+            float t1 = y - j0;
+            float t0 = 1.0f - t1;
+
+            int i0i = static_cast<int>(i0);
+            int j0i = static_cast<int>(j0);
+
+            d[IX(i, j)] =
+                s0 * (t0 * d0[IX(i0i, j0i)] + t1 * d0[IX(i0i, j0i + 1)]) +
+                s1 * (t0 * d0[IX(i0i + 1, j0i)] + t1 * d0[IX(i0i + 1, j0i + 1)]);
+        }
+    }
+    setBnd(b, d);
+}
+
+// 20 Gauss-Seidel sweeps of c * x - a * (sum of 4 neighbours) = x0
+void ReferenceSimulation::linSolve(int b, std::vector<float>& x, const std::vector<float>& x0, float a, float c) {
+    for (int k = 0; k < 20; k++) {
+        if (relaxation == Relaxation::Lexicographic) {
+            for (int i = 1; i < width - 1; i++) {
+                for (int j = 1; j < height - 1; j++) {
+                    x[IX(i, j)] = (x0[IX(i, j)] + a * (
+                        x[IX(i+1, j)] + x[IX(i-1, j)] +
+                        x[IX(i, j+1)] + x[IX(i, j-1)]
+                    )) / c;
+                }
+            }
+        } else {
+            // Cells with i + j even first, then the odd ones
+            for (int color = 0; color < 2; color++) {
+                for (int j = 1; j < height - 1; j++) {
+                    for (int i = 1 + ((j + color + 1) & 1); i < width - 1; i += 2) {
+                        x[IX(i, j)] = (x0[IX(i, j)] + a * (
+                            x[IX(i+1, j)] + x[IX(i-1, j)] +
+                            x[IX(i, j+1)] + x[IX(i, j-1)]
+                        )) / c;
+                    }
+                }
+            }
+        }
+        setBnd(b, x);
+    }
+}
+
+void ReferenceSimulation::setBnd(int b, std::vector<float>& x) {
+    for (int i = 1; i < width - 1; i++) {
+        x[IX(i, 0)] = b == 2 ? -x[IX(i, 1)] : x[IX(i, 1)];
+        x[IX(i, height-1)] = b == 2 ? -x[IX(i, height-2)] : x[IX(i, height-2)];
+    }
+    for (int j = 1; j < height - 1; j++) {
+        x[IX(0, j)] = b == 1 ? -x[IX(1, j)] : x[IX(1, j)];
+        x[IX(width-1, j)] = b == 1 ? -x[IX(width-2, j)] : x[IX(width-2, j)];
+    }
+
+    x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
+    x[IX(0, height-1)] = 0.5f * (x[IX(1, height-1)] + x[IX(0, height-2)]);
+    x[IX(width-1, 0)] = 0.5f * (x[IX(width-2, 0)] + x[IX(width-1, 1)]);
+    x[IX(width-1, height-1)] = 0.5f * (x[IX(width-2, height-1)] + x[IX(width-1, height-2)]);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include "grid.hpp"
+
+// The solver step as plain single-threaded scalar loops over whole fields:
+// the kernels fluid.cpp started from, kept as the oracle the optimized
+// FluidSimulation paths are checked against (see bench/fluid_verify.cpp).
+// It follows FluidSimulation's default configuration: 20 relaxation sweeps,
+// diffusion warm started from the previous step's field, pressure started
+// from zero, semi-Lagrangian advection and planar dye. The relaxation order
+// is selectable so either of FluidSimulation's can be matched. There are
+// no barriers, activity tracking or decomposition; keep it that way, since
+// its only job is to be obviously right.
+class ReferenceSimulation {
+public:
+    ReferenceSimulation(int width, int height, float diffusion, float viscosity, float dt, int channels = 3);
+
+    void step();
+    void addVelocity(int x, int y, float amountX, float amountY);
+    void addToChannel(int channel, int x, int y, float amount);
+
+    void setRelaxation(Relaxation relaxation) { this->relaxation = relaxation; }
+    Relaxation getRelaxation() const { return relaxation; }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getChannelCount() const { return static_cast<int>(dye.size()); }
+    const float* getVelocityX() const { return Vx.data(); }
+    const float* getVelocityY() const { return Vy.data(); }
+    const float* getChannel(int channel) const { return dye[channel].data(); }
+
+private:
+    int width;
+    int height;
+    float dt;
+    float diff;
+    float visc;
+    Relaxation relaxation = Relaxation::RedBlack;
+
+    std::vector<std::vector<float>> dye;
+    std::vector<std::vector<float>> dye0;  // diffused dye, per channel
+    std::vector<float> Vx;
+    std::vector<float> Vy;
+    std::vector<float> Vx0;
+    std::vector<float> Vy0;
+    std::vector<float> p;
+    std::vector<float> div;
+
+    void diffuse(int b, std::vector<float>& x, const std::vector<float>& x0, float diff);
+    void project(std::vector<float>& velocX, std::vector<float>& velocY);
+    void advect(int b, std::vector<float>& d, const std::vector<float>& d0,
+                const std::vector<float>& velocX, const std::vector<float>& velocY);
+    void linSolve(int b, std::vector<float>& x, const std::vector<float>& x0, float a, float c);
+    void setBnd(int b, std::vector<float>& x);
+    int IX(int x, int y) const { return x + y * width; }
+};
@@ -0,0 +1,97 @@
+#include "renderer.hpp"
+#include <algorithm>
+#include <iostream>
+#include "tonemap.hpp"
+
+namespace {
+// Brightness added per particle over a pixel, out of 255
+constexpr int PARTICLE_GAIN = 72;
+}
+
+FluidRenderer::FluidRenderer(SDL_Renderer* renderer) : renderer(renderer) {}
+
+FluidRenderer::~FluidRenderer() {
+    if (dyeTexture.texture) SDL_DestroyTexture(dyeTexture.texture);
+    if (particleTexture.texture) SDL_DestroyTexture(particleTexture.texture);
+}
+
+void FluidRenderer::setThreadCount(int threads) {
+    pool = threads > 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+}
+
+bool FluidRenderer::ensureTexture(StreamingTexture& target, int width, int height, SDL_BlendMode blend) {
+    if (target.texture && width == target.width && height == target.height) return true;
+    if (target.texture) SDL_DestroyTexture(target.texture);
+
+    target.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!target.texture) {
+        std::cerr << "Failed to create fluid texture: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    SDL_SetTextureScaleMode(target.texture, SDL_ScaleModeLinear);
+    SDL_SetTextureBlendMode(target.texture, blend);
+    target.width = width;
+    target.height = height;
+    return true;
+}
+
+void FluidRenderer::render(const FluidSimulation& fluid) {
+    draw(fluid.getWidth(), fluid.getHeight(), fluid.getChannel(0), fluid.getChannel(1), fluid.getChannel(2),
+         fluid.getActiveTiles());
+}
+
+void FluidRenderer::render(const DyeFrame& frame) {
+    if (frame.width == 0) return;
+    draw(frame.width, frame.height, frame.channel(0), frame.channel(1), frame.channel(2), frame.activeTiles());
+    if (frame.particleWidth > 0) drawParticles(frame);
+}
+
+void FluidRenderer::draw(int width, int height, ChannelView r, ChannelView g, ChannelView b,
+                         const ActiveTiles* tiles) {
+    Profiler::Scope scope(profiler, Phase::Render);
+    if (!ensureTexture(dyeTexture, width, height, SDL_BLENDMODE_NONE)) return;
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(dyeTexture.texture, nullptr, &pixels, &pitch) != 0) {
+        std::cerr << "Failed to lock fluid texture: " << SDL_GetError() << std::endl;
+        return;
+    }
+    toneMap(r, g, b, width, height, static_cast<std::uint32_t*>(pixels), pitch, pool.get(), tiles);
+    SDL_UnlockTexture(dyeTexture.texture);
+
+    SDL_RenderCopy(renderer, dyeTexture.texture, nullptr, nullptr);
+}
+
+// Counts become a pale blue-white that saturates after a few particles
+void FluidRenderer::drawParticles(const DyeFrame& frame) {
+    Profiler::Scope scope(profiler, Phase::Render);
+    const int width = frame.particleWidth;
+    const int height = frame.particleHeight;
+    if (!ensureTexture(particleTexture, width, height, SDL_BLENDMODE_ADD)) return;
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(particleTexture.texture, nullptr, &pixels, &pitch) != 0) {
+        std::cerr << "Failed to lock particle texture: " << SDL_GetError() << std::endl;
+        return;
+    }
+    auto mapRows = [&](int rowBegin, int rowEnd) {
+        for (int y = rowBegin; y < rowEnd; y++) {
+            const std::uint16_t* counts = &frame.particles[static_cast<size_t>(y) * width];
+            std::uint32_t* row = reinterpret_cast<std::uint32_t*>(static_cast<std::uint8_t*>(pixels) + y * pitch);
+            for (int x = 0; x < width; x++) {
+                const std::uint32_t level = std::min<std::uint32_t>(255, counts[x] * PARTICLE_GAIN);
+                row[x] = 0xff000000u | ((level * 3 / 4) << 16) | ((level * 7 / 8) << 8) | level;
+            }
+        }
+    };
+    if (pool) {
+        pool->parallelFor(0, height, mapRows, 16);
+    } else {
+        mapRows(0, height);
+    }
+    SDL_UnlockTexture(particleTexture.texture);
+
+    SDL_RenderCopy(renderer, particleTexture.texture, nullptr, nullptr);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <memory>
+#include "fluid.hpp"
+#include "sim_thread.hpp"
+
+// Draws the dye fields of a FluidSimulation. Kept out of the solver so the
+// simulation library has no SDL dependency.
+//
+// The dye is tone-mapped into a streaming texture the size of the grid,
+// which one SDL_RenderCopy stretches over the whole render target with
+// linear filtering. Frames with tracer particles add a second streaming
+// texture of per-pixel particle counts on top, blended additively, so a
+// million particles cost one texture upload rather than a draw call each.
+class FluidRenderer {
+public:
+    FluidRenderer(SDL_Renderer* renderer);
+    ~FluidRenderer();
+
+    FluidRenderer(const FluidRenderer&) = delete;
+    FluidRenderer& operator=(const FluidRenderer&) = delete;
+
+    void render(const FluidSimulation& fluid);
+    void render(const DyeFrame& frame);
+
+    // Threads used for tone mapping; 1 (the default) maps on the caller.
+    // The renderer keeps its own pool so it never contends with the solver's.
+    void setThreadCount(int threads);
+
+    // Times render() as Phase::Render when set
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+
+private:
+    struct StreamingTexture {
+        SDL_Texture* texture = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+
+    bool ensureTexture(StreamingTexture& target, int width, int height, SDL_BlendMode blend);
+    void draw(int width, int height, ChannelView r, ChannelView g, ChannelView b, const ActiveTiles* tiles);
+    void drawParticles(const DyeFrame& frame);
+
+    SDL_Renderer* renderer;
+    StreamingTexture dyeTexture;
+    StreamingTexture particleTexture;
+    std::unique_ptr<ThreadPool> pool;
+    Profiler* profiler = nullptr;
+};
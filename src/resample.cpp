@@ -0,0 +1,54 @@
+#include "resample.hpp"
+#include <algorithm>
+#include <cmath>
+
+AreaResampler::AreaResampler(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+    : srcWidth(srcWidth), srcHeight(srcHeight), dstWidth(dstWidth), dstHeight(dstHeight) {
+    buildTaps(srcWidth - 2, dstWidth - 2, columnTaps, columnWeights);
+    buildTaps(srcHeight - 2, dstHeight - 2, rowTaps, rowWeights);
+    rows.resize(static_cast<size_t>(dstWidth - 2) * (srcHeight - 2));
+}
+
+// Destination cell k covers [k * ratio, (k + 1) * ratio) in source cells;
+// each source cell it overlaps is weighted by the overlap over the footprint
+void AreaResampler::buildTaps(int srcCells, int dstCells, std::vector<Taps>& taps, std::vector<float>& weights) {
+    const double ratio = static_cast<double>(srcCells) / dstCells;
+    taps.resize(dstCells);
+    weights.clear();
+    for (int k = 0; k < dstCells; k++) {
+        const double begin = k * ratio;
+        const double end = (k + 1) * ratio;
+        const int first = static_cast<int>(std::floor(begin));
+        const int last = std::min(srcCells - 1, static_cast<int>(std::ceil(end)) - 1);
+        taps[k] = Taps{first, last - first + 1, static_cast<int>(weights.size())};
+        for (int i = first; i <= last; i++) {
+            const double overlap = std::min<double>(i + 1, end) - std::max<double>(i, begin);
+            weights.push_back(static_cast<float>(overlap / ratio));
+        }
+    }
+}
+
+void AreaResampler::resample(ChannelView src, float* dst) {
+    const int rowCells = dstWidth - 2;
+    for (int j = 0; j < srcHeight - 2; j++) {
+        const int srcRow = (j + 1) * srcWidth + 1;
+        float* out = &rows[static_cast<size_t>(j) * rowCells];
+        for (int k = 0; k < rowCells; k++) {
+            const Taps& taps = columnTaps[k];
+            const float* weight = &columnWeights[taps.offset];
+            float sum = 0;
+            for (int t = 0; t < taps.count; t++) sum += weight[t] * src[srcRow + taps.first + t];
+            out[k] = sum;
+        }
+    }
+    for (int k = 0; k < dstHeight - 2; k++) {
+        const Taps& taps = rowTaps[k];
+        const float* weight = &rowWeights[taps.offset];
+        float* out = &dst[(k + 1) * dstWidth + 1];
+        std::fill(out, out + rowCells, 0.0f);
+        for (int t = 0; t < taps.count; t++) {
+            const float* in = &rows[static_cast<size_t>(taps.first + t) * rowCells];
+            for (int i = 0; i < rowCells; i++) out[i] += weight[t] * in[i];
+        }
+    }
+}
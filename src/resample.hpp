@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include "dye.hpp"
+
+// Area-weighted resampling between two grids with a one-cell ghost border
+// whose interiors cover the same domain. Each destination cell gets the
+// average of the source over its footprint, so a field's integral over the
+// domain (dye mass, momentum) is kept up to rounding whether the grid
+// shrinks or grows. Separable: rows are resampled first, then columns.
+class AreaResampler {
+public:
+    AreaResampler(int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+    // Writes the interior of dst (dstWidth * dstHeight floats); its ghost
+    // cells are left for setBnd
+    void resample(ChannelView src, float* dst);
+
+private:
+    // Source cells [first, first + count) with weights from offset on
+    struct Taps {
+        int first;
+        int count;
+        int offset;
+    };
+
+    static void buildTaps(int srcCells, int dstCells, std::vector<Taps>& taps, std::vector<float>& weights);
+
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int dstHeight;
+    std::vector<Taps> columnTaps;
+    std::vector<float> columnWeights;
+    std::vector<Taps> rowTaps;
+    std::vector<float> rowWeights;
+    std::vector<float> rows;  // source rows resampled to the destination width
+};
@@ -0,0 +1,39 @@
+#include "resolution.hpp"
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(int baseWidth, int baseHeight, const ResolutionSettings& settings)
+    : baseWidth(baseWidth), baseHeight(baseHeight), settings(settings) {}
+
+bool ResolutionController::update(double stepSeconds, int& width, int& height) {
+    if (++samples <= settings.cooldown) return false;
+    average = samples == settings.cooldown + 1 ? stepSeconds
+                                               : average + settings.smoothing * (stepSeconds - average);
+
+    const double target = settings.targetSeconds;
+    if (average > settings.upperBand * target && scale > settings.minScale) {
+        outside = std::max(outside, 0) + 1;
+    } else if (average < settings.lowerBand * target && scale < settings.maxScale) {
+        outside = std::min(outside, 0) - 1;
+    } else {
+        outside = 0;
+    }
+    if (std::abs(outside) < settings.patience) return false;
+
+    // Cost scales with the cell count, so each dimension with its square root
+    const double aim = 0.5 * (settings.lowerBand + settings.upperBand) * target;
+    float factor = static_cast<float>(std::sqrt(aim / average));
+    factor = std::clamp(factor, 1.0f / settings.maxStepScale, settings.maxStepScale);
+    const float next = std::clamp(scale * factor, settings.minScale, settings.maxScale);
+    const int nextWidth = std::max(3, static_cast<int>(std::lround(baseWidth * next)));
+    const int nextHeight = std::max(3, static_cast<int>(std::lround(baseHeight * next)));
+    outside = 0;
+    if (nextWidth == width && nextHeight == height) return false;
+
+    scale = next;
+    width = nextWidth;
+    height = nextHeight;
+    samples = 0;
+    resizes++;
+    return true;
+}
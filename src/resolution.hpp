@@ -0,0 +1,44 @@
+#pragma once
+
+struct ResolutionSettings {
+    double targetSeconds = 0.008;  // step() time to hold
+    // The grid grows while the average step is below lowerBand * target
+    // and shrinks while it is above upperBand * target; in between it is
+    // left alone, so a size that lands inside the band stays
+    double lowerBand = 0.7;
+    double upperBand = 1.1;
+    double smoothing = 0.1;   // weight of the newest step in the moving average
+    int patience = 20;        // consecutive steps outside the band before resizing
+    int cooldown = 30;        // steps ignored after a resize while caches and warm starts settle
+    float maxStepScale = 1.5f;  // largest change of either dimension per resize
+    float minScale = 0.25f;     // relative to the base size
+    float maxScale = 4.0f;
+};
+
+// Picks grid sizes that keep FluidSimulation::step() within a time budget.
+// Sizes keep the base size's aspect ratio. After each step, update() is
+// given its duration; once the moving average has stayed outside the band
+// for `patience` steps it proposes the size the step cost (taken as
+// proportional to the cell count) predicts for the middle of the band.
+class ResolutionController {
+public:
+    ResolutionController(int baseWidth, int baseHeight, const ResolutionSettings& settings = {});
+
+    // Returns true and sets width and height when the grid should change
+    bool update(double stepSeconds, int& width, int& height);
+
+    const ResolutionSettings& getSettings() const { return settings; }
+    double getAverageSeconds() const { return average; }
+    float getScale() const { return scale; }
+    int getResizeCount() const { return resizes; }
+
+private:
+    int baseWidth;
+    int baseHeight;
+    ResolutionSettings settings;
+    float scale = 1.0f;
+    double average = 0;
+    int samples = 0;   // steps averaged since the last resize
+    int outside = 0;   // consecutive steps outside the band, negative below it
+    int resizes = 0;
+};
@@ -0,0 +1,195 @@
+#include "shm_transport.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FLUID_HAVE_SHM 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr std::uint32_t SHM_MAGIC = 0x464C4853u;  // "FLHS"
+constexpr std::size_t WINDOW_ALIGNMENT = 64;
+
+// Spins before a waiting rank starts yielding its core
+constexpr int SPINS_BEFORE_YIELD = 256;
+}
+
+// Atomics in the segment are shared between processes, which is only
+// sound when they are lock-free
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "shared barrier needs lock-free atomics");
+
+struct ShmTransport::Header {
+    std::uint32_t magic;
+    std::int32_t ranks;
+    std::uint64_t windowFloats;
+    alignas(64) std::atomic<std::uint32_t> arrived;
+    alignas(64) std::atomic<std::uint32_t> generation;
+    alignas(64) double reduce[2][MAX_RANKS];
+};
+
+// Windows start on the first cache line after the header
+std::size_t ShmTransport::headerBytes() {
+    return (sizeof(Header) + WINDOW_ALIGNMENT - 1) / WINDOW_ALIGNMENT * WINDOW_ALIGNMENT;
+}
+
+#ifdef FLUID_HAVE_SHM
+
+bool ShmTransport::create(const std::string& name, int ranks, std::size_t windowFloats) {
+    if (ranks < 1 || ranks > MAX_RANKS) {
+        std::cerr << "Shared memory transport supports 1 to " << MAX_RANKS << " ranks" << std::endl;
+        return false;
+    }
+    const std::size_t bytes = headerBytes() + 2 * static_cast<std::size_t>(ranks) * windowFloats * sizeof(float);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to create shared memory " << name << std::endl;
+        return false;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << name << std::endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    Header* header = new (memory) Header();
+    header->ranks = ranks;
+    header->windowFloats = windowFloats;
+    header->arrived.store(0, std::memory_order_relaxed);
+    header->generation.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_MAGIC;
+    munmap(memory, bytes);
+    return true;
+}
+
+void ShmTransport::unlink(const std::string& name) {
+    shm_unlink(name.c_str());
+}
+
+std::unique_ptr<ShmTransport> ShmTransport::attach(const std::string& name, int rank) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to open shared memory " << name << std::endl;
+        return nullptr;
+    }
+    struct stat info;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) >= headerBytes()) {
+        memory = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << name << std::endl;
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmTransport> transport(new ShmTransport());
+    transport->header = static_cast<Header*>(memory);
+    transport->mappedBytes = static_cast<std::size_t>(info.st_size);
+    transport->ownRank = rank;
+    if (transport->header->magic != SHM_MAGIC || rank < 0 || rank >= transport->header->ranks) {
+        std::cerr << "Invalid shared memory transport " << name << " for rank " << rank << std::endl;
+        return nullptr;
+    }
+    return transport;
+}
+
+ShmTransport::~ShmTransport() {
+    if (header) munmap(header, mappedBytes);
+}
+
+#else
+
+bool ShmTransport::create(const std::string& name, int, std::size_t) {
+    std::cerr << "Shared memory transport is not available on this platform (" << name << ")" << std::endl;
+    return false;
+}
+
+void ShmTransport::unlink(const std::string&) {}
+
+std::unique_ptr<ShmTransport> ShmTransport::attach(const std::string&, int) {
+    return nullptr;
+}
+
+ShmTransport::~ShmTransport() {}
+
+#endif
+
+int ShmTransport::size() const {
+    return header->ranks;
+}
+
+std::size_t ShmTransport::windowFloats() const {
+    return header->windowFloats;
+}
+
+float* ShmTransport::window(int rank, int epoch) const {
+    std::byte* base = reinterpret_cast<std::byte*>(header) + headerBytes();
+    return reinterpret_cast<float*>(base) + (static_cast<std::size_t>(rank) * 2 + (epoch & 1)) * header->windowFloats;
+}
+
+void ShmTransport::put(std::size_t offset, const float* data, std::size_t count) {
+    std::memcpy(window(ownRank, windowEpoch) + offset, data, count * sizeof(float));
+}
+
+// Puts go to this epoch's window and gets read the previous one. A rank can
+// only start writing a window again after the next fence, which every rank
+// reaches only once it has finished reading it.
+void ShmTransport::fence() {
+    barrier();
+    windowEpoch++;
+}
+
+void ShmTransport::get(int rank, std::size_t offset, float* out, std::size_t count) {
+    std::memcpy(out, window(rank, windowEpoch - 1) + offset, count * sizeof(float));
+}
+
+const double* ShmTransport::gather(double value) {
+    double* slots = header->reduce[reduceEpoch & 1];
+    slots[ownRank] = value;
+    barrier();
+    reduceEpoch++;
+    return slots;
+}
+
+double ShmTransport::sum(double value) {
+    const double* values = gather(value);
+    double total = 0;
+    for (int r = 0; r < header->ranks; r++) total += values[r];
+    return total;
+}
+
+double ShmTransport::max(double value) {
+    const double* values = gather(value);
+    double result = values[0];
+    for (int r = 1; r < header->ranks; r++) result = std::max(result, values[r]);
+    return result;
+}
+
+// Sense-reversing barrier: the last rank to arrive resets the count and
+// advances the generation the others are waiting on
+void ShmTransport::barrier() {
+    const std::uint32_t generation = header->generation.load(std::memory_order_acquire);
+    if (header->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == static_cast<std::uint32_t>(header->ranks)) {
+        header->arrived.store(0, std::memory_order_relaxed);
+        header->generation.store(generation + 1, std::memory_order_release);
+        return;
+    }
+    for (int spins = 0; header->generation.load(std::memory_order_acquire) == generation; spins++) {
+        if (spins > SPINS_BEFORE_YIELD) std::this_thread::yield();
+    }
+}
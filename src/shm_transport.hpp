@@ -0,0 +1,56 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "halo.hpp"
+
+// HaloTransport between processes on one machine through a POSIX shared
+// memory segment. The segment holds a barrier, the reduction slots and two
+// windows per rank, used in alternate epochs so a fence is the only
+// synchronisation a put/get round needs. Not available on platforms without
+// shm_open, where create() fails.
+class ShmTransport : public HaloTransport {
+public:
+    static constexpr int MAX_RANKS = 64;
+
+    // Creates the named segment for ranks processes, each exposing a window
+    // of windowFloats. Call once, before any rank attaches. Reports errors
+    // to std::cerr and returns false.
+    static bool create(const std::string& name, int ranks, std::size_t windowFloats);
+    // Removes the name; mappings stay valid until their transports close
+    static void unlink(const std::string& name);
+
+    // Maps the segment as rank; nullptr on error
+    static std::unique_ptr<ShmTransport> attach(const std::string& name, int rank);
+
+    ~ShmTransport() override;
+
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+
+    int rank() const override { return ownRank; }
+    int size() const override;
+    std::size_t windowFloats() const override;
+
+    void put(std::size_t offset, const float* data, std::size_t count) override;
+    void fence() override;
+    void get(int rank, std::size_t offset, float* out, std::size_t count) override;
+
+    double sum(double value) override;
+    double max(double value) override;
+
+private:
+    struct Header;
+
+    ShmTransport() = default;
+    static std::size_t headerBytes();
+    void barrier();
+    float* window(int rank, int epoch) const;
+    // Publishes value and returns every rank's, in rank order
+    const double* gather(double value);
+
+    Header* header = nullptr;
+    std::size_t mappedBytes = 0;
+    int ownRank = 0;
+    int windowEpoch = 0;
+    int reduceEpoch = 0;
+};
@@ -0,0 +1,237 @@
+#include "sim_thread.hpp"
+#include <chrono>
+
+namespace {
+// Steps run in one catch-up burst at most; time beyond that is dropped so a
+// slow machine falls behind real time instead of spiralling
+constexpr int MAX_CATCH_UP_STEPS = 4;
+}
+
+InputEvent InputEvent::density(int x, int y, float amount, int r, int g, int b) {
+    InputEvent event;
+    event.type = Type::Density;
+    event.x = x;
+    event.y = y;
+    event.amount = amount;
+    event.r = r;
+    event.g = g;
+    event.b = b;
+    return event;
+}
+
+InputEvent InputEvent::velocity(int x, int y, float amountX, float amountY) {
+    InputEvent event;
+    event.type = Type::Velocity;
+    event.x = x;
+    event.y = y;
+    event.amount = amountX;
+    event.amountY = amountY;
+    return event;
+}
+
+InputEvent InputEvent::explosion(int x, int y, float power, int r, int g, int b) {
+    InputEvent event = density(x, y, power, r, g, b);
+    event.type = Type::Explosion;
+    return event;
+}
+
+InputEvent InputEvent::fromSplat(const Splat& splat) {
+    InputEvent event;
+    event.type = Type::Splat;
+    event.splat = splat;
+    return event;
+}
+
+InputEvent InputEvent::emitter(int x, int y, float radius, float rate) {
+    InputEvent event;
+    event.type = Type::Emitter;
+    event.x = x;
+    event.y = y;
+    event.amount = radius;
+    event.amountY = rate;
+    return event;
+}
+
+InputEvent InputEvent::collector(int x, int y, float radius) {
+    InputEvent event;
+    event.type = Type::Collector;
+    event.x = x;
+    event.y = y;
+    event.amount = radius;
+    return event;
+}
+
+InputEvent InputEvent::reset() {
+    return InputEvent();
+}
+
+InputEvent InputEvent::profiling(bool enabled) {
+    InputEvent event;
+    event.type = Type::Profiling;
+    event.amount = enabled ? 1.0f : 0.0f;
+    return event;
+}
+
+SimulationThread::SimulationThread(FluidSimulation& fluid, double stepSeconds)
+    : fluid(fluid), stepSeconds(stepSeconds) {}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (running.exchange(true)) return;
+    publishFrame();
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (!running.exchange(false)) return;
+    thread.join();
+}
+
+void SimulationThread::setParticles(ParticleSystem* particles, int imageWidth, int imageHeight) {
+    this->particles = particles;
+    particleWidth = imageWidth;
+    particleHeight = imageHeight;
+    if (particles) particles->setProfiler(&fluid.getProfiler());
+    // Each step's frame then ends after its particles
+    fluid.setEndsProfilerFrames(particles == nullptr);
+}
+
+bool SimulationThread::post(const InputEvent& event) {
+    if (input.push(event)) return true;
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    const auto stepDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(stepSeconds));
+    auto last = Clock::now();
+    Clock::duration accumulator{0};
+
+    while (running.load(std::memory_order_relaxed)) {
+        auto now = Clock::now();
+        accumulator += now - last;
+        last = now;
+        if (accumulator > stepDuration * MAX_CATCH_UP_STEPS) accumulator = stepDuration * MAX_CATCH_UP_STEPS;
+
+        if (accumulator < stepDuration) {
+            std::this_thread::sleep_for(stepDuration - accumulator);
+            continue;
+        }
+
+        while (accumulator >= stepDuration) {
+            applyInput();
+            auto stepStart = Clock::now();
+            fluid.step();
+            if (resolution) {
+                int width = fluid.getWidth();
+                int height = fluid.getHeight();
+                double seconds = std::chrono::duration<double>(Clock::now() - stepStart).count();
+                if (resolution->update(seconds, width, height)) fluid.resize(width, height);
+            }
+            if (particles) particles->step(fluid);
+            std::uint64_t step = steps.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (recorder) recorder->capture(fluid, step);
+            accumulator -= stepDuration;
+            if (particles) {
+                // Only the burst's last step is shown
+                if (accumulator < stepDuration) rasterizeParticles();
+                if (fluid.getProfiler().isEnabled()) fluid.getProfiler().endFrame();
+            }
+        }
+        publishFrame();
+    }
+}
+
+void SimulationThread::applyInput() {
+    InputEvent event;
+    while (input.pop(event)) {
+        switch (event.type) {
+            case InputEvent::Type::Density:
+                fluid.addDensity(event.x, event.y, event.amount, event.r, event.g, event.b);
+                break;
+            case InputEvent::Type::Velocity:
+                fluid.addVelocity(event.x, event.y, event.amount, event.amountY);
+                break;
+            case InputEvent::Type::Explosion:
+                fluid.createExplosion(event.x, event.y, event.amount, event.r, event.g, event.b);
+                break;
+            case InputEvent::Type::Splat:
+                fluid.queueSplat(event.splat);
+                break;
+            case InputEvent::Type::Emitter:
+                if (particles) {
+                    particles->addEmitter({static_cast<float>(event.x), static_cast<float>(event.y), event.amount,
+                                           event.amountY});
+                }
+                break;
+            case InputEvent::Type::Collector:
+                if (particles) {
+                    particles->addCollector({static_cast<float>(event.x), static_cast<float>(event.y), event.amount});
+                }
+                break;
+            case InputEvent::Type::Reset:
+                fluid.reset();
+                if (particles) {
+                    particles->clear();
+                    particles->clearRegions();
+                }
+                break;
+            case InputEvent::Type::Profiling:
+                if (event.amount != 0 && !fluid.getProfiler().isEnabled()) fluid.getProfiler().reset();
+                fluid.getProfiler().setEnabled(event.amount != 0);
+                break;
+        }
+    }
+}
+
+void SimulationThread::publishFrame() {
+    DyeFrame& frame = frames.writeBuffer();
+    frame.width = fluid.getWidth();
+    frame.height = fluid.getHeight();
+    frame.step = steps.load(std::memory_order_relaxed);
+
+    const ActiveTiles* tiles = fluid.getActiveTiles();
+    frame.sparse = tiles != nullptr;
+    if (tiles) frame.tiles = *tiles;
+    frame.profiled = fluid.getProfiler().isEnabled();
+    if (frame.profiled) fluid.getProfiler().snapshot(frame.profile);
+
+    const int cells = frame.width * frame.height;
+    std::vector<float>* planes[3] = {&frame.r, &frame.g, &frame.b};
+    for (int c = 0; c < 3; c++) {
+        std::vector<float>& plane = *planes[c];
+        // Only active spans are copied. The planes are recycled by the
+        // triple buffer, so inactive tiles keep whatever an earlier frame
+        // left there; readers mask them with activeTiles() (toneMap() draws
+        // them black)
+        if (plane.size() != static_cast<size_t>(cells)) plane.assign(cells, 0.0f);
+        ChannelView view = fluid.getChannel(c);
+        if (!tiles) {
+            for (int idx = 0; idx < cells; idx++) plane[idx] = view[idx];
+            continue;
+        }
+        for (int y = 0; y < frame.height; y++) {
+            for (const ActiveTiles::Span& span : tiles->rowSpans(y)) {
+                for (int idx = y * frame.width + span.begin; idx < y * frame.width + span.end; idx++) {
+                    plane[idx] = view[idx];
+                }
+            }
+        }
+    }
+
+    frames.publish();
+}
+
+// Into the frame publishFrame() completes next
+void SimulationThread::rasterizeParticles() {
+    DyeFrame& frame = frames.writeBuffer();
+    frame.particleWidth = particleWidth;
+    frame.particleHeight = particleHeight;
+    frame.particleCount = particles->getCount();
+    frame.particles.assign(static_cast<size_t>(particleWidth) * particleHeight, 0);
+    particles->rasterize(frame.particles.data(), particleWidth, particleHeight);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "fluid.hpp"
+#include "particles.hpp"
+#include "recorder.hpp"
+#include "resolution.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+
+// User input forwarded to the simulation thread
+struct InputEvent {
+    enum class Type { Density, Velocity, Explosion, Splat, Emitter, Collector, Reset, Profiling };
+
+    Type type = Type::Reset;
+    int x = 0;
+    int y = 0;
+    float amount = 0;   // density amount, explosion power, velocity x, region radius or profiling on (1) / off (0)
+    float amountY = 0;  // velocity y or emitter rate
+    int r = 0;
+    int g = 0;
+    int b = 0;
+    Splat splat;        // queued with FluidSimulation::queueSplat
+
+    static InputEvent density(int x, int y, float amount, int r, int g, int b);
+    static InputEvent velocity(int x, int y, float amountX, float amountY);
+    static InputEvent explosion(int x, int y, float power, int r, int g, int b);
+    static InputEvent fromSplat(const Splat& splat);
+    // Particle regions; ignored without a particle system
+    static InputEvent emitter(int x, int y, float radius, float rate);
+    static InputEvent collector(int x, int y, float radius);
+    static InputEvent reset();
+    // Enables the solver's profiler (starting it from a reset) or disables it
+    static InputEvent profiling(bool enabled);
+};
+
+// Planar copy of the R, G and B dye channels after a completed step
+struct DyeFrame {
+    int width = 0;
+    int height = 0;
+    std::uint64_t step = 0;
+    std::vector<float> r;
+    std::vector<float> g;
+    std::vector<float> b;
+    // Only the active tiles' dye was copied; the rest of r, g and b is
+    // stale and must be masked with activeTiles()
+    bool sparse = false;
+    ActiveTiles tiles;
+    bool profiled = false;    // the solver's profiler was enabled
+    ProfileSnapshot profile;
+    // Tracer particles over each pixel of a particleWidth x particleHeight
+    // image covering the grid (see ParticleSystem::rasterize); empty
+    // without a particle system
+    int particleWidth = 0;
+    int particleHeight = 0;
+    int particleCount = 0;
+    std::vector<std::uint16_t> particles;
+
+    ChannelView channel(int c) const { return ChannelView{c == 0 ? r.data() : c == 1 ? g.data() : b.data(), 1}; }
+    const ActiveTiles* activeTiles() const { return sparse ? &tiles : nullptr; }
+};
+
+// Runs FluidSimulation::step() on its own thread at a fixed wall-clock rate,
+// independent of the display. Input arrives through a lock-free queue and
+// is applied before the next step; finished frames go out through a triple
+// buffer. While running, the simulation must only be touched through this
+// class.
+class SimulationThread {
+public:
+    // stepSeconds is the wall-clock time between steps
+    explicit SimulationThread(FluidSimulation& fluid, double stepSeconds = 1.0 / 60);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void start();
+    void stop();
+
+    // Any single thread. Returns false, dropping the event, if the queue is full.
+    bool post(const InputEvent& event);
+
+    // Fed after every step. Set while stopped; the recorder must be started
+    // before start() and stopped after stop().
+    void setRecorder(Recorder* recorder) { this->recorder = recorder; }
+
+    // Times every step and resizes the grid as the controller proposes,
+    // so frames change size along with it. Set while stopped. Input
+    // coordinates refer to the grid size of the latest frame.
+    void setResolutionController(ResolutionController* controller) { resolution = controller; }
+
+    // Stepped after every solver step and rasterized into every frame at
+    // imageWidth x imageHeight; a reset clears its particles and regions.
+    // Both are timed in the profiler frame of the step they belong to.
+    // Set while stopped.
+    void setParticles(ParticleSystem* particles, int imageWidth, int imageHeight);
+
+    // Reader thread only. The newest completed frame; width is 0 until the
+    // first frame is published.
+    const DyeFrame& latestFrame() { return frames.read(); }
+
+    std::uint64_t getStepCount() const { return steps.load(std::memory_order_relaxed); }
+    std::uint64_t getDroppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    void applyInput();
+    void publishFrame();
+    void rasterizeParticles();
+
+    FluidSimulation& fluid;
+    double stepSeconds;
+
+    Recorder* recorder = nullptr;
+    ResolutionController* resolution = nullptr;
+    ParticleSystem* particles = nullptr;
+    int particleWidth = 0;
+    int particleHeight = 0;
+    SpscQueue<InputEvent, 1024> input;
+    TripleBuffer<DyeFrame> frames;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<std::uint64_t> steps{0};
+    std::atomic<std::uint64_t> dropped{0};
+};
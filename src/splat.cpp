@@ -0,0 +1,92 @@
+#include "splat.hpp"
+#include <algorithm>
+#include <cmath>
+
+Splat Splat::point(float x, float y, float amount, int r, int g, int b, float velocityX, float velocityY) {
+    return gaussian(x, y, 0, amount, r, g, b, velocityX, velocityY);
+}
+
+Splat Splat::gaussian(float x, float y, float radius, float amount, int r, int g, int b,
+                      float velocityX, float velocityY) {
+    Splat splat;
+    splat.x = x;
+    splat.y = y;
+    splat.radius = radius;
+    splat.amount = amount;
+    splat.r = r;
+    splat.g = g;
+    splat.b = b;
+    splat.velocityX = velocityX;
+    splat.velocityY = velocityY;
+    return splat;
+}
+
+Splat Splat::explosion(float x, float y, float power, int r, int g, int b) {
+    Splat splat = gaussian(x, y, 20.0f, power * 10.0f, r, g, b);
+    splat.falloff = SplatFalloff::Cubic;
+    splat.push = power * 50.0f;
+    return splat;
+}
+
+Splat Splat::segment(float x0, float y0, float x1, float y1, float radius, float amount,
+                     int r, int g, int b, float velocityX, float velocityY) {
+    Splat splat = gaussian(x0, y0, radius, amount, r, g, b, velocityX, velocityY);
+    splat.stroke = true;
+    splat.endX = x1;
+    splat.endY = y1;
+    return splat;
+}
+
+namespace {
+
+std::unique_ptr<SplatKernel> buildKernel(SplatFalloff falloff, int key) {
+    auto kernel = std::make_unique<SplatKernel>();
+    const float radius = key / 8.0f;
+    kernel->falloff = falloff;
+    kernel->key = key;
+    kernel->extent = static_cast<int>(falloff == SplatFalloff::Gaussian ? std::ceil(2 * radius) : std::floor(radius));
+    const int extent = kernel->extent;
+    const size_t cells = static_cast<size_t>(2 * extent + 1) * (2 * extent + 1);
+    kernel->weight.assign(cells, 0.0f);
+    kernel->outwardX.assign(cells, 0.0f);
+    kernel->outwardY.assign(cells, 0.0f);
+
+    size_t k = 0;
+    for (int j = -extent; j <= extent; j++) {
+        for (int i = -extent; i <= extent; i++, k++) {
+            float dist = std::sqrt(static_cast<float>(i * i + j * j));
+            float weight = 0;
+            if (falloff == SplatFalloff::Gaussian) {
+                weight = radius > 0 ? std::exp(-(dist * dist) / (radius * radius)) : 1.0f;
+            } else if (radius == 0) {
+                weight = 1.0f;
+            } else if (dist <= radius) {
+                weight = (radius - dist) / radius;
+                weight = weight * weight * weight;
+            }
+            kernel->weight[k] = weight;
+            if (dist > 0.1f) {
+                kernel->outwardX[k] = i / dist * weight;
+                kernel->outwardY[k] = j / dist * weight;
+            }
+        }
+    }
+    return kernel;
+}
+
+}  // namespace
+
+const SplatKernel& SplatKernels::get(SplatFalloff falloff, float radius) {
+    const int key = static_cast<int>(std::lround(std::clamp(radius, 0.0f, MAX_RADIUS) * 8));
+    for (const auto& kernel : kernels) {
+        if (kernel->falloff == falloff && kernel->key == key) return *kernel;
+    }
+    if (static_cast<int>(kernels.size()) < CAPACITY) {
+        kernels.push_back(buildKernel(falloff, key));
+        return *kernels.back();
+    }
+    kernels[next] = buildKernel(falloff, key);
+    const SplatKernel& kernel = *kernels[next];
+    next = (next + 1) % CAPACITY;
+    return kernel;
+}
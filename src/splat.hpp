@@ -0,0 +1,73 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+// Radial profile of a splat's footprint
+enum class SplatFalloff {
+    Gaussian,  // exp(-d^2 / radius^2), cut off at 2 * radius
+    Cubic      // ((radius - d) / radius)^3 inside radius, as createExplosion
+};
+
+// One impulse of dye and momentum, in the simulation's input coordinates.
+// The footprint is stamped at the cell nearest (x, y); within it each cell
+// gets weight * amount / 255 of the colour in dye channels 0-2 (as
+// addDensity) and weight * (velocityX, velocityY) plus `push` along the
+// outward unit vector times the weight.
+struct Splat {
+    SplatFalloff falloff = SplatFalloff::Gaussian;
+    float x = 0;
+    float y = 0;
+    float radius = 0;  // 0 stamps a single cell
+    float amount = 0;
+    int r = 0;
+    int g = 0;
+    int b = 0;
+    float velocityX = 0;
+    float velocityY = 0;
+    float push = 0;
+    // A stroke stamps the footprint at steps of at most one cell (or half
+    // the radius, if larger) along (x, y) to (endX, endY), leaving out the
+    // start so consecutive strokes of a drag chain without doubling up.
+    bool stroke = false;
+    float endX = 0;
+    float endY = 0;
+
+    // addDensity and addVelocity on one cell
+    static Splat point(float x, float y, float amount, int r, int g, int b,
+                       float velocityX = 0, float velocityY = 0);
+    static Splat gaussian(float x, float y, float radius, float amount, int r, int g, int b,
+                          float velocityX = 0, float velocityY = 0);
+    // createExplosion's footprint: radius 20, cubic falloff, outward push
+    static Splat explosion(float x, float y, float power, int r, int g, int b);
+    // A Gaussian (or, with radius 0, point) splat dragged from (x0, y0) to (x1, y1)
+    static Splat segment(float x0, float y0, float x1, float y1, float radius, float amount,
+                         int r, int g, int b, float velocityX = 0, float velocityY = 0);
+};
+
+// Footprint weights over a (2 * extent + 1)^2 square, row by row, with the
+// outward unit vector premultiplied by the weight
+struct SplatKernel {
+    SplatFalloff falloff;
+    int key;  // radius in eighths of a cell
+    int extent;
+    std::vector<float> weight;
+    std::vector<float> outwardX;
+    std::vector<float> outwardY;
+};
+
+// Kernels built on first use and kept for reuse, so stamping a splat costs
+// a multiply-add per covered cell and no square roots or exponentials.
+// Radii are rounded to an eighth of a cell and capped at MAX_RADIUS; the
+// least recently built kernel is dropped once CAPACITY are cached.
+class SplatKernels {
+public:
+    static constexpr float MAX_RADIUS = 32.0f;
+    static constexpr int CAPACITY = 16;
+
+    // Valid until the next call
+    const SplatKernel& get(SplatFalloff falloff, float radius);
+
+private:
+    std::vector<std::unique_ptr<SplatKernel>> kernels;
+    int next = 0;  // slot replaced when full
+};
@@ -0,0 +1,78 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount) {
+    int background = std::max(1, threadCount) - 1;
+    workers.reserve(background);
+    for (int i = 0; i < background; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::defaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::runChunk(int chunk) {
+    long long range = taskEnd - taskBegin;
+    int chunkBegin = taskBegin + static_cast<int>(range * chunk / chunkCount);
+    int chunkEnd = taskBegin + static_cast<int>(range * (chunk + 1) / chunkCount);
+    (*task)(chunkBegin, chunkEnd);
+}
+
+void ThreadPool::parallelFor(int begin, int end, FunctionRef<void(int, int)> fn, int minChunk) {
+    if (end <= begin) return;
+
+    int chunks = std::min(getThreadCount(), std::max(1, (end - begin) / std::max(1, minChunk)));
+    if (chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &fn;
+        taskBegin = begin;
+        taskEnd = end;
+        chunkCount = chunks;
+        pending = chunks - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runChunk(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return pending == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::workerLoop(int index) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        if (index >= chunkCount) continue;
+        lock.unlock();
+
+        runChunk(index);
+
+        lock.lock();
+        if (--pending == 0) {
+            finished.notify_one();
+        }
+    }
+}
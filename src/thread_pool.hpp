@@ -0,0 +1,46 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "function_ref.hpp"
+
+// Persistent pool of worker threads for data-parallel loops over grid rows.
+// The calling thread takes part in every loop, so a pool of N threads owns
+// N - 1 background workers.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int getThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Splits [begin, end) into contiguous chunks of at least minChunk items,
+    // runs fn(chunkBegin, chunkEnd) on each and returns once all are done.
+    // Must not be called from inside fn.
+    void parallelFor(int begin, int end, FunctionRef<void(int, int)> fn, int minChunk = 1);
+
+    // Hardware thread count, at least 1
+    static int defaultThreadCount();
+
+private:
+    void workerLoop(int index);
+    void runChunk(int chunk);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const FunctionRef<void(int, int)>* task = nullptr;
+    int taskBegin = 0;
+    int taskEnd = 0;
+    int chunkCount = 0;
+    int pending = 0;
+    std::uint64_t generation = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,73 @@
+#include "tonemap.hpp"
+#include <algorithm>
+
+namespace {
+
+// Rows per parallel chunk; a row is cheap so chunks must be large
+constexpr int TONE_MAP_GRAIN = 32;
+
+inline std::uint32_t level(float v) {
+    return static_cast<std::uint32_t>(std::min(255.0f, std::max(0.0f, v * 255)));
+}
+
+inline std::uint32_t packPixel(float r, float g, float b) {
+    return 0xFF000000u | level(r) << 16 | level(g) << 8 | level(b);
+}
+
+// S is the shared channel stride when known at compile time (0 = use
+// stride). With a fixed stride the loop vectorizes into clamps, converts
+// and shifts.
+template <int S>
+void toneMapRow(std::uint32_t* out, const float* r, const float* g, const float* b, int stride, int count) {
+    const size_t ns = S ? S : stride;
+    for (int i = 0; i < count; i++) {
+        out[i] = packPixel(r[i * ns], g[i * ns], b[i * ns]);
+    }
+}
+
+}  // namespace
+
+void toneMap(ChannelView r, ChannelView g, ChannelView b, int width, int height,
+             std::uint32_t* pixels, int pitch, ThreadPool* pool, const ActiveTiles* tiles) {
+    // Mixed strides and 16-bit channels take the per-pixel path
+    const bool floats = !r.half && !g.half && !b.half;
+    const int stride = floats && r.stride == g.stride && g.stride == b.stride ? r.stride : 0;
+    auto span = [&](std::uint32_t* out, int row, int begin, int end) {
+        if (stride == 0) {
+            for (int i = begin; i < end; i++) out[i] = packPixel(r[row + i], g[row + i], b[row + i]);
+            return;
+        }
+        const size_t first = static_cast<size_t>(row + begin) * stride;
+        const float* pr = r.data + first;
+        const float* pg = g.data + first;
+        const float* pb = b.data + first;
+        switch (stride) {
+            case 1: toneMapRow<1>(out + begin, pr, pg, pb, 1, end - begin); break;
+            case 3: toneMapRow<3>(out + begin, pr, pg, pb, 3, end - begin); break;
+            case 4: toneMapRow<4>(out + begin, pr, pg, pb, 4, end - begin); break;
+            default: toneMapRow<0>(out + begin, pr, pg, pb, stride, end - begin); break;
+        }
+    };
+    auto rows = [&](int rowBegin, int rowEnd) {
+        for (int j = rowBegin; j < rowEnd; j++) {
+            auto* out = reinterpret_cast<std::uint32_t*>(reinterpret_cast<char*>(pixels) + static_cast<size_t>(j) * pitch);
+            int row = j * width;
+            if (!tiles) {
+                span(out, row, 0, width);
+                continue;
+            }
+            int covered = 0;
+            for (const ActiveTiles::Span& active : tiles->rowSpans(j)) {
+                std::fill(out + covered, out + active.begin, 0xFF000000u);
+                span(out, row, active.begin, active.end);
+                covered = active.end;
+            }
+            std::fill(out + covered, out + width, 0xFF000000u);
+        }
+    };
+    if (pool) {
+        pool->parallelFor(0, height, rows, TONE_MAP_GRAIN);
+    } else {
+        rows(0, height);
+    }
+}
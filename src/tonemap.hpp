@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include "active_tiles.hpp"
+#include "dye.hpp"
+#include "thread_pool.hpp"
+
+// Packs three dye channels into 32-bit 0xAARRGGBB pixels (SDL's ARGB8888),
+// clamping each channel to [0, 1] and scaling by 255. pitch is the byte
+// distance between pixel rows. Rows are split across pool when given.
+// With tiles, only active tiles are read and the rest are filled black.
+void toneMap(ChannelView r, ChannelView g, ChannelView b, int width, int height,
+             std::uint32_t* pixels, int pitch, ThreadPool* pool, const ActiveTiles* tiles = nullptr);
@@ -0,0 +1,37 @@
+#pragma once
+#include <array>
+#include <atomic>
+
+// Lock-free hand-off of whole values from one writer thread to one reader
+// thread. The writer fills writeBuffer() and publishes it; the reader always
+// gets the most recently published value. Neither side ever waits, and
+// values published faster than they are read are simply skipped.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side
+    T& writeBuffer() { return buffers[back]; }
+
+    void publish() {
+        int previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & INDEX_MASK;
+    }
+
+    // Reader side. The reference stays valid until the next call to read().
+    const T& read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            int previous = middle.exchange(front, std::memory_order_acq_rel);
+            front = previous & INDEX_MASK;
+        }
+        return buffers[front];
+    }
+
+private:
+    static constexpr int INDEX_MASK = 3;
+    static constexpr int FRESH = 4;  // set while middle holds an unread value
+
+    std::array<T, 3> buffers;
+    std::atomic<int> middle{1};
+    int back = 0;   // owned by the writer
+    int front = 2;  // owned by the reader
+};
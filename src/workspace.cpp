@@ -0,0 +1,62 @@
+#include "workspace.hpp"
+#include <algorithm>
+
+namespace {
+
+std::size_t alignUp(std::size_t bytes) {
+    return (bytes + WORKSPACE_ALIGNMENT - 1) / WORKSPACE_ALIGNMENT * WORKSPACE_ALIGNMENT;
+}
+
+std::byte* allocateBlock(std::size_t bytes) {
+    return static_cast<std::byte*>(::operator new(bytes, std::align_val_t(WORKSPACE_ALIGNMENT)));
+}
+
+void freeBlock(std::byte* block) {
+    ::operator delete(block, std::align_val_t(WORKSPACE_ALIGNMENT));
+}
+
+}  // namespace
+
+Workspace::~Workspace() {
+    for (const OverflowBlock& block : overflow) freeBlock(block.memory);
+    if (memory) freeBlock(memory);
+}
+
+void Workspace::reserve(std::size_t bytes) {
+    bytes = alignUp(bytes);
+    if (bytes <= capacity) return;
+    if (used > 0 || !overflow.empty()) {
+        // Live buffers point into the current block; grow once it is empty
+        highWater = std::max(highWater, bytes);
+        return;
+    }
+    if (memory) freeBlock(memory);
+    memory = allocateBlock(bytes);
+    capacity = bytes;
+    allocationCount++;
+}
+
+float* Workspace::allocateFloats(std::size_t count) {
+    std::size_t bytes = alignUp(count * sizeof(float));
+    highWater = std::max(highWater, used + overflowBytes + bytes);
+    if (used + bytes <= capacity) {
+        float* result = reinterpret_cast<float*>(memory + used);
+        used += bytes;
+        return result;
+    }
+
+    overflow.push_back({allocateBlock(bytes), bytes});
+    overflowBytes += bytes;
+    allocationCount++;
+    return reinterpret_cast<float*>(overflow.back().memory);
+}
+
+void Workspace::release(std::size_t mark, std::size_t overflowMark) {
+    used = mark;
+    while (overflow.size() > overflowMark) {
+        freeBlock(overflow.back().memory);
+        overflowBytes -= overflow.back().bytes;
+        overflow.pop_back();
+    }
+    if (used == 0 && overflow.empty()) reserve(highWater);
+}
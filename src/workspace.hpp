@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Cache-line alignment of every solver buffer
+constexpr std::size_t WORKSPACE_ALIGNMENT = 64;
+
+// std::allocator replacement returning 64-byte aligned storage
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(WORKSPACE_ALIGNMENT)));
+    }
+    void deallocate(T* ptr, std::size_t) {
+        ::operator delete(ptr, std::align_val_t(WORKSPACE_ALIGNMENT));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Stack arena for scratch buffers that only live during one phase of a step.
+// Buffers are 64-byte aligned and uninitialized. Scopes release everything
+// carved inside them, so once the arena has grown to the high-water mark of
+// a step, later steps never touch the heap. One workspace can be shared by
+// several simulations as long as they do not step concurrently.
+class Workspace {
+public:
+    Workspace() = default;
+    ~Workspace();
+
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    // Makes sure bytes of scratch are available without further allocation
+    void reserve(std::size_t bytes);
+
+    float* allocateFloats(std::size_t count);
+
+    // Releases the buffers allocated during its lifetime
+    class Scope {
+    public:
+        explicit Scope(Workspace& workspace)
+            : workspace(workspace), mark(workspace.used), overflowMark(workspace.overflow.size()) {}
+        ~Scope() { workspace.release(mark, overflowMark); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Workspace& workspace;
+        std::size_t mark;
+        std::size_t overflowMark;
+    };
+
+    std::size_t getCapacity() const { return capacity; }
+    std::size_t getHighWater() const { return highWater; }
+
+    // Heap allocations made by the arena itself; stays constant once warm
+    std::uint64_t getAllocationCount() const { return allocationCount; }
+
+private:
+    void release(std::size_t mark, std::size_t overflowMark);
+
+    std::byte* memory = nullptr;
+    std::size_t capacity = 0;
+    std::size_t used = 0;
+    std::size_t highWater = 0;
+    std::uint64_t allocationCount = 0;
+
+    // Requests that did not fit, freed with the scope that made them. The
+    // main block grows to the high-water mark once the arena is empty again.
+    struct OverflowBlock {
+        std::byte* memory;
+        std::size_t bytes;
+    };
+    std::vector<OverflowBlock> overflow;
+    std::size_t overflowBytes = 0;
+};